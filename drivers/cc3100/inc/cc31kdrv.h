@@ -19,6 +19,12 @@ int cc31k_write(Fd_t fd, unsigned char *pBuff, int len);
 void cc31k_enable(void);
 void cc31k_disable(void);
 int cc31k_registerIrqHandler(irq_handler_t handler, void *pVal);
+void cc31k_dma_irq_handler(int stream);
+
+#ifdef CC31K_SIM
+// the simulated NWP has no IRQ line; it is serviced from the non-OS main loop
+void cc31k_poll(void);
+#endif
 
 
 #endif // CC31KDRV_H
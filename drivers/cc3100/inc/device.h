@@ -330,6 +330,18 @@ typedef struct
        unsigned long reserved[3];  
 }SlDateTime_t;
 
+typedef struct
+{
+    UINT32  AsyncBufAllocs;
+    UINT32  AsyncBufFailures;
+    UINT8   AsyncBufInUse;
+    UINT8   AsyncBufMaxInUse;
+    UINT8   ObjPoolInUse;
+    UINT8   ObjPoolMaxInUse;
+    UINT32  ObjPoolWaits;
+    UINT32  ObjPoolFailures;
+}SlPoolStats_t;
+
 
 
 
@@ -559,6 +571,32 @@ int sl_UartSetMode(const SlUartIfParams_t* pUartParams);
 #endif
 #endif
 
+
+/*!
+    \brief Get the usage statistics of the driver's buffer and action pools
+
+    \param[out]     pStats      Pointer to the statistics:
+                                AsyncBufAllocs   - async message buffers handed out
+                                AsyncBufFailures - async messages dropped for lack of a buffer
+                                AsyncBufInUse    - async message buffers currently held
+                                AsyncBufMaxInUse - high water mark of AsyncBufInUse
+                                ObjPoolWaits     - actions that had to wait for a busy socket or action
+                                ObjPoolFailures  - actions refused with POOL_IS_EMPTY
+                                ObjPoolInUse     - action objects currently held
+                                ObjPoolMaxInUse  - high water mark of ObjPoolInUse
+    \param[in]      Reset       When non-zero, clear the counters and restart the high
+                                water marks from the current usage
+
+    \return         None
+
+    \sa             SL_ASYNC_BUF_POOL_SIZE, MAX_CONCURRENT_ACTIONS
+
+    \note           belongs to \ref basic_api
+
+    \warning
+*/
+void sl_PoolStatsGet(SlPoolStats_t *pStats, UINT8 Reset);
+
 /*!
 
  Close the Doxygen group.
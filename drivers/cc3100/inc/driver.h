@@ -191,6 +191,8 @@ extern void _sl_HandleAsync_Stop(void *pVoidBuf);
 extern int _SlDrvWaitForPoolObj(UINT32 ActionID, UINT8 SocketID);
 extern void _SlDrvReleasePoolObj(UINT8 pObj);
 extern void _SlDrvObjInit(void);  
+extern UINT8 *_SlDrvAsyncBufAlloc(void);
+extern void _SlDrvAsyncBufFree(UINT8 *pBuf);
 
 #define _SL_PROTOCOL_ALIGN_SIZE(msgLen)             (((msgLen)+3) & (~3))
 #define _SL_IS_PROTOCOL_ALIGNED_SIZE(msgLen)        (!((msgLen) & 3))
@@ -353,6 +353,10 @@ extern void sl_NetAppEvtHdlr(SlNetAppEvent_t *pSlSockEvent);
 extern void sl_SockEvtHdlr(SlSockEvent_t *pSlSockEvent);
 #endif
 
+#if (defined(sl_SockSelectEvtHdlr))
+extern void sl_SockSelectEvtHdlr(UINT16 readFds, UINT16 writeFds);
+#endif
+
 #if (defined(sl_HttpServerCallback))
 extern void sl_HttpServerCallback(SlHttpServerEvent_t *pSlHttpServerEvent, SlHttpServerResponse_t *pSlHttpServerResponse);
 #endif
@@ -553,6 +553,23 @@ typedef irq_handler_t                         SL_P_EVENT_HANDLER;
 
 #define sl_IfUnMaskIntHdlr()
 
+/*!
+    \brief      Polls the interface for pending device messages
+
+                Called on every pass of the non-OS main loop. Only needed
+                when the interface has no interrupt line of its own, as with
+                the host-side simulator built with CC31K_SIM.
+
+    \sa         sl_IfRegIntHdlr
+
+    \note       belongs to \ref porting_sec
+
+    \warning
+*/
+#ifdef CC31K_SIM
+#define sl_IfPoll()                         cc31k_poll()
+#endif
+
 /*!
     \brief      Write Handers for statistics debug on write
 
@@ -606,25 +623,44 @@ typedef irq_handler_t                         SL_P_EVENT_HANDLER;
  *****************************************************************************
  */
 
+#define SL_MEMORY_MGMT_STATIC       0
+#define SL_MEMORY_MGMT_DYNAMIC      1
+
 /*!
     \brief      Defines whether the SimpleLink driver is working in dynamic
                 memory model or not
 
-                When defined, the SimpleLink driver use dynamic allocations
-                if dynamic allocation is selected malloc and free functions
-                must be retrieved
+                With SL_MEMORY_MGMT_DYNAMIC the SimpleLink driver use dynamic
+                allocations and malloc and free functions must be retrieved.
+                With SL_MEMORY_MGMT_STATIC the driver control block and the
+                async message buffers are allocated statically
 
-    \sa
+    \sa         SL_ASYNC_BUF_POOL_SIZE
 
     \note       belongs to \ref porting_sec
 
-    \warning
+    \warning    malloc is the MicroPython GC heap on this port, so the dynamic
+                model must not be used
 */
-/*
-#define SL_MEMORY_MGMT_DYNAMIC
+#define SL_MEMORY_MGMT              SL_MEMORY_MGMT_STATIC
+
+/*!
+    \brief      Number of buffers in the static async message pool
+
+                Every async event (accept, connect, close, select...) is read
+                into a buffer of SL_ASYNC_MAX_MSG_LEN bytes taken from this
+                pool. The driver holds one buffer at a time; more are only
+                needed if the port keeps events around after their handler
+
+    \sa         sl_PoolStatsGet
+
+    \note       belongs to \ref porting_sec
+
+    \warning    Must not be more than 32
 */
+#define SL_ASYNC_BUF_POOL_SIZE      1
 
-#ifdef SL_MEMORY_MGMT_DYNAMIC
+#if (SL_MEMORY_MGMT == SL_MEMORY_MGMT_DYNAMIC)
 
 /*!
     \brief
@@ -1004,6 +1040,22 @@ typedef irq_handler_t                         SL_P_EVENT_HANDLER;
 */
 #define sl_SockEvtHdlr              SimpleLinkSockEventHandler
 
+/*!
+    \brief      Socket readiness handler
+
+                Called with the read and write sets of every completed select,
+                before the caller of sl_Select is released. Lets the host track
+                socket readiness without issuing selects of its own.
+
+    \sa         sl_Select
+
+    \note       belongs to \ref porting_sec
+
+    \warning    Called in the driver's async event context; must not call
+                back into the driver
+*/
+#define sl_SockSelectEvtHdlr        SimpleLinkSockSelectEventHandler
+
 
 /*!
 
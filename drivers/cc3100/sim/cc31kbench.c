@@ -0,0 +1,364 @@
+// --------------------------------------------------------------------------------------
+// Module     : CC31KBENCH
+// Throughput and latency benchmark for the SimpleLink host driver on the simulated NWP.
+//
+// Runs the unmodified host driver against cc31ksim.c and a loopback peer, and reports
+// TCP send and receive throughput, round trip latency and the transport counters for
+// each phase.  Exits non-zero if any phase fails, so it doubles as a smoke test.
+// --------------------------------------------------------------------------------------
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "simplelink.h"
+#include "cc31ksim.h"
+#include "cc31kbench.h"
+
+#ifndef BENCH_BYTES
+#define BENCH_BYTES (4 * 1024 * 1024)
+#endif
+
+#ifndef BENCH_CHUNK
+#define BENCH_CHUNK (1460)
+#endif
+
+#ifndef BENCH_ECHO_COUNT
+#define BENCH_ECHO_COUNT (2000)
+#endif
+
+#define BENCH_ECHO_SIZE (64)
+
+// read size of the small read phases, about a line of a text protocol
+#define BENCH_SMALL_READ (64)
+
+// span handed to a single sl_Send in the burst phase, as modcc31k does for TCP
+#ifndef BENCH_BURST
+#define BENCH_BURST (BENCH_CHUNK * 32)
+#endif
+
+// connections opened at once in the non-blocking connect phase
+#ifndef BENCH_NB_CONNS
+#define BENCH_NB_CONNS (4)
+#endif
+
+// SPI clock on the pyboard (42 MHz APB1 / 4), used to turn the longest single
+// transfer into the time it would keep a blocking transport busy
+#ifndef BENCH_SPI_MHZ
+#define BENCH_SPI_MHZ (10)
+#endif
+
+static volatile bool ip_obtained = false;
+static uint16_t peer_port;
+static uint8_t buf[BENCH_BURST];
+
+static uint64_t bench_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void bench_report(const char *name, const char *result)
+{
+    cc31k_sim_stats_t st;
+    cc31k_sim_get_stats(&st);
+    printf("%-8s %-16s %6u cmds %6u msgs %6u irqs %5u dummies %7u rd %7u wr %9u rd_bytes %9u wr_bytes %5u max_xfer (%.0f us at %u MHz)\n",
+        name, result, st.cmds, st.msgs, st.irqs, st.dummies, st.rd_calls, st.wr_calls, st.rd_bytes, st.wr_bytes,
+        st.max_xfer, st.max_xfer * 8.0 / BENCH_SPI_MHZ, BENCH_SPI_MHZ);
+    cc31k_sim_reset_stats();
+}
+
+static int bench_connect(uint8_t req)
+{
+    uint8_t msg[4] = {req};
+    SlSockAddrIn_t addr;
+    int sd = sl_Socket(SL_AF_INET, SL_SOCK_STREAM, 0);
+    if (sd < 0) {
+        return sd;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = SL_AF_INET;
+    addr.sin_port = sl_Htons(peer_port);
+    addr.sin_addr.s_addr = sl_Htonl(0x7f000001);
+    int ret = sl_Connect(sd, (SlSockAddr_t *)&addr, sizeof(addr));
+    if (ret < 0 || sl_Send(sd, msg, 1, 0) != 1) {
+        sl_Close(sd);
+        return ret < 0 ? ret : -1;
+    }
+    return sd;
+}
+
+// open several connections at once on non-blocking sockets, finishing each by
+// asking sl_Connect again until it stops answering SL_EALREADY, as the poll of
+// modcc31k does
+static int bench_nbconnect(void)
+{
+    uint8_t msg[4] = {'S'};
+    SlSockAddrIn_t addr;
+    SlSockNonblocking_t nb = {1};
+    int sd[BENCH_NB_CONNS];
+    int n_open = 0, ret = 0;
+    uint32_t pending = 0;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = SL_AF_INET;
+    addr.sin_port = sl_Htons(peer_port);
+    addr.sin_addr.s_addr = sl_Htonl(0x7f000001);
+
+    for (; n_open < BENCH_NB_CONNS; n_open++) {
+        sd[n_open] = sl_Socket(SL_AF_INET, SL_SOCK_STREAM, 0);
+        if (sd[n_open] < 0) {
+            ret = sd[n_open];
+            break;
+        }
+        if (sl_SetSockOpt(sd[n_open], SL_SOL_SOCKET, SL_SO_NONBLOCKING, &nb, sizeof(nb)) < 0) {
+            ret = -1;
+            n_open += 1;
+            break;
+        }
+        int r = sl_Connect(sd[n_open], (SlSockAddr_t *)&addr, sizeof(addr));
+        if (r == SL_EALREADY) {
+            pending |= 1 << n_open;
+        } else if (r != 0) {
+            ret = r;
+            n_open += 1;
+            break;
+        }
+    }
+    while (ret == 0 && pending != 0) {
+        for (int i = 0; i < n_open; i++) {
+            if (!(pending & (1 << i))) {
+                continue;
+            }
+            int r = sl_Connect(sd[i], (SlSockAddr_t *)&addr, sizeof(addr));
+            if (r == 0 || r == SL_EISCONN) {
+                pending &= ~(1 << i);
+            } else if (r != SL_EALREADY) {
+                ret = r;
+                break;
+            }
+        }
+    }
+    for (int i = 0; i < n_open; i++) {
+        if (ret == 0 && sl_Send(sd[i], msg, 1, 0) != 1) {
+            ret = -1;
+        }
+        sl_Close(sd[i]);
+    }
+    if (ret != 0) {
+        return ret;
+    }
+
+    char result[32];
+    snprintf(result, sizeof(result), "%d connects", BENCH_NB_CONNS);
+    bench_report("nbconn", result);
+    return 0;
+}
+
+static int bench_tx(const char *name, int len)
+{
+    int sd = bench_connect('S');
+    if (sd < 0) {
+        return sd;
+    }
+    memset(buf, 0xa5, len);
+    uint64_t t0 = bench_us();
+    for (uint32_t n = 0; n < BENCH_BYTES; ) {
+        int ret = sl_Send(sd, buf, len, 0);
+        if (ret <= 0) {
+            sl_Close(sd);
+            return -1;
+        }
+        n += ret;
+    }
+    uint64_t us = bench_us() - t0;
+    sl_Close(sd);
+
+    char result[32];
+    snprintf(result, sizeof(result), "%.1f MB/s", (double)BENCH_BYTES / us);
+    bench_report(name, result);
+    return 0;
+}
+
+// read the stream in pieces of len bytes, refilling a read-ahead buffer of
+// ahead bytes (0 for none) as modcc31k does
+static int bench_rx(const char *name, int len, int ahead)
+{
+    static uint8_t rx_buf[BENCH_CHUNK];
+    int rx_pos = 0, rx_len = 0;
+    int sd = bench_connect('G');
+    if (sd < 0) {
+        return sd;
+    }
+    uint32_t total = sl_Htonl(BENCH_BYTES);
+    uint64_t t0 = bench_us();
+    if (sl_Send(sd, &total, sizeof(total), 0) != sizeof(total)) {
+        sl_Close(sd);
+        return -1;
+    }
+    uint32_t n = 0;
+    for (;;) {
+        int ret;
+        if (ahead > 0) {
+            if (rx_pos == rx_len) {
+                rx_len = sl_Recv(sd, rx_buf, ahead, 0);
+                rx_pos = 0;
+                if (rx_len <= 0) {
+                    break;
+                }
+            }
+            ret = rx_len - rx_pos < len ? rx_len - rx_pos : len;
+            memcpy(buf, rx_buf + rx_pos, ret);
+            rx_pos += ret;
+        } else {
+            ret = sl_Recv(sd, buf, len, 0);
+        }
+        if (ret <= 0) {
+            break;
+        }
+        n += ret;
+    }
+    uint64_t us = bench_us() - t0;
+    sl_Close(sd);
+    if (n != BENCH_BYTES) {
+        printf("%s: got %u of %u bytes\n", name, n, BENCH_BYTES);
+        return -1;
+    }
+
+    char result[32];
+    snprintf(result, sizeof(result), "%.1f MB/s", (double)BENCH_BYTES / us);
+    bench_report(name, result);
+    return 0;
+}
+
+static int bench_echo(void)
+{
+    int sd = bench_connect('E');
+    if (sd < 0) {
+        return sd;
+    }
+    memset(buf, 0x3c, BENCH_ECHO_SIZE);
+    uint64_t t0 = bench_us();
+    for (int i = 0; i < BENCH_ECHO_COUNT; i++) {
+        if (sl_Send(sd, buf, BENCH_ECHO_SIZE, 0) != BENCH_ECHO_SIZE) {
+            sl_Close(sd);
+            return -1;
+        }
+        for (int n = 0; n < BENCH_ECHO_SIZE; ) {
+            int ret = sl_Recv(sd, buf + n, BENCH_ECHO_SIZE - n, 0);
+            if (ret <= 0) {
+                sl_Close(sd);
+                return -1;
+            }
+            n += ret;
+        }
+    }
+    uint64_t us = bench_us() - t0;
+    sl_Close(sd);
+
+    char result[32];
+    snprintf(result, sizeof(result), "%.1f us rtt", (double)us / BENCH_ECHO_COUNT);
+    bench_report("echo", result);
+    return 0;
+}
+
+int main(void)
+{
+    // the driver clocks out whole words, so every buffer it sends is padded to
+    // a multiple of four
+    static char ssid[4] = "sim";
+    static char host[12] = "localhost";
+    SlSecParams_t sec = {SL_SEC_TYPE_OPEN, NULL, 0};
+    unsigned long ip = 0;
+
+    if (bench_peer_start(&peer_port) != 0) {
+        printf("cannot start peer\n");
+        return 1;
+    }
+    if (sl_Start(0, 0, 0) != ROLE_STA) {
+        printf("sl_Start failed\n");
+        return 1;
+    }
+    if (sl_WlanConnect(ssid, 3, 0, &sec, 0) < 0) {
+        printf("sl_WlanConnect failed\n");
+        return 1;
+    }
+    while (!ip_obtained) {
+        _SlNonOsMainLoopTask();
+    }
+    if (sl_NetAppDnsGetHostByName(host, 9, &ip, SL_AF_INET) < 0 || ip != 0x7f000001) {
+        printf("sl_NetAppDnsGetHostByName failed\n");
+        return 1;
+    }
+    bench_report("setup", "ok");
+
+    int ret = bench_nbconnect();
+    if (ret == 0) {
+        ret = bench_tx("tx", BENCH_CHUNK);
+    }
+    if (ret == 0) {
+        ret = bench_tx("txburst", BENCH_BURST);
+    }
+    if (ret == 0) {
+        ret = bench_rx("rx", BENCH_CHUNK, 0);
+    }
+    if (ret == 0) {
+        ret = bench_rx("rxsmall", BENCH_SMALL_READ, 0);
+    }
+    if (ret == 0) {
+        ret = bench_rx("rxahead", BENCH_SMALL_READ, BENCH_CHUNK);
+    }
+    if (ret == 0) {
+        ret = bench_echo();
+    }
+    sl_Stop(100);
+    if (ret != 0) {
+        printf("benchmark failed: %d\n", ret);
+        return 1;
+    }
+
+    SlPoolStats_t ps;
+    sl_PoolStatsGet(&ps, 0);
+    printf("pools    async %u allocs %u failed %u max in use, actions %u waits %u failed %u max in use\n",
+        ps.AsyncBufAllocs, ps.AsyncBufFailures, ps.AsyncBufMaxInUse,
+        ps.ObjPoolWaits, ps.ObjPoolFailures, ps.ObjPoolMaxInUse);
+    return 0;
+}
+
+// --------------------------------------------------------------------------------------
+// SimpleLink event handlers
+// --------------------------------------------------------------------------------------
+
+void SimpleLinkWlanEventHandler(SlWlanEvent_t *pWlanEvent)
+{
+    if (pWlanEvent->Event == SL_WLAN_DISCONNECT_EVENT) {
+        ip_obtained = false;
+    }
+}
+
+void SimpleLinkNetAppEventHandler(SlNetAppEvent_t *pNetAppEvent)
+{
+    if (pNetAppEvent->Event == SL_NETAPP_IPV4_ACQUIRED) {
+        ip_obtained = true;
+    }
+}
+
+void SimpleLinkHttpServerCallback(SlHttpServerEvent_t *pHttpEvent, SlHttpServerResponse_t *pHttpResponse)
+{
+}
+
+void SimpleLinkGeneralEventHandler(SlDeviceEvent_t *pDevEvent)
+{
+    printf("general event %d\n", (int)pDevEvent->Event);
+}
+
+void SimpleLinkSockEventHandler(SlSockEvent_t *pSock)
+{
+}
+
+void SimpleLinkSockSelectEventHandler(uint16_t readFds, uint16_t writeFds)
+{
+}
@@ -0,0 +1,14 @@
+// --------------------------------------------------------------------------------------
+// Module     : CC31KBENCH
+// Throughput and latency benchmark for the SimpleLink host driver on the simulated NWP.
+// --------------------------------------------------------------------------------------
+
+#ifndef CC31KBENCH_H
+#define CC31KBENCH_H
+
+#include <stdint.h>
+
+// start the loopback peer thread; returns its port in host byte order
+int bench_peer_start(uint16_t *port);
+
+#endif // CC31KBENCH_H
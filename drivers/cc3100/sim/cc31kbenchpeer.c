@@ -0,0 +1,97 @@
+// --------------------------------------------------------------------------------------
+// Module     : CC31KBENCHPEER
+// Loopback peer for cc31kbench, run in a thread on plain host sockets.
+//
+// Each connection starts with a one byte request:
+//   'S' <data>         sink: read and discard until the other end closes
+//   'G' <u32 len>      source: write len bytes then close
+//   'E' <data>         echo: write back whatever is read until the other end closes
+// --------------------------------------------------------------------------------------
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "cc31kbench.h"
+
+static int peer_fd = -1;
+
+static void peer_serve(int fd)
+{
+    static uint8_t buf[16384];
+    uint8_t req;
+    if (recv(fd, &req, 1, MSG_WAITALL) != 1) {
+        return;
+    }
+    if (req == 'G') {
+        uint32_t len;
+        if (recv(fd, &len, sizeof(len), MSG_WAITALL) != sizeof(len)) {
+            return;
+        }
+        len = ntohl(len);
+        memset(buf, 0x5a, sizeof(buf));
+        while (len > 0) {
+            int n = send(fd, buf, len < sizeof(buf) ? len : sizeof(buf), MSG_NOSIGNAL);
+            if (n <= 0) {
+                return;
+            }
+            len -= n;
+        }
+        return;
+    }
+    for (;;) {
+        int n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            return;
+        }
+        if (req == 'E' && send(fd, buf, n, MSG_NOSIGNAL) != n) {
+            return;
+        }
+    }
+}
+
+static void *peer_thread(void *arg)
+{
+    for (;;) {
+        int fd = accept(peer_fd, NULL, NULL);
+        if (fd < 0) {
+            break;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        peer_serve(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+int bench_peer_start(uint16_t *port)
+{
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+    pthread_t thread;
+
+    peer_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (peer_fd < 0) {
+        return -1;
+    }
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(peer_fd, (struct sockaddr *)&sin, sizeof(sin)) < 0
+        || listen(peer_fd, 4) < 0
+        || getsockname(peer_fd, (struct sockaddr *)&sin, &len) < 0) {
+        return -1;
+    }
+    *port = ntohs(sin.sin_port);
+    if (pthread_create(&thread, NULL, peer_thread, NULL) != 0) {
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
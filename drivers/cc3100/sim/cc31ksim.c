@@ -0,0 +1,744 @@
+// --------------------------------------------------------------------------------------
+// Module     : CC31KSIM
+// Simulated CC3100 network processor, linked in place of cc31kdrv.c on a host build.
+//
+// The host side of the SPI link is modelled byte for byte: the driver writes a sync
+// pattern, header, descriptors and payload for each command, and reads each message
+// after writing the CNYS pattern in response to an IRQ.  Like the real NWP only one
+// message is signalled at a time; the next IRQ is raised from cc31k_poll() once the
+// driver has moved on, which the non-OS main loop calls while it waits.
+// --------------------------------------------------------------------------------------
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simplelink.h"
+#include "protocol.h"
+#include "flowcont.h"
+#include "cc31ksim.h"
+
+#define SIM_ALIGN(len)          (((len) + 3) & ~3)
+#define SIM_RESPONSE(opcode)    ((opcode) & ~0x8000)
+#define SIM_HDR_SIZE            (SYNC_PATTERN_LEN + _SL_RESP_HDR_SIZE)
+
+typedef struct _sim_msg_t {
+    struct _sim_msg_t *next;
+    uint32_t len;
+    uint8_t buf[];              // N2H sync pattern, response header, payload
+} sim_msg_t;
+
+typedef struct _sim_sock_t {
+    int fd;                     // host socket, -1 when the slot is free
+    uint8_t sd;                 // socket id with the payload type in the top nibble
+    bool nonblocking;
+    bool accept_pending;
+    bool connecting;            // non-blocking connect reported as in progress
+    int16_t connect_status;     // its result, handed out on the next connect
+    uint16_t recv_op;           // pending recv/recvfrom async opcode, 0 if none
+    uint16_t recv_len;
+    uint32_t rcvtimeo;          // in ms, 0 for none
+    uint32_t deadline;
+} sim_sock_t;
+
+typedef struct _sim_select_t {
+    bool pending;
+    bool forever;
+    uint16_t rd;
+    uint16_t wr;
+    uint32_t deadline;
+} sim_select_t;
+
+static const uint8_t sim_h2n_sync[SYNC_PATTERN_LEN] = {0x21, 0x43, 0x34, 0x12};
+static const uint8_t sim_h2n_cnys[SYNC_PATTERN_LEN] = {0x65, 0x87, 0x78, 0x56};
+
+static struct {
+    irq_handler_t irq_handler;
+    bool enabled;
+    bool irq_pending;           // IRQ raised for the head message, CNYS not seen yet
+    bool serving;               // a message is being clocked out to the host
+    bool wlan_connected;
+    sim_msg_t *head;
+    sim_msg_t *tail;
+    sim_msg_t *cur;
+    uint32_t cur_pos;
+    uint8_t *in_buf;
+    uint32_t in_len;
+    uint32_t in_alloc;
+    uint8_t host_pool;          // TX credits as the host counts them
+    uint8_t tx_failure;
+    sim_sock_t sock[SL_MAX_SOCKETS];
+    sim_select_t select;
+    cc31k_sim_stats_t stats;
+} sim;
+
+// --------------------------------------------------------------------------------------
+// NWP-to-host message queue
+// --------------------------------------------------------------------------------------
+
+static void sim_queue(uint16_t opcode, const void *args, uint32_t args_len, const void *data, uint32_t data_len)
+{
+    uint32_t len = SIM_HDR_SIZE + SIM_ALIGN(args_len) + SIM_ALIGN(data_len);
+    sim_msg_t *msg = calloc(1, sizeof(sim_msg_t) + len);
+    if (msg == NULL) {
+        return;
+    }
+    msg->len = len;
+    uint32_t sync = N2H_SYNC_PATTERN;
+    memcpy(msg->buf, &sync, SYNC_PATTERN_LEN);
+    _SlResponseHeader_t *hdr = (_SlResponseHeader_t *)(msg->buf + SYNC_PATTERN_LEN);
+    hdr->GenHeader.Opcode = opcode;
+    hdr->GenHeader.Len = _SL_RESP_SPEC_HDR_SIZE + args_len + data_len;
+    if (args_len > 0) {
+        memcpy(msg->buf + SIM_HDR_SIZE, args, args_len);
+    }
+    if (data_len > 0) {
+        memcpy(msg->buf + SIM_HDR_SIZE + SIM_ALIGN(args_len), data, data_len);
+    }
+    if (sim.tail != NULL) {
+        sim.tail->next = msg;
+    } else {
+        sim.head = msg;
+    }
+    sim.tail = msg;
+}
+
+static void sim_queue_basic(uint16_t opcode, int16_t status)
+{
+    _BasicResponse_t rsp = {status, 0};
+    sim_queue(opcode, &rsp, sizeof(rsp), NULL, 0);
+}
+
+static void sim_queue_sock(uint16_t opcode, int16_t status, uint8_t sd)
+{
+    _SocketResponse_t rsp = {status, sd, 0};
+    sim_queue(opcode, &rsp, sizeof(rsp), NULL, 0);
+}
+
+static void sim_flush(void)
+{
+    while (sim.head != NULL) {
+        sim_msg_t *msg = sim.head;
+        sim.head = msg->next;
+        free(msg);
+    }
+    sim.tail = NULL;
+    free(sim.cur);
+    sim.cur = NULL;
+    sim.irq_pending = false;
+    sim.serving = false;
+}
+
+// the host wrote CNYS: start clocking out the message its IRQ announced
+static void sim_serve(void)
+{
+    free(sim.cur);
+    sim.cur = sim.head;
+    sim.cur_pos = 0;
+    sim.irq_pending = false;
+    if (sim.cur == NULL) {
+        return;
+    }
+    sim.head = sim.cur->next;
+    if (sim.head == NULL) {
+        sim.tail = NULL;
+    }
+    sim.serving = true;
+    sim.stats.msgs++;
+
+    // flow control and socket state are reported as of the time of reading
+    _SlResponseHeader_t *hdr = (_SlResponseHeader_t *)(sim.cur->buf + SYNC_PATTERN_LEN);
+    uint8_t nonblocking = 0;
+    for (int i = 0; i < SL_MAX_SOCKETS; i++) {
+        if (sim.sock[i].fd >= 0 && sim.sock[i].nonblocking) {
+            nonblocking |= 1 << i;
+        }
+    }
+    hdr->TxPoolCnt = CC31K_SIM_TX_POOL;
+    hdr->SocketTXFailure = sim.tx_failure;
+    hdr->SocketNonBlocking = nonblocking;
+    if (hdr->GenHeader.Opcode != SL_OPCODE_DEVICE_INITCOMPLETE) {
+        sim.host_pool = CC31K_SIM_TX_POOL;
+    }
+}
+
+static void sim_kick(void)
+{
+    if (sim.enabled && sim.irq_handler != NULL && sim.head != NULL && !sim.irq_pending && !sim.serving) {
+        sim.irq_pending = true;
+        sim.stats.irqs++;
+        sim.irq_handler(0);
+    }
+}
+
+// --------------------------------------------------------------------------------------
+// Sockets
+// --------------------------------------------------------------------------------------
+
+static sim_sock_t *sim_sock_get(uint8_t sd)
+{
+    uint8_t id = sd & BSD_SOCKET_ID_MASK;
+    if (id >= SL_MAX_SOCKETS || sim.sock[id].fd < 0) {
+        return NULL;
+    }
+    return &sim.sock[id];
+}
+
+static sim_sock_t *sim_sock_alloc(int fd, bool stream)
+{
+    for (int i = 0; i < SL_MAX_SOCKETS; i++) {
+        sim_sock_t *s = &sim.sock[i];
+        if (s->fd < 0) {
+            memset(s, 0, sizeof(*s));
+            s->fd = fd;
+            s->sd = i | (stream ? SL_SOCKET_PAYLOAD_TYPE_TCP_IPV4 : SL_SOCKET_PAYLOAD_TYPE_UDP_IPV4);
+            sim.tx_failure &= ~(1 << i);
+            return s;
+        }
+    }
+    return NULL;
+}
+
+static void sim_sock_free(sim_sock_t *s)
+{
+    simhost_close(s->fd);
+    s->fd = -1;
+    s->recv_op = 0;
+    s->accept_pending = false;
+}
+
+static bool sim_expired(uint32_t deadline)
+{
+    return (int32_t)(simhost_ticks_ms() - deadline) >= 0;
+}
+
+// complete a pending accept if a connection is waiting, or if it must not wait
+static void sim_try_accept(sim_sock_t *s)
+{
+    _SocketAddrAsyncIPv4Response_t rsp;
+    memset(&rsp, 0, sizeof(rsp));
+    rsp.sd = s->sd;
+    rsp.family = SL_AF_INET;
+
+    uint32_t addr;
+    uint16_t port;
+    int fd = simhost_accept(s->fd, &addr, &port);
+    if (fd == SL_EAGAIN && !s->nonblocking) {
+        s->accept_pending = true;
+        return;
+    }
+    if (fd >= 0) {
+        sim_sock_t *ns = sim_sock_alloc(fd, true);
+        if (ns == NULL) {
+            simhost_close(fd);
+            rsp.statusOrLen = SL_ENSOCK;
+        } else {
+            rsp.statusOrLen = ns->sd;
+            rsp.port = port;
+            rsp.address = addr;
+        }
+    } else {
+        rsp.statusOrLen = fd;
+    }
+    s->accept_pending = false;
+    sim_queue(SL_OPCODE_SOCKET_ACCEPTASYNCRESPONSE, &rsp, sizeof(rsp), NULL, 0);
+}
+
+// complete a pending recv if data, EOF or an error is available, or if it must not wait
+static void sim_try_recv(sim_sock_t *s)
+{
+    uint8_t buf[CC31K_SIM_MAX_RX_CHUNK];
+    uint32_t addr = 0;
+    uint16_t port = 0;
+    int n;
+    if (s->recv_op == SL_OPCODE_SOCKET_RECVFROMASYNCRESPONSE) {
+        n = simhost_recvfrom(s->fd, buf, s->recv_len, &addr, &port);
+    } else {
+        n = simhost_recv(s->fd, buf, s->recv_len);
+    }
+    if (n == SL_EAGAIN && !s->nonblocking && (s->rcvtimeo == 0 || !sim_expired(s->deadline))) {
+        return;
+    }
+
+    uint16_t op = s->recv_op;
+    s->recv_op = 0;
+    if (op == SL_OPCODE_SOCKET_RECVFROMASYNCRESPONSE) {
+        _SocketAddrAsyncIPv4Response_t rsp;
+        memset(&rsp, 0, sizeof(rsp));
+        rsp.statusOrLen = n;
+        rsp.sd = s->sd;
+        rsp.family = SL_AF_INET;
+        rsp.port = port;
+        rsp.address = addr;
+        sim_queue(op, &rsp, sizeof(rsp), buf, n > 0 ? n : 0);
+    } else {
+        _SocketResponse_t rsp = {n, s->sd, 0};
+        sim_queue(op, &rsp, sizeof(rsp), buf, n > 0 ? n : 0);
+    }
+}
+
+static void sim_try_select(void)
+{
+    _SelectAsyncResponse_t rsp;
+    memset(&rsp, 0, sizeof(rsp));
+    for (int i = 0; i < SL_MAX_SOCKETS; i++) {
+        if (sim.sock[i].fd < 0 || !((sim.select.rd | sim.select.wr) & (1 << i))) {
+            continue;
+        }
+        int ready = simhost_ready(sim.sock[i].fd);
+        if ((sim.select.rd & (1 << i)) && (ready & SIMHOST_RD)) {
+            rsp.readFds |= 1 << i;
+            rsp.readFdsCount++;
+        }
+        if ((sim.select.wr & (1 << i)) && (ready & SIMHOST_WR)) {
+            rsp.writeFds |= 1 << i;
+            rsp.writeFdsCount++;
+        }
+    }
+    rsp.status = rsp.readFdsCount + rsp.writeFdsCount;
+    if (rsp.status == 0 && (sim.select.forever || !sim_expired(sim.select.deadline))) {
+        return;
+    }
+    sim.select.pending = false;
+    sim_queue(SL_OPCODE_SOCKET_SELECTASYNCRESPONSE, &rsp, sizeof(rsp), NULL, 0);
+}
+
+static void sim_socket_cmd(uint16_t opcode, uint8_t *p, uint32_t len)
+{
+    uint8_t *data = p + sizeof(_sendRecvCommand_t);
+    uint32_t data_len = len > sizeof(_sendRecvCommand_t) ? len - sizeof(_sendRecvCommand_t) : 0;
+    sim_sock_t *s = NULL;
+    if (opcode != SL_OPCODE_SOCKET_SOCKET && opcode != SL_OPCODE_SOCKET_SELECT) {
+        // every other socket command carries the descriptor in its third byte
+        // or, for the byte-aligned ones, in the first
+        uint8_t sd = (opcode == SL_OPCODE_SOCKET_CLOSE || opcode == SL_OPCODE_SOCKET_ACCEPT
+            || opcode == SL_OPCODE_SOCKET_LISTEN || opcode == SL_OPCODE_SOCKET_SETSOCKOPT
+            || opcode == SL_OPCODE_SOCKET_GETSOCKOPT) ? p[0] : p[2];
+        s = sim_sock_get(sd);
+        if (s == NULL) {
+            switch (opcode) {
+                case SL_OPCODE_SOCKET_SEND:
+                case SL_OPCODE_SOCKET_SENDTO:
+                    break;
+                case SL_OPCODE_SOCKET_RECV:
+                    sim_queue_sock(SL_OPCODE_SOCKET_RECVASYNCRESPONSE, SL_EBADF, sd);
+                    break;
+                case SL_OPCODE_SOCKET_RECVFROM: {
+                    _SocketAddrAsyncIPv4Response_t rsp;
+                    memset(&rsp, 0, sizeof(rsp));
+                    rsp.statusOrLen = SL_EBADF;
+                    rsp.sd = sd;
+                    sim_queue(SL_OPCODE_SOCKET_RECVFROMASYNCRESPONSE, &rsp, sizeof(rsp), NULL, 0);
+                    break;
+                }
+                case SL_OPCODE_SOCKET_LISTEN:
+                    sim_queue_basic(SIM_RESPONSE(opcode), SL_EBADF);
+                    break;
+                default:
+                    sim_queue_sock(SIM_RESPONSE(opcode), SL_EBADF, sd);
+                    break;
+            }
+            return;
+        }
+    }
+
+    switch (opcode) {
+        case SL_OPCODE_SOCKET_SOCKET: {
+            _SocketCommand_t *cmd = (_SocketCommand_t *)p;
+            bool stream = (cmd->Type == SL_SOCK_STREAM);
+            if (cmd->Domain != SL_AF_INET || (cmd->Type != SL_SOCK_STREAM && cmd->Type != SL_SOCK_DGRAM)) {
+                sim_queue_sock(SL_OPCODE_SOCKET_SOCKETRESPONSE, SL_EPROTONOSUPPORT, 0);
+                break;
+            }
+            int fd = simhost_socket(stream);
+            if (fd < 0) {
+                sim_queue_sock(SL_OPCODE_SOCKET_SOCKETRESPONSE, fd, 0);
+                break;
+            }
+            s = sim_sock_alloc(fd, stream);
+            if (s == NULL) {
+                simhost_close(fd);
+                sim_queue_sock(SL_OPCODE_SOCKET_SOCKETRESPONSE, SL_ENSOCK, 0);
+                break;
+            }
+            sim_queue_sock(SL_OPCODE_SOCKET_SOCKETRESPONSE, 0, s->sd);
+            break;
+        }
+
+        case SL_OPCODE_SOCKET_CLOSE: {
+            uint8_t sd = s->sd;
+            sim_sock_free(s);
+            sim_queue_sock(SL_OPCODE_SOCKET_CLOSERESPONSE, 0, sd);
+            break;
+        }
+
+        case SL_OPCODE_SOCKET_BIND: {
+            _SocketAddrIPv4Command_t *cmd = (_SocketAddrIPv4Command_t *)p;
+            sim_queue_sock(SL_OPCODE_SOCKET_BINDRESPONSE, simhost_bind(s->fd, cmd->address, cmd->port), s->sd);
+            break;
+        }
+
+        case SL_OPCODE_SOCKET_LISTEN: {
+            _ListenCommand_t *cmd = (_ListenCommand_t *)p;
+            sim_queue_basic(SL_OPCODE_SOCKET_LISTENRESPONSE, simhost_listen(s->fd, cmd->backlog));
+            break;
+        }
+
+        case SL_OPCODE_SOCKET_ACCEPT:
+            sim_queue_sock(SL_OPCODE_SOCKET_ACCEPTRESPONSE, 0, s->sd);
+            sim_try_accept(s);
+            break;
+
+        case SL_OPCODE_SOCKET_CONNECT: {
+            // host loopback connects complete at once, so this one blocks; a
+            // non-blocking socket is told SL_EALREADY first, as the NWP does
+            // while the handshake runs, and gets the result when it asks again
+            _SocketAddrIPv4Command_t *cmd = (_SocketAddrIPv4Command_t *)p;
+            if (s->nonblocking && !s->connecting) {
+                s->connect_status = simhost_connect(s->fd, cmd->address, cmd->port);
+                s->connecting = true;
+                sim_queue_sock(SL_OPCODE_SOCKET_CONNECTRESPONSE, SL_EALREADY, s->sd);
+                break;
+            }
+            int status = s->connecting ? s->connect_status : simhost_connect(s->fd, cmd->address, cmd->port);
+            s->connecting = false;
+            sim_queue_sock(SL_OPCODE_SOCKET_CONNECTRESPONSE, 0, s->sd);
+            sim_queue_sock(SL_OPCODE_SOCKET_CONNECTASYNCRESPONSE, status, s->sd);
+            break;
+        }
+
+        case SL_OPCODE_SOCKET_SELECT: {
+            _SelectCommand_t *cmd = (_SelectCommand_t *)p;
+            sim_queue_basic(SL_OPCODE_SOCKET_SELECTRESPONSE, 0);
+            sim.select.pending = true;
+            sim.select.rd = cmd->readFds;
+            sim.select.wr = cmd->writeFds;
+            // the driver has already scaled tv_usec down to milliseconds
+            sim.select.forever = (cmd->tv_sec == 0xffff && cmd->tv_usec == 0xffff);
+            sim.select.deadline = simhost_ticks_ms() + cmd->tv_sec * 1000 + cmd->tv_usec;
+            sim_try_select();
+            break;
+        }
+
+        case SL_OPCODE_SOCKET_SETSOCKOPT: {
+            _setSockOptCommand_t *cmd = (_setSockOptCommand_t *)p;
+            uint8_t *optval = p + sizeof(_setSockOptCommand_t);
+            if (cmd->level == SL_SOL_SOCKET && cmd->optionName == SL_SO_NONBLOCKING && cmd->optionLen >= sizeof(uint32_t)) {
+                uint32_t val;
+                memcpy(&val, optval, sizeof(val));
+                s->nonblocking = (val != 0);
+            } else if (cmd->level == SL_SOL_SOCKET && cmd->optionName == SL_SO_RCVTIMEO && cmd->optionLen >= sizeof(SlTimeval_t)) {
+                SlTimeval_t tv;
+                memcpy(&tv, optval, sizeof(tv));
+                s->rcvtimeo = tv.tv_sec * 1000 + tv.tv_usec / 1000;
+            }
+            sim_queue_sock(SL_OPCODE_SOCKET_SETSOCKOPTRESPONSE, 0, s->sd);
+            break;
+        }
+
+        case SL_OPCODE_SOCKET_GETSOCKOPT: {
+            _getSockOptCommand_t *cmd = (_getSockOptCommand_t *)p;
+            _getSockOptResponse_t rsp = {0, s->sd, cmd->optionLen};
+            uint8_t val[256];
+            memset(val, 0, sizeof(val));
+            if (cmd->level == SL_SOL_SOCKET && cmd->optionName == SL_SO_NONBLOCKING) {
+                val[0] = s->nonblocking;
+            }
+            sim_queue(SL_OPCODE_SOCKET_GETSOCKOPTRESPONSE, &rsp, sizeof(rsp), val, cmd->optionLen);
+            break;
+        }
+
+        case SL_OPCODE_SOCKET_RECV:
+        case SL_OPCODE_SOCKET_RECVFROM: {
+            _sendRecvCommand_t *cmd = (_sendRecvCommand_t *)p;
+            s->recv_op = (opcode == SL_OPCODE_SOCKET_RECV) ? SL_OPCODE_SOCKET_RECVASYNCRESPONSE : SL_OPCODE_SOCKET_RECVFROMASYNCRESPONSE;
+            s->recv_len = cmd->StatusOrLen < CC31K_SIM_MAX_RX_CHUNK ? cmd->StatusOrLen : CC31K_SIM_MAX_RX_CHUNK;
+            s->deadline = simhost_ticks_ms() + s->rcvtimeo;
+            sim.host_pool--;
+            sim_try_recv(s);
+            break;
+        }
+
+        case SL_OPCODE_SOCKET_SEND:
+        case SL_OPCODE_SOCKET_SENDTO: {
+            int n;
+            if (opcode == SL_OPCODE_SOCKET_SEND) {
+                _sendRecvCommand_t *cmd = (_sendRecvCommand_t *)p;
+                if (cmd->StatusOrLen < data_len) {
+                    data_len = cmd->StatusOrLen;
+                }
+                n = 0;
+                while (n >= 0 && data_len > 0) {
+                    n = simhost_send(s->fd, data, data_len);
+                    if (n > 0) {
+                        data += n;
+                        data_len -= n;
+                    }
+                }
+            } else {
+                _SocketAddrIPv4Command_t *cmd = (_SocketAddrIPv4Command_t *)p;
+                data = p + sizeof(_SocketAddrIPv4Command_t);
+                data_len = len - sizeof(_SocketAddrIPv4Command_t);
+                if ((uint16_t)cmd->lenOrPadding < data_len) {
+                    data_len = (uint16_t)cmd->lenOrPadding;
+                }
+                n = simhost_sendto(s->fd, data, data_len, cmd->address, cmd->port);
+            }
+            if (n < 0) {
+                sim.tx_failure |= 1 << (s->sd & BSD_SOCKET_ID_MASK);
+            }
+            sim.host_pool--;
+            break;
+        }
+
+        default:
+            sim_queue(SIM_RESPONSE(opcode), NULL, 0, NULL, 0);
+            break;
+    }
+}
+
+// --------------------------------------------------------------------------------------
+// Host-to-NWP commands
+// --------------------------------------------------------------------------------------
+
+static void sim_command(uint16_t opcode, uint8_t *p, uint32_t len)
+{
+    sim.stats.cmds++;
+
+    if ((opcode & SL_OPCODE_SILO_MASK) == SL_OPCODE_SILO_SOCKET) {
+        sim_socket_cmd(opcode, p, len);
+    } else {
+        switch (opcode) {
+            case SL_OPCODE_DEVICE_STOP_COMMAND:
+                for (int i = 0; i < SL_MAX_SOCKETS; i++) {
+                    if (sim.sock[i].fd >= 0) {
+                        sim_sock_free(&sim.sock[i]);
+                    }
+                }
+                sim.wlan_connected = false;
+                sim_queue_basic(SL_OPCODE_DEVICE_STOP_RESPONSE, 0);
+                sim_queue_basic(SL_OPCODE_DEVICE_STOP_ASYNC_RESPONSE, 0);
+                break;
+
+            case SL_OPCODE_WLAN_WLANCONNECTCOMMAND: {
+                // any network will do; the host's loopback sits behind it
+                sl_protocol_wlanConnectAsyncResponse_t con;
+                _IpV4AcquiredAsync_t ip;
+                memset(&con, 0, sizeof(con));
+                ip.ip = 0x7f000001;
+                ip.gateway = 0x7f000001;
+                ip.dns = 0x7f000001;
+                sim_queue_basic(SIM_RESPONSE(opcode), 0);
+                sim_queue(SL_OPCODE_WLAN_WLANASYNCCONNECTEDRESPONSE, &con, sizeof(con), NULL, 0);
+                sim_queue(SL_OPCODE_NETAPP_IPACQUIRED, &ip, sizeof(ip), NULL, 0);
+                sim.wlan_connected = true;
+                break;
+            }
+
+            case SL_OPCODE_WLAN_WLANDISCONNECTCOMMAND:
+                if (sim.wlan_connected) {
+                    sl_protocol_wlanConnectAsyncResponse_t con;
+                    memset(&con, 0, sizeof(con));
+                    con.reason_code = SL_USER_INITIATED_DISCONNECTION;
+                    sim_queue_basic(SIM_RESPONSE(opcode), 0);
+                    sim_queue(SL_OPCODE_WLAN_WLANASYNCDISCONNECTEDRESPONSE, &con, sizeof(con), NULL, 0);
+                    sim.wlan_connected = false;
+                } else {
+                    sim_queue_basic(SIM_RESPONSE(opcode), -1);
+                }
+                break;
+
+            case SL_OPCODE_NETAPP_DNSGETHOSTBYNAME: {
+                _GetHostByNameCommand_t *cmd = (_GetHostByNameCommand_t *)p;
+                _GetHostByNameIPv4AsyncResponse_t rsp;
+                char name[256];
+                uint32_t addr = 0;
+                uint32_t n = cmd->Len < sizeof(name) - 1 ? cmd->Len : sizeof(name) - 1;
+                memcpy(name, p + sizeof(_GetHostByNameCommand_t), n);
+                name[n] = '\0';
+                memset(&rsp, 0, sizeof(rsp));
+                rsp.status = simhost_gethostbyname(name, &addr);
+                // the NWP reports addresses in host byte order
+                rsp.ip0 = __builtin_bswap32(addr);
+                sim_queue_basic(SL_OPCODE_NETAPP_DNSGETHOSTBYNAMERESPONSE, 0);
+                sim_queue(SL_OPCODE_NETAPP_DNSGETHOSTBYNAMEASYNCRESPONSE, &rsp, sizeof(rsp), NULL, 0);
+                break;
+            }
+
+            default:
+                // configuration and status commands all succeed with a zeroed reply
+                sim_queue(SIM_RESPONSE(opcode), NULL, 0, NULL, 0);
+                break;
+        }
+    }
+
+    // the host will block on its next data op: hand its credits back
+    if (sim.host_pool <= FLOW_CONT_MIN + 1 && sim.head == NULL) {
+        sim_queue(SL_OPCODE_DEVICE_DEVICEASYNCDUMMY, NULL, 0, NULL, 0);
+        sim.stats.dummies++;
+    }
+}
+
+static void sim_parse(void)
+{
+    uint32_t pos = 0;
+    while (sim.in_len - pos >= SYNC_PATTERN_LEN) {
+        uint8_t *p = sim.in_buf + pos;
+        if (memcmp(p, sim_h2n_cnys, SYNC_PATTERN_LEN) == 0) {
+            pos += SYNC_PATTERN_LEN;
+            sim_serve();
+        } else if (memcmp(p, sim_h2n_sync, SYNC_PATTERN_LEN) == 0) {
+            if (sim.in_len - pos < SYNC_PATTERN_LEN + _SL_CMD_HDR_SIZE) {
+                break;
+            }
+            _SlCommandHeader_t *hdr = (_SlCommandHeader_t *)(p + SYNC_PATTERN_LEN);
+            uint32_t len = SYNC_PATTERN_LEN + _SL_CMD_HDR_SIZE + hdr->Len;
+            if (sim.in_len - pos < len) {
+                break;
+            }
+            // a new command means the previous message has been read
+            sim.serving = false;
+            sim_command(hdr->Opcode, p + SYNC_PATTERN_LEN + _SL_CMD_HDR_SIZE, hdr->Len);
+            pos += len;
+        } else {
+            // dummy or alignment word
+            pos += SYNC_PATTERN_LEN;
+        }
+    }
+    memmove(sim.in_buf, sim.in_buf + pos, sim.in_len - pos);
+    sim.in_len -= pos;
+}
+
+// --------------------------------------------------------------------------------------
+// cc31kdrv.h transport
+// --------------------------------------------------------------------------------------
+
+Fd_t cc31k_open(char *ifName, unsigned long flags)
+{
+    sim_flush();
+    sim.in_len = 0;
+    for (int i = 0; i < SL_MAX_SOCKETS; i++) {
+        sim.sock[i].fd = -1;
+    }
+    return 0;
+}
+
+int cc31k_close(Fd_t fd)
+{
+    return 0;
+}
+
+int cc31k_read(Fd_t fd, unsigned char *pBuff, int len)
+{
+    sim.stats.rd_calls++;
+    sim.stats.rd_bytes += len;
+    if (len > sim.stats.max_xfer) {
+        sim.stats.max_xfer = len;
+    }
+    int n = 0;
+    if (sim.cur != NULL && sim.cur_pos < sim.cur->len) {
+        n = sim.cur->len - sim.cur_pos;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(pBuff, sim.cur->buf + sim.cur_pos, n);
+        sim.cur_pos += n;
+    }
+    // reading past the end of a message clocks in idle bytes
+    memset(pBuff + n, 0, len - n);
+    return len;
+}
+
+int cc31k_write(Fd_t fd, unsigned char *pBuff, int len)
+{
+    sim.stats.wr_calls++;
+    sim.stats.wr_bytes += len;
+    if (len > sim.stats.max_xfer) {
+        sim.stats.max_xfer = len;
+    }
+    if (sim.in_len + len > sim.in_alloc) {
+        uint32_t alloc = sim.in_alloc ? sim.in_alloc : 2048;
+        while (alloc < sim.in_len + len) {
+            alloc *= 2;
+        }
+        uint8_t *buf = realloc(sim.in_buf, alloc);
+        if (buf == NULL) {
+            return 0;
+        }
+        sim.in_buf = buf;
+        sim.in_alloc = alloc;
+    }
+    memcpy(sim.in_buf + sim.in_len, pBuff, len);
+    sim.in_len += len;
+    sim_parse();
+    return len;
+}
+
+void cc31k_enable(void)
+{
+    InitComplete_t init = {INIT_STA_OK};
+    sim.enabled = true;
+    sim_queue(SL_OPCODE_DEVICE_INITCOMPLETE, &init, sizeof(init), NULL, 0);
+}
+
+void cc31k_disable(void)
+{
+    sim.enabled = false;
+    sim_flush();
+    for (int i = 0; i < SL_MAX_SOCKETS; i++) {
+        if (sim.sock[i].fd >= 0) {
+            sim_sock_free(&sim.sock[i]);
+        }
+    }
+    sim.select.pending = false;
+    sim.wlan_connected = false;
+}
+
+int cc31k_registerIrqHandler(irq_handler_t handler, void *pVal)
+{
+    sim.irq_handler = handler;
+    return 0;
+}
+
+void cc31k_poll(void)
+{
+    // the driver polls once more while it still holds its lock after reading a
+    // message (sl_SyncObjClear is a one-shot wait), so hold the next IRQ back
+    // until the poll after that, as the bus turnaround would on the device
+    bool served = sim.serving;
+    sim.serving = false;
+
+    for (int i = 0; i < SL_MAX_SOCKETS; i++) {
+        sim_sock_t *s = &sim.sock[i];
+        if (s->fd < 0) {
+            continue;
+        }
+        if (s->recv_op != 0) {
+            sim_try_recv(s);
+        }
+        if (s->accept_pending) {
+            sim_try_accept(s);
+        }
+    }
+    if (sim.select.pending) {
+        sim_try_select();
+    }
+
+    if (!served) {
+        sim_kick();
+    }
+}
+
+// --------------------------------------------------------------------------------------
+// Statistics
+// --------------------------------------------------------------------------------------
+
+void cc31k_sim_get_stats(cc31k_sim_stats_t *stats)
+{
+    *stats = sim.stats;
+}
+
+void cc31k_sim_reset_stats(void)
+{
+    memset(&sim.stats, 0, sizeof(sim.stats));
+}
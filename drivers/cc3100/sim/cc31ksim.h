@@ -0,0 +1,63 @@
+// --------------------------------------------------------------------------------------
+// Module     : CC31KSIM
+// Host-side stand-in for the CC3100 network processor.
+//
+// cc31ksim.c implements the cc31k_* transport from cc31kdrv.h and plays the NWP side of
+// the SimpleLink host protocol (sync patterns, command/response, async events and TX
+// flow control).  Sockets are backed by real host sockets through the small simhost_*
+// layer in cc31ksimhost.c, which is kept in its own file so that the host BSD headers
+// never meet the SimpleLink BSD name macros.
+// --------------------------------------------------------------------------------------
+
+#ifndef CC31KSIM_H
+#define CC31KSIM_H
+
+#include <stdint.h>
+
+// number of TX buffers the simulated NWP advertises in every message header
+#ifndef CC31K_SIM_TX_POOL
+#define CC31K_SIM_TX_POOL (8)
+#endif
+
+// largest recv payload the simulated NWP returns per message, like a TCP segment
+#ifndef CC31K_SIM_MAX_RX_CHUNK
+#define CC31K_SIM_MAX_RX_CHUNK (1460)
+#endif
+
+// transport counters, useful to compare the bus cost of driver changes
+typedef struct _cc31k_sim_stats_t {
+    uint32_t rd_calls;      // cc31k_read calls
+    uint32_t wr_calls;      // cc31k_write calls
+    uint32_t rd_bytes;      // bytes clocked in by the host
+    uint32_t wr_bytes;      // bytes clocked out by the host
+    uint32_t cmds;          // host-to-NWP messages
+    uint32_t msgs;          // NWP-to-host messages
+    uint32_t irqs;          // host IRQs raised
+    uint32_t dummies;       // flow control credit messages
+    uint32_t max_xfer;      // longest single read or write, in bytes
+} cc31k_sim_stats_t;
+
+void cc31k_sim_get_stats(cc31k_sim_stats_t *stats);
+void cc31k_sim_reset_stats(void);
+
+// host socket backend; all calls are non-blocking except connect and send,
+// return a negated host errno on failure, and take addresses and ports in
+// network byte order, as they appear on the wire
+#define SIMHOST_RD  (1)
+#define SIMHOST_WR  (2)
+
+int simhost_socket(int stream);
+int simhost_close(int fd);
+int simhost_bind(int fd, uint32_t addr, uint16_t port);
+int simhost_listen(int fd, int backlog);
+int simhost_accept(int fd, uint32_t *addr, uint16_t *port);
+int simhost_connect(int fd, uint32_t addr, uint16_t port);
+int simhost_send(int fd, const void *buf, int len);
+int simhost_sendto(int fd, const void *buf, int len, uint32_t addr, uint16_t port);
+int simhost_recv(int fd, void *buf, int len);
+int simhost_recvfrom(int fd, void *buf, int len, uint32_t *addr, uint16_t *port);
+int simhost_ready(int fd);
+int simhost_gethostbyname(const char *name, uint32_t *addr);
+uint32_t simhost_ticks_ms(void);
+
+#endif // CC31KSIM_H
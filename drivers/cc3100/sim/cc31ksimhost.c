@@ -0,0 +1,149 @@
+// --------------------------------------------------------------------------------------
+// Module     : CC31KSIMHOST
+// Host BSD socket backend for the simulated CC3100 network processor.
+// --------------------------------------------------------------------------------------
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "cc31ksim.h"
+
+static void simhost_addr(struct sockaddr_in *sin, uint32_t addr, uint16_t port)
+{
+    memset(sin, 0, sizeof(*sin));
+    sin->sin_family = AF_INET;
+    sin->sin_addr.s_addr = addr;
+    sin->sin_port = port;
+}
+
+int simhost_socket(int stream)
+{
+    int fd = socket(AF_INET, stream ? SOCK_STREAM : SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return -errno;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (stream) {
+        // the NWP pushes each send out as its own segment
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+int simhost_close(int fd)
+{
+    return close(fd) < 0 ? -errno : 0;
+}
+
+int simhost_bind(int fd, uint32_t addr, uint16_t port)
+{
+    struct sockaddr_in sin;
+    simhost_addr(&sin, addr, port);
+    return bind(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0 ? -errno : 0;
+}
+
+int simhost_listen(int fd, int backlog)
+{
+    return listen(fd, backlog) < 0 ? -errno : 0;
+}
+
+int simhost_accept(int fd, uint32_t *addr, uint16_t *port)
+{
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+    int nfd = accept(fd, (struct sockaddr *)&sin, &len);
+    if (nfd < 0) {
+        return -errno;
+    }
+    int one = 1;
+    setsockopt(nfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    *addr = sin.sin_addr.s_addr;
+    *port = sin.sin_port;
+    return nfd;
+}
+
+int simhost_connect(int fd, uint32_t addr, uint16_t port)
+{
+    struct sockaddr_in sin;
+    simhost_addr(&sin, addr, port);
+    return connect(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0 ? -errno : 0;
+}
+
+int simhost_send(int fd, const void *buf, int len)
+{
+    int n = send(fd, buf, len, MSG_NOSIGNAL);
+    return n < 0 ? -errno : n;
+}
+
+int simhost_sendto(int fd, const void *buf, int len, uint32_t addr, uint16_t port)
+{
+    struct sockaddr_in sin;
+    simhost_addr(&sin, addr, port);
+    int n = sendto(fd, buf, len, MSG_NOSIGNAL, (struct sockaddr *)&sin, sizeof(sin));
+    return n < 0 ? -errno : n;
+}
+
+int simhost_recv(int fd, void *buf, int len)
+{
+    int n = recv(fd, buf, len, MSG_DONTWAIT);
+    return n < 0 ? -errno : n;
+}
+
+int simhost_recvfrom(int fd, void *buf, int len, uint32_t *addr, uint16_t *port)
+{
+    struct sockaddr_in sin;
+    socklen_t slen = sizeof(sin);
+    memset(&sin, 0, sizeof(sin));
+    int n = recvfrom(fd, buf, len, MSG_DONTWAIT, (struct sockaddr *)&sin, &slen);
+    if (n < 0) {
+        return -errno;
+    }
+    *addr = sin.sin_addr.s_addr;
+    *port = sin.sin_port;
+    return n;
+}
+
+int simhost_ready(int fd)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN | POLLOUT };
+    if (poll(&pfd, 1, 0) <= 0) {
+        return 0;
+    }
+    int ret = 0;
+    // a hang-up or error reads as end of stream, like BSD select
+    if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+        ret |= SIMHOST_RD;
+    }
+    if (pfd.revents & POLLOUT) {
+        ret |= SIMHOST_WR;
+    }
+    return ret;
+}
+
+int simhost_gethostbyname(const char *name, uint32_t *addr)
+{
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    if (getaddrinfo(name, NULL, &hints, &res) != 0) {
+        return -ENOENT;
+    }
+    *addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr.s_addr;
+    freeaddrinfo(res);
+    return 0;
+}
+
+uint32_t simhost_ticks_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
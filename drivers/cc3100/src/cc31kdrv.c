@@ -38,9 +38,43 @@
 #define PIN_IRQ pin_B8 // Y3
 #define SPI_HANDLE SPIHandle2
 
+// SPI2 DMA requests are on channel 0 of DMA1 stream 3 (RX) and stream 4 (TX)
+#define DMA_RX_STREAM DMA1_Stream3
+#define DMA_RX_IRQN DMA1_Stream3_IRQn
+#define DMA_TX_STREAM DMA1_Stream4
+#define DMA_TX_IRQN DMA1_Stream4_IRQn
+#define DMA_CHANNEL DMA_CHANNEL_0
+
+// transfers shorter than this are done polled: most are 4 to 16 byte sync and
+// header words, for which setting up the DMA costs more than it saves
+#ifndef CC31K_DMA_MIN_SIZE
+#define CC31K_DMA_MIN_SIZE (32)
+#endif
+
+// longer transfers are streamed in chunks of this size (the DMA count is 16 bits)
+#ifndef CC31K_DMA_CHUNK_SIZE
+#define CC31K_DMA_CHUNK_SIZE (4096)
+#endif
+
+#define SPI_TIMEOUT_MS (20) // in ms, per chunk
+
+// the CCM RAM is not reachable by the DMA
+#define IS_DMA_ADDR(addr) ((uint32_t)(addr) >= 0x20000000)
+
+typedef enum {
+    CC31K_DMA_IDLE,
+    CC31K_DMA_BUSY,
+    CC31K_DMA_DONE,
+    CC31K_DMA_ERROR,
+} cc31k_dma_state_t;
+
 STATIC volatile irq_handler_t cc31k_IrqHandler = 0;
 STATIC mp_obj_t irq_callback(mp_obj_t line);
 
+STATIC DMA_HandleTypeDef cc31k_dma_rx;
+STATIC DMA_HandleTypeDef cc31k_dma_tx;
+STATIC volatile cc31k_dma_state_t cc31k_dma_state = CC31K_DMA_IDLE;
+
 static int cc31k_transceive(unsigned char *data, uint16_t size);
 
 static void cc31k_en(int val)
@@ -90,6 +124,62 @@ void cc31k_cs_deassert(void)
     cc31k_cs(1);
 }
 
+STATIC void cc31k_dma_init_stream(DMA_HandleTypeDef *dma, DMA_Stream_TypeDef *stream, uint32_t direction, IRQn_Type irqn)
+{
+    dma->Instance                   = stream;
+    dma->State                      = HAL_DMA_STATE_RESET;
+    dma->Init.Channel               = DMA_CHANNEL;
+    dma->Init.Direction             = direction;
+    dma->Init.PeriphInc             = DMA_PINC_DISABLE;
+    dma->Init.MemInc                = DMA_MINC_ENABLE;
+    dma->Init.PeriphDataAlignment   = DMA_PDATAALIGN_BYTE;
+    dma->Init.MemDataAlignment      = DMA_MDATAALIGN_BYTE;
+    dma->Init.Mode                  = DMA_NORMAL;
+    dma->Init.Priority              = DMA_PRIORITY_HIGH;
+    dma->Init.FIFOMode              = DMA_FIFOMODE_DISABLE;
+    dma->Init.FIFOThreshold         = DMA_FIFO_THRESHOLD_HALFFULL;
+    dma->Init.MemBurst              = DMA_MBURST_SINGLE;
+    dma->Init.PeriphBurst           = DMA_PBURST_SINGLE;
+    HAL_DMA_DeInit(dma);
+    HAL_DMA_Init(dma);
+
+    HAL_NVIC_SetPriority(irqn, 6, 0);
+    HAL_NVIC_EnableIRQ(irqn);
+}
+
+STATIC void cc31k_dma_init(void)
+{
+    __DMA1_CLK_ENABLE();
+    cc31k_dma_init_stream(&cc31k_dma_rx, DMA_RX_STREAM, DMA_PERIPH_TO_MEMORY, DMA_RX_IRQN);
+    cc31k_dma_init_stream(&cc31k_dma_tx, DMA_TX_STREAM, DMA_MEMORY_TO_PERIPH, DMA_TX_IRQN);
+    __HAL_LINKDMA(&SPI_HANDLE, hdmarx, cc31k_dma_rx);
+    __HAL_LINKDMA(&SPI_HANDLE, hdmatx, cc31k_dma_tx);
+    cc31k_dma_state = CC31K_DMA_IDLE;
+}
+
+void cc31k_dma_irq_handler(int stream)
+{
+    if (stream == 3) {
+        HAL_DMA_IRQHandler(&cc31k_dma_rx);
+    } else {
+        HAL_DMA_IRQHandler(&cc31k_dma_tx);
+    }
+}
+
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+    if (hspi == &SPI_HANDLE) {
+        cc31k_dma_state = CC31K_DMA_DONE;
+    }
+}
+
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi)
+{
+    if (hspi == &SPI_HANDLE) {
+        cc31k_dma_state = CC31K_DMA_ERROR;
+    }
+}
+
 STATIC mp_obj_t irq_callback(mp_obj_t line)
 {
     if(cc31k_IrqHandler)
@@ -115,6 +205,7 @@ Fd_t cc31k_open(char *ifName, unsigned long flags)
     SPI_HANDLE.Init.CRCPolynomial       = 7; // unused
 
     spi_init(&SPI_HANDLE, false);
+    cc31k_dma_init();
 
     // configure wlan CS and EN pins
     GPIO_InitTypeDef GPIO_InitStructure;
@@ -197,16 +288,49 @@ int cc31k_registerIrqHandler(irq_handler_t handler, void *pVal)
     return 0;
 }
 
+// Runs one chunk through the DMA and sleeps until the completion interrupt.
+// Interrupts stay enabled throughout, so other ISRs are not held off.
+STATIC HAL_StatusTypeDef cc31k_transceive_dma(unsigned char *data, uint16_t size)
+{
+    cc31k_dma_state = CC31K_DMA_BUSY;
+    HAL_StatusTypeDef hal_status = HAL_SPI_TransmitReceive_DMA(&SPI_HANDLE, data, data, size);
+    if (hal_status != HAL_OK) {
+        cc31k_dma_state = CC31K_DMA_IDLE;
+        return hal_status;
+    }
+
+    uint32_t start = HAL_GetTick();
+    while (cc31k_dma_state == CC31K_DMA_BUSY) {
+        if (HAL_GetTick() - start >= SPI_TIMEOUT_MS) {
+            HAL_SPI_DMAStop(&SPI_HANDLE);
+            cc31k_dma_state = CC31K_DMA_IDLE;
+            return HAL_TIMEOUT;
+        }
+        __WFI();
+    }
+
+    hal_status = (cc31k_dma_state == CC31K_DMA_DONE) ? HAL_OK : HAL_ERROR;
+    cc31k_dma_state = CC31K_DMA_IDLE;
+    return hal_status;
+}
+
 static int cc31k_transceive(unsigned char *data, uint16_t size)
 {
-    #define SPI_TIMEOUT_MS                     (20) // in ms
-    HAL_StatusTypeDef hal_status;
+    HAL_StatusTypeDef hal_status = HAL_OK;
 
-    __disable_irq();
+    // CS stays asserted across chunks so the NWP sees a single transfer
     cc31k_cs_assert();
-    hal_status = HAL_SPI_TransmitReceive(&SPI_HANDLE, data, data, size, SPI_TIMEOUT_MS);
+    if (size < CC31K_DMA_MIN_SIZE || !IS_DMA_ADDR(data)) {
+        // the polled transfer waits for each byte to come back before sending
+        // the next, so an ISR running in the middle of it cannot cause an overrun
+        hal_status = HAL_SPI_TransmitReceive(&SPI_HANDLE, data, data, size, SPI_TIMEOUT_MS);
+    } else {
+        for (uint32_t pos = 0; pos < size && hal_status == HAL_OK; pos += CC31K_DMA_CHUNK_SIZE) {
+            uint16_t chunk = MIN(size - pos, CC31K_DMA_CHUNK_SIZE);
+            hal_status = cc31k_transceive_dma(data + pos, chunk);
+        }
+    }
     cc31k_cs_deassert();
-    __enable_irq();
 
     if(hal_status != HAL_OK)
     {
@@ -215,7 +339,3 @@ static int cc31k_transceive(unsigned char *data, uint16_t size)
     }
     return(size);
 }
-
-
-
-
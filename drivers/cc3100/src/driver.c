@@ -99,12 +99,15 @@ typedef struct
 {
     UINT32 Align;
     _SlDriverCb_t DriverCB;
-    UINT8 AsyncRespBuf[SL_ASYNC_MAX_MSG_LEN];
+    UINT8 AsyncRespBuf[SL_ASYNC_BUF_POOL_SIZE][SL_ASYNC_MAX_MSG_LEN];
+    UINT32 AsyncRespBufUsed;    /* bit per buffer of AsyncRespBuf, set while it is handed out */
 }_SlStatMem_t;
 
 _SlStatMem_t g_StatMem;
 #endif
 
+SlPoolStats_t g_PoolStats;
+
 /*****************************************************************************
  _SlDrvDriverCBInit
 *****************************************************************************/
@@ -121,6 +124,10 @@ void _SlDrvDriverCBInit(void)
     MALLOC_OK_CHECK(g_pCB);
 
     sl_Memset((g_pCB), 0, sizeof(_SlDriverCb_t));
+#if (SL_MEMORY_MGMT == SL_MEMORY_MGMT_STATIC)
+    g_StatMem.AsyncRespBufUsed = 0;
+#endif
+    g_PoolStats.AsyncBufInUse = 0;
 
     OSI_RET_OK_CHECK( sl_SyncObjCreate(&g_pCB->CmdSyncObj, "CmdSyncObj") );
     sl_SyncObjClear(&g_pCB->CmdSyncObj);
@@ -510,11 +517,7 @@ _SlReturnVal_t _SlDrvMsgRead(void)
 
             VERIFY_PROTOCOL(NULL == g_pCB->FunctionParams.AsyncExt.pAsyncBuf);
 
-#if (SL_MEMORY_MGMT == SL_MEMORY_MGMT_STATIC)
-            g_pCB->FunctionParams.AsyncExt.pAsyncBuf = g_StatMem.AsyncRespBuf;
-#else
-            g_pCB->FunctionParams.AsyncExt.pAsyncBuf = sl_Malloc(SL_ASYNC_MAX_MSG_LEN);
-#endif
+            g_pCB->FunctionParams.AsyncExt.pAsyncBuf = _SlDrvAsyncBufAlloc();
             MALLOC_OK_CHECK(g_pCB->FunctionParams.AsyncExt.pAsyncBuf);
 
             sl_Memcpy(g_pCB->FunctionParams.AsyncExt.pAsyncBuf, uBuf.TempBuf, _SL_RESP_HDR_SIZE);
@@ -972,11 +975,8 @@ _SlReturnVal_t _SlDrvMsgReadCmdCtx(void)
                 /*  release. */
                _SlAsyncEventGenericHandler();
 
-#if (SL_MEMORY_MGMT == SL_MEMORY_MGMT_STATIC)
+                _SlDrvAsyncBufFree(g_pCB->FunctionParams.AsyncExt.pAsyncBuf);
                 g_pCB->FunctionParams.AsyncExt.pAsyncBuf = NULL;
-#else
-                sl_Free(g_pCB->FunctionParams.AsyncExt.pAsyncBuf);
-#endif
             }
         }
         else
@@ -1052,11 +1052,8 @@ _SlReturnVal_t _SlDrvMsgReadSpawnCtx(void *pValue)
 
         _SlAsyncEventGenericHandler();
 
-#if (SL_MEMORY_MGMT == SL_MEMORY_MGMT_STATIC)
+        _SlDrvAsyncBufFree(g_pCB->FunctionParams.AsyncExt.pAsyncBuf);
         g_pCB->FunctionParams.AsyncExt.pAsyncBuf = NULL;
-#else
-        sl_Free(g_pCB->FunctionParams.AsyncExt.pAsyncBuf);
-#endif
         break;
     case DUMMY_MSG_CLASS:
     case RECV_RESP_CLASS:
@@ -1278,9 +1275,15 @@ int _SlDrvWaitForPoolObj(UINT32 ActionID, UINT8 SocketID)
     }
     else
     {
+        g_PoolStats.ObjPoolFailures++;
         OSI_RET_OK_CHECK(sl_LockObjUnlock(&g_pCB->ProtectionLockObj));
         return CurrObjIndex;
     }
+    g_PoolStats.ObjPoolInUse++;
+    if (g_PoolStats.ObjPoolInUse > g_PoolStats.ObjPoolMaxInUse)
+    {
+        g_PoolStats.ObjPoolMaxInUse = g_PoolStats.ObjPoolInUse;
+    }
     g_pCB->ObjPool[CurrObjIndex].ActionID = ActionID;
     if (SL_MAX_SOCKETS > SocketID)
     {
@@ -1291,6 +1294,7 @@ int _SlDrvWaitForPoolObj(UINT32 ActionID, UINT8 SocketID)
     while ( ( (SL_MAX_SOCKETS > SocketID) && (g_pCB->ActiveActionsBitmap & (1<<SocketID)) ) || ( (g_pCB->ActiveActionsBitmap & (1<<ActionID)) && (SL_MAX_SOCKETS == SocketID) ) )
     {
         //action in progress - move to pending list 
+        g_PoolStats.ObjPoolWaits++;
         g_pCB->ObjPool[CurrObjIndex].NextIndex = g_pCB->PendingPoolIdx;
         g_pCB->PendingPoolIdx = CurrObjIndex;
         OSI_RET_OK_CHECK(sl_LockObjUnlock(&g_pCB->ProtectionLockObj));
@@ -1363,6 +1367,7 @@ void _SlDrvReleasePoolObj(UINT8 pObjIdx)
     /* move to free list */
     g_pCB->ObjPool[pObjIdx].NextIndex = g_pCB->FreePoolIdx;
     g_pCB->FreePoolIdx = pObjIdx;
+    g_PoolStats.ObjPoolInUse--;
 
     OSI_RET_OK_CHECK(sl_LockObjUnlock(&g_pCB->ProtectionLockObj));
 }
@@ -1377,6 +1382,7 @@ void _SlDrvObjInit(void)
     UINT8 Idx;
 
     sl_Memset(&g_pCB->ObjPool[0],0,MAX_CONCURRENT_ACTIONS*sizeof(_SlPoolObj_t));
+    g_PoolStats.ObjPoolInUse = 0;
     /* place all Obj in the free list */
     g_pCB->FreePoolIdx = 0;
     for (Idx = 0 ; Idx < MAX_CONCURRENT_ACTIONS ; Idx++)
@@ -1401,6 +1407,78 @@ void _SlDrvObjDeInit(void)
 
 }
 
+/* ******************************************************************************/
+/*  _SlDrvAsyncBufAlloc */
+/* ******************************************************************************/
+/*  Called with GlobalLockObj held, from _SlDrvMsgRead only, so the pool */
+/*  needs no lock of its own. Returns NULL if the pool is exhausted. */
+UINT8 *_SlDrvAsyncBufAlloc(void)
+{
+    UINT8 *pBuf = NULL;
+#if (SL_MEMORY_MGMT == SL_MEMORY_MGMT_STATIC)
+    UINT8 Idx;
+
+    for (Idx = 0; Idx < SL_ASYNC_BUF_POOL_SIZE; Idx++)
+    {
+        if (!(g_StatMem.AsyncRespBufUsed & (1 << Idx)))
+        {
+            g_StatMem.AsyncRespBufUsed |= (1 << Idx);
+            pBuf = g_StatMem.AsyncRespBuf[Idx];
+            break;
+        }
+    }
+#else
+    pBuf = sl_Malloc(SL_ASYNC_MAX_MSG_LEN);
+#endif
+
+    if (NULL == pBuf)
+    {
+        g_PoolStats.AsyncBufFailures++;
+        return NULL;
+    }
+    g_PoolStats.AsyncBufAllocs++;
+    g_PoolStats.AsyncBufInUse++;
+    if (g_PoolStats.AsyncBufInUse > g_PoolStats.AsyncBufMaxInUse)
+    {
+        g_PoolStats.AsyncBufMaxInUse = g_PoolStats.AsyncBufInUse;
+    }
+    return pBuf;
+}
+
+/* ******************************************************************************/
+/*  _SlDrvAsyncBufFree */
+/* ******************************************************************************/
+void _SlDrvAsyncBufFree(UINT8 *pBuf)
+{
+    if (NULL == pBuf)
+    {
+        return;
+    }
+#if (SL_MEMORY_MGMT == SL_MEMORY_MGMT_STATIC)
+    g_StatMem.AsyncRespBufUsed &= ~(1 << ((pBuf - g_StatMem.AsyncRespBuf[0]) / SL_ASYNC_MAX_MSG_LEN));
+#else
+    sl_Free(pBuf);
+#endif
+    g_PoolStats.AsyncBufInUse--;
+}
+
+/* ******************************************************************************/
+/*  sl_PoolStatsGet */
+/* ******************************************************************************/
+void sl_PoolStatsGet(SlPoolStats_t *pStats, UINT8 Reset)
+{
+    sl_Memcpy(pStats, &g_PoolStats, sizeof(SlPoolStats_t));
+    if (Reset)
+    {
+        g_PoolStats.AsyncBufAllocs = 0;
+        g_PoolStats.AsyncBufFailures = 0;
+        g_PoolStats.AsyncBufMaxInUse = g_PoolStats.AsyncBufInUse;
+        g_PoolStats.ObjPoolWaits = 0;
+        g_PoolStats.ObjPoolFailures = 0;
+        g_PoolStats.ObjPoolMaxInUse = g_PoolStats.ObjPoolInUse;
+    }
+}
+
 /* ******************************************************************************/
 /*   */
 /* ******************************************************************************/
@@ -117,6 +117,9 @@ _SlNonOsRetVal_t _SlNonOsMainLoopTask(void)
 {
 	int i;
 	
+#ifdef sl_IfPoll
+	sl_IfPoll();
+#endif
 	for (i=0 ; i<NONOS_MAX_SPAWN_ENTRIES ; i++)
 	{
 		_SlNonOsSpawnEntry_t* pE = &g__SlNonOsCB.SpawnEntries[i];
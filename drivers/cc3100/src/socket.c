@@ -1112,6 +1112,12 @@ void _sl_HandleAsync_Select(void *pVoidBuf)
     VERIFY_SOCKET_CB(NULL != g_pCB->ObjPool[g_pCB->FunctionParams.AsyncExt.ActionIndex].pRespArgs);
 
     memcpy(g_pCB->ObjPool[g_pCB->FunctionParams.AsyncExt.ActionIndex].pRespArgs, pMsgArgs, sizeof(_SelectAsyncResponse_t));
+#ifdef sl_SockSelectEvtHdlr
+    if (pMsgArgs->status >= 0)
+    {
+        sl_SockSelectEvtHdlr(pMsgArgs->readFds, pMsgArgs->writeFds);
+    }
+#endif
     OSI_RET_OK_CHECK(sl_SyncObjSignal(&g_pCB->ObjPool[g_pCB->FunctionParams.AsyncExt.ActionIndex].SyncObj));
 
     OSI_RET_OK_CHECK(sl_LockObjUnlock(&g_pCB->ProtectionLockObj));
@@ -179,7 +179,13 @@ mp_obj_t mp_binary_get_val(char struct_type, char val_type, byte **ptr) {
     }
     *ptr = p + size;
 
-    long long val = mp_binary_get_int(size, is_signed(val_type), (struct_type == '>'), p);
+    return mp_binary_get_val_at(val_type, size, (struct_type == '>'), p);
+}
+
+// Get a value of the given type and size (in bytes) stored at p, with no
+// alignment applied to p.
+mp_obj_t mp_binary_get_val_at(char val_type, mp_uint_t size, bool big_endian, const byte *p) {
+    long long val = mp_binary_get_int(size, is_signed(val_type), big_endian, p);
 
     if (val_type == 'O') {
         return (mp_obj_t)(mp_uint_t)val;
@@ -236,6 +242,12 @@ void mp_binary_set_val(char struct_type, char val_type, mp_obj_t val_in, byte **
     }
     *ptr = p + size;
 
+    mp_binary_set_val_at(val_type, size, struct_type == '>', val_in, p);
+}
+
+// Store a value of the given type and size (in bytes) at p, with no
+// alignment applied to p.
+void mp_binary_set_val_at(char val_type, mp_uint_t size, bool big_endian, mp_obj_t val_in, byte *p) {
     mp_uint_t val;
     switch (val_type) {
         case 'O':
@@ -245,7 +257,7 @@ void mp_binary_set_val(char struct_type, char val_type, mp_obj_t val_in, byte **
             val = mp_obj_get_int(val_in);
     }
 
-    mp_binary_set_int(MIN(size, sizeof(val)), struct_type == '>', p, val);
+    mp_binary_set_int(MIN(size, sizeof(val)), big_endian, p, val);
 }
 
 void mp_binary_set_val_array(char typecode, void *p, mp_uint_t index, mp_obj_t val_in) {
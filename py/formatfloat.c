@@ -26,21 +26,33 @@
 
 /***********************************************************************
 
-  formatfloat.c  - Ruutine for converting a single-precision floating
-                    point number into a string.
-
-  The code in this funcion was inspired from Fred Bayer's pdouble.c.
-  Since pdouble.c was released as Public Domain, I'm releasing this
-  code as public domain as well.
-
-  The original code can be found in https://github.com/dhylands/format-float
-
-  Dave Hylands
+  formatfloat.c  - Routines for converting a single-precision floating
+                   point number to and from a decimal string.
+
+  Both directions work in integer arithmetic.  The float is multiplied by
+  a power of ten, taken from a small table of 64-bit normalised mantissas,
+  to give a fixed-point number whose integer part holds the wanted decimal
+  digits.  The error in this product is a few units in 2^-60, far below
+  the resolution of a float, so:
+
+   - fixed-precision output ('e', 'f', 'g') is correctly rounded, up to
+     the 9 significant digits needed to identify any float (further
+     digits are written as zeros);
+   - the shortest output ('r', used for repr) is the fewest digits that
+     lie inside the rounding interval of the float; digits too close to the
+     ends of the interval to decide with the approximation are checked
+     exactly, so the result always reads back to the same float with
+     float_from_decimal below.
+
+  The original digit-by-digit code was inspired from Fred Bayer's
+  pdouble.c and can be found in https://github.com/dhylands/format-float
 
 ***********************************************************************/
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
 
 #include "mpconfig.h"
 
@@ -56,13 +68,351 @@
 #define FLT_EXP_MASK    0x7F800000
 #define FLT_MAN_MASK    0x007FFFFF
 
-static const float g_pos_pow[] = {
-    1e32, 1e16, 1e8, 1e4, 1e2, 1e1
+// 9 significant digits are enough to uniquely identify any float.
+#define FLT_MAX_DIGITS  (9)
+
+// Number of fractional bits in the fixed-point scaled values.  The integer
+// part can then hold up to 10 decimal digits.
+#define FRAC_BITS       (28)
+#define FRAC_HALF       ((uint32_t)1 << (FRAC_BITS - 1))
+#define FRAC_MASK       (((uint32_t)1 << FRAC_BITS) - 1)
+
+// Margin, in fixed-point units, by which a shortest candidate must lie
+// inside the rounding interval.  The scaled values are accurate to about
+// one unit, so this is very conservative.
+#define SHORTEST_MARGIN (64)
+
+// 10^(8i) for i = -9..7 as f * 2^e, with f normalised to 64 bits and
+// rounded to nearest.  Entries 1e0 to 1e24 are exact.
+#define POW10_MIN (-72)
+static const struct { uint64_t f; int16_t e; } pow10_big[] = {
+    { 0xe2280b6c20dd5232ULL, -303 }, // 1e-72
+    { 0xa87fea27a539e9a5ULL, -276 }, // 1e-64
+    { 0xfb158592be068d2fULL, -250 }, // 1e-56
+    { 0xbb127c53b17ec159ULL, -223 }, // 1e-48
+    { 0x8b61313bbabce2c6ULL, -196 }, // 1e-40
+    { 0xcfb11ead453994baULL, -170 }, // 1e-32
+    { 0x9abe14cd44753b53ULL, -143 }, // 1e-24
+    { 0xe69594bec44de15bULL, -117 }, // 1e-16
+    { 0xabcc77118461cefdULL, -90 },  // 1e-8
+    { 0x8000000000000000ULL, -63 },  // 1e0
+    { 0xbebc200000000000ULL, -37 },  // 1e8
+    { 0x8e1bc9bf04000000ULL, -10 },  // 1e16
+    { 0xd3c21bcecceda100ULL, 16 },   // 1e24
+    { 0x9dc5ada82b70b59eULL, 43 },   // 1e32
+    { 0xeb194f8e1ae525fdULL, 69 },   // 1e40
+    { 0xaf298d050e4395d7ULL, 96 },   // 1e48
+    { 0x82818f1281ed44a0ULL, 123 },  // 1e56
 };
-static const float g_neg_pow[] = {
-    1e-32, 1e-16, 1e-8, 1e-4, 1e-2, 1e-1
+#define POW10_MAX (POW10_MIN + 8 * (int)(sizeof(pow10_big) / sizeof(pow10_big[0])) - 1)
+
+static const uint32_t pow10_small[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
 };
 
+static int clz64(uint64_t x) {
+    int n = 0;
+    if ((x >> 32) == 0) { n += 32; x <<= 32; }
+    if ((x >> 48) == 0) { n += 16; x <<= 16; }
+    if ((x >> 56) == 0) { n += 8; x <<= 8; }
+    if ((x >> 60) == 0) { n += 4; x <<= 4; }
+    if ((x >> 62) == 0) { n += 2; x <<= 2; }
+    if ((x >> 63) == 0) { n += 1; }
+    return n;
+}
+
+// floor(log10(2^e2)), valid for |e2| < 1650
+static int floor_log10_pow2(int e2) {
+    return (e2 * 78913) >> 18;
+}
+
+// 128-bit product of two 64-bit numbers, as hi:lo
+static void mul64(uint64_t a, uint64_t b, uint64_t *hi, uint64_t *lo) {
+    uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+    uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+    uint64_t ll = a_lo * b_lo;
+    uint64_t lh = a_lo * b_hi;
+    uint64_t hl = a_hi * b_lo;
+    uint64_t mid = (ll >> 32) + (uint32_t)lh + (uint32_t)hl;
+    *lo = (mid << 32) | (uint32_t)ll;
+    *hi = a_hi * b_hi + (lh >> 32) + (hl >> 32) + (mid >> 32);
+}
+
+// 10^s as f * 2^e with f normalised to 64 bits, for POW10_MIN <= s <= POW10_MAX
+static uint64_t pow10_fp(int s, int *e) {
+    int i = (s - POW10_MIN) / 8;
+    int j = (s - POW10_MIN) % 8;
+    uint64_t f = pow10_big[i].f;
+    *e = pow10_big[i].e;
+    if (j > 0) {
+        // multiply by 10^j (at most 27 bits) and renormalise, truncating
+        uint64_t lo = (uint64_t)(uint32_t)f * pow10_small[j];
+        uint64_t hi = (f >> 32) * pow10_small[j] + (lo >> 32);
+        int lz = clz64(hi);
+        f = (hi << lz) | (((lo & 0xffffffff) << lz) >> 32);
+        *e += 32 - lz;
+    }
+    return f;
+}
+
+// Compute m * 2^e * 10^s as a fixed-point number with FRAC_BITS fractional
+// bits, which must be less than 2^64.  If half_ulp is not NULL then also
+// compute 2^(e-1) * 10^s in the same format.  If sticky is not NULL then it
+// is set if any non-zero bits were shifted out of the results.
+static uint64_t scale_pow10(uint32_t m, int e, int s, uint64_t *half_ulp, bool *sticky) {
+    int fe;
+    uint64_t f = pow10_fp(s, &fe);
+
+    // m * f as the 96-bit number hi:lo (lo being 32 bits)
+    uint64_t lo = (uint64_t)(uint32_t)f * m;
+    uint64_t hi = (f >> 32) * m + (lo >> 32);
+    lo = (uint32_t)lo;
+
+    // shift right by r to get the fixed-point result
+    int r = -(e + fe + FRAC_BITS);
+    uint64_t res;
+    bool dropped;
+    if (r >= 96) {
+        res = 0;
+        dropped = true;
+    } else if (r >= 32) {
+        res = hi >> (r - 32);
+        dropped = lo != 0 || (r > 32 && (hi << (96 - r)) != 0);
+    } else if (r > 0) {
+        res = (hi << (32 - r)) | (lo >> r);
+        dropped = (lo << (64 - r)) != 0;
+    } else {
+        res = ((hi << 32) | lo) << -r;
+        dropped = false;
+    }
+
+    if (half_ulp != NULL) {
+        r += 1;
+        if (r >= 64) {
+            *half_ulp = 0;
+            dropped = true;
+        } else if (r > 0) {
+            *half_ulp = f >> r;
+            dropped |= (f << (64 - r)) != 0;
+        } else {
+            *half_ulp = f << -r;
+        }
+    }
+
+    if (sticky != NULL) {
+        *sticky = dropped;
+    }
+    return res;
+}
+
+// Check if m * 2^e * 10^s is exactly q + 1/2, for s < 0.  This can only
+// happen if 5^-s divides m, so -s is small.
+static bool is_half_way(uint32_t m, int e, int s, uint32_t q) {
+    if (s < -10) {
+        // 5^11 doesn't fit in the 24-bit mantissa
+        return false;
+    }
+    // q + 1/2 = (2q + 1) * 5^-s * 2^(-s-1) * 10^s, and (2q + 1) * 5^-s is odd
+    uint64_t odd = 2 * (uint64_t)q + 1;
+    for (int i = s; i < 0; i++) {
+        odd *= 5;
+    }
+    int sh = -s - 1 - e;
+    return 0 <= sh && sh < 24 && (odd << sh) == m;
+}
+
+// Return round-half-even(m * 2^e * 10^s), which must be less than 2^32.
+static uint32_t round_pow10(uint32_t m, int e, int s) {
+    bool sticky;
+    uint64_t d = scale_pow10(m, e, s, NULL, &sticky);
+    uint32_t q = d >> FRAC_BITS;
+    uint32_t frac = d & FRAC_MASK;
+    bool round_up;
+    if (0 <= s && s <= 27) {
+        // 10^s is exact so the result is exact apart from the sticky bits
+        round_up = frac > FRAC_HALF || (frac == FRAC_HALF && (sticky || (q & 1)));
+    } else if (s < 0 && frac + 16 >= FRAC_HALF && frac <= FRAC_HALF + 16 && is_half_way(m, e, s, q)) {
+        // exact tie, hidden by the error in 10^s
+        round_up = q & 1;
+    } else {
+        // the error in 10^s can't move the result across a half way point
+        round_up = frac >= FRAC_HALF;
+    }
+    if (round_up) {
+        q += 1;
+    }
+    return q;
+}
+
+// Return the n most significant digits (1 <= n <= FLT_MAX_DIGITS) of
+// m * 2^e, correctly rounded, as an integer.  *k is set to the decimal
+// exponent of the first digit.
+static uint32_t float_digits(uint32_t m, int e, int n, int *k) {
+    int k_est = floor_log10_pow2(e + 63 - clz64(m));
+    // the exponent is k_est or k_est + 1
+    uint64_t d = scale_pow10(m, e, n - 1 - k_est, NULL, NULL);
+    if ((d >> FRAC_BITS) >= pow10_small[n]) {
+        k_est += 1;
+    }
+    uint32_t q = round_pow10(m, e, n - 1 - k_est);
+    if (q == pow10_small[n]) {
+        // rounded up to the next power of 10
+        q = pow10_small[n - 1];
+        k_est += 1;
+    }
+    *k = k_est;
+    return q;
+}
+
+// Check if c * 10^a is exactly odd * 2^e2, where odd is an odd number less
+// than 2^26.  This needs 5^a to divide odd, so a must be small.
+static bool is_boundary(uint32_t c, int a, uint32_t odd, int e2) {
+    if (c == 0 || a < 0 || a > 11) {
+        return false;
+    }
+    // c * 10^a = c * 5^a * 2^a; move the powers of 2 in c to the exponent
+    uint64_t lhs = c;
+    int p2 = a;
+    while ((lhs & 1) == 0) {
+        lhs >>= 1;
+        p2 += 1;
+    }
+    for (int i = 0; i < a; i++) {
+        lhs *= 5;
+    }
+    return lhs == odd && p2 == e2;
+}
+
+// Return the shortest digits that read back as m * 2^e, as an integer with
+// *n digits and no trailing zeros.  *k is set to the decimal exponent of the
+// first digit.  lower_closer is set if the next float below is half as far
+// away as the next float above (m is a power of 2).
+static uint32_t float_shortest(uint32_t m, int e, bool lower_closer, int *n, int *k) {
+    int k_est = floor_log10_pow2(e + 63 - clz64(m));
+    uint64_t half_ulp;
+    bool sticky;
+    uint64_t d = scale_pow10(m, e, FLT_MAX_DIGITS - 1 - k_est, &half_ulp, &sticky);
+    if ((d >> FRAC_BITS) >= pow10_small[FLT_MAX_DIGITS]) {
+        k_est += 1;
+        d = scale_pow10(m, e, FLT_MAX_DIGITS - 1 - k_est, &half_ulp, &sticky);
+    }
+    uint64_t margin_hi = half_ulp;
+    uint64_t margin_lo = lower_closer ? half_ulp >> 1 : half_ulp;
+    uint32_t q = d >> FRAC_BITS;
+    uint32_t frac = d & FRAC_MASK;
+
+    // A candidate must be inside the boundary by a safety margin, unless
+    // 10^s is exact and no bits were lost.  A candidate exactly on the
+    // boundary reads back as m if m is even; if the scaled values are exact
+    // this is a simple comparison, otherwise it is checked separately.
+    int s = FLT_MAX_DIGITS - 1 - k_est;
+    bool exact = 0 <= s && s <= 27 && !sticky;
+    uint64_t margin = exact ? 0 : SHORTEST_MARGIN;
+    bool even = (m & 1) == 0;
+
+    // Find the largest power of 10 such that a multiple of it lies inside the
+    // rounding interval.  With t = 0 the nearest integer always lies inside.
+    int t;
+    uint32_t c = 0;
+    for (t = FLT_MAX_DIGITS - 1; t >= 0; t--) {
+        uint32_t unit = pow10_small[t];
+        uint64_t down = ((uint64_t)(q % unit) << FRAC_BITS) | frac;
+        uint64_t up = ((uint64_t)unit << FRAC_BITS) - down;
+        c = q / unit;
+        bool ok_down = down + margin < margin_lo;
+        bool ok_up = up + margin < margin_hi;
+        if (even && exact) {
+            ok_down |= down == margin_lo;
+            ok_up |= up == margin_hi;
+        } else if (even && s < 0) {
+            if (down <= margin_lo + SHORTEST_MARGIN && margin_lo <= down + SHORTEST_MARGIN) {
+                ok_down |= lower_closer ? is_boundary(c, t - s, 4 * m - 1, e - 2) : is_boundary(c, t - s, 2 * m - 1, e - 1);
+            }
+            if (up <= margin_hi + SHORTEST_MARGIN && margin_hi <= up + SHORTEST_MARGIN) {
+                ok_up |= is_boundary(c + 1, t - s, 2 * m + 1, e - 1);
+            }
+        }
+        if (ok_down || ok_up) {
+            // choose the closer candidate
+            if (ok_up && (!ok_down || up < down || (up == down && (c & 1)))) {
+                c += 1;
+            }
+            break;
+        } else if (t == 0) {
+            if (frac > FRAC_HALF || (frac == FRAC_HALF && (c & 1))) {
+                c += 1;
+            }
+            break;
+        }
+    }
+
+    int nd = FLT_MAX_DIGITS - t;
+    if (c == pow10_small[nd]) {
+        // rounded up to the next power of 10
+        c = 1;
+        nd = 1;
+        k_est += 1;
+    }
+    while (nd > 1 && c % 10 == 0) {
+        c /= 10;
+        nd -= 1;
+    }
+    *n = nd;
+    *k = k_est;
+    return c;
+}
+
+// Write the n digits of q into dig, most significant first.
+static void uint_to_digits(uint32_t q, int n, char *dig) {
+    for (int i = n - 1; i >= 0; i--) {
+        dig[i] = '0' + q % 10;
+        q /= 10;
+    }
+}
+
+// Write the number 0.dig * 10^(k+1) (dig has n digits) in fixed-point
+// notation with frac_digits digits after the decimal point.  Positions
+// beyond the given digits are written as '0'.
+static char *put_fixed(char *s, const char *dig, int n, int k, int frac_digits) {
+    for (int p = k < 0 ? 0 : k; p >= -frac_digits; p--) {
+        int i = k - p;
+        *s++ = (0 <= i && i < n) ? dig[i] : '0';
+        if (p == 0 && frac_digits > 0) {
+            *s++ = '.';
+        }
+    }
+    return s;
+}
+
+// Write the number dig[0].dig[1..] * 10^k in exponent notation with
+// frac_digits digits after the decimal point.
+static char *put_exp(char *s, const char *dig, int n, int k, int frac_digits, char e_char) {
+    *s++ = dig[0];
+    if (frac_digits > 0) {
+        *s++ = '.';
+        for (int i = 1; i <= frac_digits; i++) {
+            *s++ = i < n ? dig[i] : '0';
+        }
+    }
+    *s++ = e_char;
+    if (k < 0) {
+        *s++ = '-';
+        k = -k;
+    } else {
+        *s++ = '+';
+    }
+    *s++ = '0' + k / 10;
+    *s++ = '0' + k % 10;
+    return s;
+}
+
+// Length of the output of put_fixed and put_exp
+#define FIXED_LEN(k, frac_digits) (((k) < 0 ? 1 : (k) + 1) + ((frac_digits) > 0 ? (frac_digits) + 1 : 0))
+#define EXP_LEN(frac_digits) (1 + ((frac_digits) > 0 ? (frac_digits) + 1 : 0) + 4)
+
+// fmt is one of 'e', 'f', 'g' as for printf, or 'r' for the shortest
+// representation that reads back as the same float (as used by repr).
+// Upper case variants give an upper case exponent character.
 int format_float(float f, char *buf, size_t buf_size, char fmt, int prec, char sign) {
 
     char *s = buf;
@@ -115,223 +465,314 @@ int format_float(float f, char *buf, size_t buf_size, char fmt, int prec, char s
     }
     char e_char = 'E' | (fmt & 0x20);   // e_char will match case of fmt
     fmt |= 0x20; // Force fmt to be lowercase
-    char org_fmt = fmt;
-    if (fmt == 'g' && prec == 0) {
-        prec = 1;
-    }
-    int e, e1; 
-    int dec = 0;
-    char e_sign = '\0';
-    int num_digits = 0;
-    const float *pos_pow = g_pos_pow;
-    const float *neg_pow = g_neg_pow;
-
-    if (num.u == 0) {
-        e = 0;
-        if (fmt == 'e') {
-            e_sign = '+';
-        } else if (fmt == 'f') {
-            num_digits = prec + 1;
+
+    // decompose the float as m * 2^e
+    uint32_t m = num.u & FLT_MAN_MASK;
+    int e = (num.u & FLT_EXP_MASK) >> 23;
+    bool lower_closer = (m == 0 && e > 1);
+    if (e == 0) {
+        // subnormal
+        e = -149;
+    } else {
+        m |= FLT_MAN_MASK + 1;
+        e -= 150;
+    }
+
+    char dig[FLT_MAX_DIGITS + 1];
+    int n; // number of digits in dig
+    int k; // decimal exponent of dig[0]
+    uint32_t q;
+
+    int k_est = m == 0 ? 0 : floor_log10_pow2(e + 63 - clz64(m));
+    if (fmt == 'f' && FIXED_LEN(k_est + 1, prec) > buf_remaining) {
+        // trim the precision to fit the buffer
+        prec = buf_remaining - (k_est + 1) - 2;
+        if (prec < 0) {
+            // the integer part doesn't fit, use exponent notation
+            fmt = 'e';
         }
-    } else if (num.u < 0x3f800000) { // f < 1.0
-        // Build negative exponent
-        for (e = 0, e1 = 32; e1; e1 >>= 1, pos_pow++, neg_pow++) {
-            if (*neg_pow > num.f) {
-                e += e1;
-                num.f *= *pos_pow;
-            }
+    }
+
+    if (fmt == 'r') {
+        if (m == 0) {
+            q = 0, n = 1, k = 0;
+        } else {
+            q = float_shortest(m, e, lower_closer, &n, &k);
+        }
+        uint_to_digits(q, n, dig);
+        int frac_digits = n - 1 - k;
+        if (frac_digits < 0) {
+            frac_digits = 0;
         }
-        if (num.f < 1.0F && num.f >= 0.9999995F) {
-            num.f = 1.0F;
+        if (-4 <= k && k < 16 && FIXED_LEN(k, frac_digits) <= buf_remaining) {
+            s = put_fixed(s, dig, n, k, frac_digits);
         } else {
-            e++; 
-            num.f *= 10.0F;
+            s = put_exp(s, dig, n, k, n - 1, e_char);
         }
-
-        // If the user specified 'g' format, and e is <= 4, then we'll switch
-        // to the fixed format ('f')
-
-        if (fmt == 'f' || (fmt == 'g' && e <= 4)) {
-            fmt = 'f';
-            dec = -1;
-            *s++ = '0';
-
-            if (prec + e + 1 > buf_remaining) {
-                prec = buf_remaining - e - 1;
-            }
-
-            if (org_fmt == 'g') {
-                prec += (e - 1);
-            }
-            num_digits = prec;
-            if (num_digits) {
-                *s++ = '.'; 
-                while (--e && num_digits) {
-                    *s++ = '0';
-                    num_digits--;
-                }
+    } else if (fmt == 'f') {
+        if (m == 0) {
+            q = 0, n = 1, k = -prec;
+        } else if (k_est + 2 + prec <= FLT_MAX_DIGITS) {
+            // all the digits we need fit in q
+            q = round_pow10(m, e, prec);
+            for (n = 1; n < FLT_MAX_DIGITS + 1 && q >= pow10_small[n]; n++) {
             }
+            k = n - 1 - prec;
         } else {
-            // For e & g formats, we'll be printing the exponent, so set the
-            // sign.
-            e_sign = '-';
-            dec = 0;
-
-            if (prec > (buf_remaining - 6)) {
-                prec = buf_remaining - 6;
-                if (fmt == 'g') {
-                    prec++;
-                }
+            // more digits than a float holds, so pad with zeros
+            n = FLT_MAX_DIGITS;
+            q = float_digits(m, e, n, &k);
+        }
+        uint_to_digits(q, n, dig);
+        s = put_fixed(s, dig, n, k, prec);
+    } else if (fmt == 'e') {
+        if (EXP_LEN(prec) > buf_remaining) {
+            prec = buf_remaining - 6;
+            if (prec < 0) {
+                prec = 0;
             }
         }
+        n = prec + 1;
+        if (n > FLT_MAX_DIGITS) {
+            n = FLT_MAX_DIGITS;
+        }
+        if (m == 0) {
+            q = 0, k = 0;
+        } else {
+            q = float_digits(m, e, n, &k);
+        }
+        uint_to_digits(q, n, dig);
+        s = put_exp(s, dig, n, k, prec, e_char);
     } else {
-        // Build positive exponent
-        for (e = 0, e1 = 32; e1; e1 >>= 1, pos_pow++, neg_pow++) {
-            if (*pos_pow <= num.f) {
-                e += e1;
-                num.f *= *neg_pow;
-            }
+        // 'g' format: prec is the number of significant digits
+        if (prec == 0) {
+            prec = 1;
         }
-
-        // If the user specified fixed format (fmt == 'f') and e makes the 
-        // number too big to fit into the available buffer, then we'll
-        // switch to the 'e' format.
-
-        if (fmt == 'f') {
-            if (e >= buf_remaining) {
-                fmt = 'e';
-            } else if ((e + prec + 2) > buf_remaining) {
-                prec = buf_remaining - e - 2;
-                if (prec < 0) {
-                    // This means no decimal point, so we can add one back
-                    // for the decimal.
-                    prec++;
-                }
+        if (prec > buf_remaining - 6) {
+            prec = buf_remaining - 6;
+            if (prec < 1) {
+                prec = 1;
             }
         }
-        if (fmt == 'e' && prec > (buf_remaining - 6)) {
-            prec = buf_remaining - 6;
+        n = prec;
+        if (n > FLT_MAX_DIGITS) {
+            n = FLT_MAX_DIGITS;
         }
-        // If the user specified 'g' format, and e is < prec, then we'll switch
-        // to the fixed format.
-
-        if (fmt == 'g' && e < prec) {
-            fmt = 'f';
-            prec -= (e + 1);
+        if (m == 0) {
+            q = 0, n = 1, k = 0;
+        } else {
+            q = float_digits(m, e, n, &k);
+        }
+        // remove trailing zeros
+        while (n > 1 && q % 10 == 0) {
+            q /= 10;
+            n -= 1;
+        }
+        uint_to_digits(q, n, dig);
+        int frac_digits = n - 1 - k;
+        if (frac_digits < 0) {
+            frac_digits = 0;
         }
-        if (fmt == 'f') {
-            dec = e;
-            num_digits = prec + e + 1;
+        if (-4 <= k && k < prec && FIXED_LEN(k, frac_digits) <= buf_remaining) {
+            s = put_fixed(s, dig, n, k, frac_digits);
         } else {
-            e_sign = '+';
+            s = put_exp(s, dig, n, k, n - 1, e_char);
         }
     }
-    if (prec < 0) {
-        // This can happen when the prec is trimmed to prevent buffer overflow
-        prec = 0;
+
+    *s = '\0';
+
+    return s - buf;
+}
+
+// The number of bits to drop from hi * 2^e2 (hi normalised so that its top
+// bit is set) to get a 24-bit mantissa, or fewer bits for a subnormal result
+// whose least significant bit is 2^-149.  More than 64 means zero.
+static int float_round_shift(int e2) {
+    if (e2 + 63 < -126) {
+        return -149 - e2;
     }
+    return 40;
+}
 
-    // We now have num.f as a floating point number between >= 1 and < 10
-    // (or equal to zero), and e contains the absolute value of the power of
-    // 10 exponent. and (dec + 1) == the number of dgits before the decimal.
+// Round the number hi * 2^e2 (hi normalised so that its top bit is set)
+// to the nearest float.  sticky is set if the value is a little bigger
+// than that, so that exact ties can be broken correctly.
+static float float_from_fp(uint64_t hi, int e2, bool sticky) {
+    union {
+        float f;
+        uint32_t u;
+    } num;
 
-    // For e, prec is # digits after the decimal
-    // For f, prec is # digits after the decimal
-    // For g, prec is the max number of significant digits
-    //
-    // For e & g there will be a single digit before the decimal
-    // for f there will be e digits before the decimal
+    int lead = e2 + 63;
+    int shift = float_round_shift(e2);
+    if (shift > 64) {
+        num.u = 0;
+        return num.f;
+    }
 
-    if (fmt == 'e') {
-        num_digits = prec + 1;
-    } else if (fmt == 'g') {
-        if (prec == 0) {
-            prec = 1;
-        }
-        num_digits = prec; 
+    uint64_t mant, rem, half = (uint64_t)1 << (shift - 1);
+    if (shift == 64) {
+        mant = 0;
+        rem = hi;
+    } else {
+        mant = hi >> shift;
+        rem = hi & (((uint64_t)1 << shift) - 1);
+    }
+    if (rem > half || (rem == half && (sticky || (mant & 1)))) {
+        mant += 1;
     }
 
-    // Print the digits of the mantissa
-    for (int i = 0; i < num_digits; ++i, --dec) {
-        int32_t d = num.f;
-        *s++ = '0' + d;
-        if (dec == 0 && prec > 0) {
-            *s++ = '.';
+    if (shift == 40) {
+        // normal; the hidden bit of mant adds 1 to the exponent field, and
+        // rounding up to 2^24 carries into the exponent correctly
+        num.u = ((uint32_t)(lead + 126) << 23) + (uint32_t)mant;
+        if (num.u >= FLT_EXP_MASK) {
+            num.u = FLT_EXP_MASK; // infinity
         }
-        num.f -= (float)d;
-        num.f *= 10.0F;
-    }
-
-    // Round
-    if (num.f >= 5.0F) {
-        char *rs = s;
-        rs--;
-        while (1) {
-            if (*rs == '.') {
-                rs--;
-                continue;
-            }
-            if (*rs < '0' || *rs > '9') {
-                // + or -
-                rs++; // So we sit on the digit to the right of the sign
-                break;
-            }
-            if (*rs < '9') {
-                (*rs)++;
-                break;
-            }
-            *rs = '0';
-            if (rs == buf) {
-                break;
-            }
-            rs--; 
+    } else {
+        // subnormal, or the smallest normal if mant rounded up to 2^23
+        num.u = (uint32_t)mant;
+    }
+    return num.f;
+}
+
+// A little big number arithmetic, enough to compare mant * 10^exp10 with a
+// point half way between two floats exactly.  Both sides are near each other
+// and below 2^64 * 5^66, so 256 bits is plenty.
+#define BIG_WORDS (8)
+
+typedef struct _big_t {
+    uint32_t w[BIG_WORDS]; // least significant word first
+} big_t;
+
+static void big_set(big_t *b, uint64_t v) {
+    memset(b, 0, sizeof(*b));
+    b->w[0] = (uint32_t)v;
+    b->w[1] = v >> 32;
+}
+
+static void big_mul_pow5(big_t *b, int n) {
+    while (n > 0) {
+        // 5^13 is the largest power of 5 that fits in 32 bits
+        int k = n < 13 ? n : 13;
+        uint32_t m = 1;
+        for (int i = 0; i < k; i++) {
+            m *= 5;
         }
-        if (*rs == '0') {
-            // We need to insert a 1
-            if (rs[1] == '.' && fmt != 'f') {
-                // We're going to round 9.99 to 10.00
-                // Move the decimal point
-                rs[0] = '.';
-                rs[1] = '0';
-                if (e_sign == '-') {
-                    e--;
-                } else {
-                    e++; 
-                }
-            }
-            s++;
-            char *ss = s; 
-            while (ss > rs) {
-                *ss = ss[-1];
-                ss--;
-            }
-            *rs = '1';
+        uint64_t carry = 0;
+        for (int i = 0; i < BIG_WORDS; i++) {
+            carry += (uint64_t)b->w[i] * m;
+            b->w[i] = (uint32_t)carry;
+            carry >>= 32;
         }
-        if (num.u < 0x3f800000 && fmt == 'f') {
-            // We rounded up to 1.0
-            prec--;
+        n -= k;
+    }
+}
+
+static void big_shl(big_t *b, int n) {
+    int words = n / 32;
+    int bits = n % 32;
+    for (int i = BIG_WORDS - 1; i >= 0; i--) {
+        uint32_t w = i >= words ? b->w[i - words] << bits : 0;
+        if (bits > 0 && i > words) {
+            w |= b->w[i - words - 1] >> (32 - bits);
         }
+        b->w[i] = w;
     }
+}
 
-    if (org_fmt == 'g' && prec > 0) {
-        // Remove trailing zeros and a trailing decimal point
-        while (s[-1] == '0') {
-            s--;
+static int big_cmp(const big_t *a, const big_t *b) {
+    for (int i = BIG_WORDS - 1; i >= 0; i--) {
+        if (a->w[i] != b->w[i]) {
+            return a->w[i] < b->w[i] ? -1 : 1;
         }
-        if (s[-1] == '.') {
-            s--;
+    }
+    return 0;
+}
+
+// Compare mant * 10^exp10 with the half way point (2q + 1) * 2^e, returning
+// -1, 0 or 1 as it is below, on or above it.
+static int decimal_cmp_half_way(uint64_t mant, int exp10, uint32_t q, int e) {
+    // mant * 5^exp10 * 2^exp10 against (2q + 1) * 2^e, with the power of 5
+    // moved to whichever side keeps it positive
+    big_t l, r;
+    big_set(&l, mant);
+    big_set(&r, 2 * (uint64_t)q + 1);
+    if (exp10 >= 0) {
+        big_mul_pow5(&l, exp10);
+    } else {
+        big_mul_pow5(&r, -exp10);
+    }
+    if (exp10 > e) {
+        big_shl(&l, exp10 - e);
+    } else {
+        big_shl(&r, e - exp10);
+    }
+    return big_cmp(&l, &r);
+}
+
+// Convert mant * 10^exp10 to the nearest float.  truncated says that some
+// non-zero digits were dropped from the end of mant, which only matters for
+// breaking ties.
+float float_from_decimal(uint64_t mant, int exp10, bool truncated) {
+    if (mant == 0 || exp10 < -(45 + 1 + 20)) {
+        return 0;
+    } else if (exp10 > 39) {
+        union {
+            float f;
+            uint32_t u;
+        } num = {.u = FLT_EXP_MASK};
+        return num.f;
+    }
+
+    if (!truncated && mant < ((uint32_t)1 << 24) && -FLT_MAX_DIGITS <= exp10 && exp10 <= FLT_MAX_DIGITS) {
+        // mant and 10^exp10 are exact floats, so a single correctly rounded
+        // operation gives the correctly rounded result
+        if (exp10 >= 0) {
+            return (float)(uint32_t)mant * (float)pow10_small[exp10];
+        } else {
+            return (float)(uint32_t)mant / (float)pow10_small[-exp10];
         }
     }
-    // Append the exponent
-    if (e_sign) {
-        *s++ = e_char;
-        *s++ = e_sign;
-        *s++ = '0' + (e / 10);
-        *s++ = '0' + (e % 10);
+
+    // scale the normalised mantissa by the power of 10 and keep the top 64
+    // bits of the product
+    int lz = clz64(mant);
+    int fe;
+    uint64_t f = pow10_fp(exp10, &fe);
+    uint64_t hi, lo;
+    mul64(mant << lz, f, &hi, &lo);
+    int e2 = fe - lz + 64;
+    if ((hi >> 63) == 0) {
+        hi = (hi << 1) | (lo >> 63);
+        lo <<= 1;
+        e2 -= 1;
+    }
+    bool sticky = truncated || lo != 0;
+
+    // 10^exp10 is rounded down unless it is small, so the product can be a
+    // few units low.  That can only change the result if it lies within a
+    // few units of a half way point, in which case compare exactly and put
+    // the product on, just below or just above the half way point.
+    int shift = float_round_shift(e2);
+    if (shift <= 64) {
+        uint64_t half = (uint64_t)1 << (shift - 1);
+        uint64_t rem = hi & (half - 1 + half);
+        if (half - 8 <= rem && rem <= half + 8) {
+            uint32_t q = shift == 64 ? 0 : hi >> shift;
+            int c = decimal_cmp_half_way(mant, exp10, q, e2 + shift - 1);
+            hi = (hi & ~(half - 1 + half)) | half;
+            if (c < 0) {
+                hi -= 1;
+            } else if (c > 0) {
+                hi += 1;
+            }
+            sticky = truncated;
+        }
     }
-    *s = '\0';
 
-    return s - buf;
+    return float_from_fp(hi, e2, sticky);
 }
 
 #endif
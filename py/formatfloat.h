@@ -25,3 +25,4 @@
  */
 
 int format_float(float f, char *buf, size_t bufSize, char fmt, int prec, char sign);
+float float_from_decimal(uint64_t mant, int exp10, bool truncated);
@@ -45,8 +45,10 @@
 struct _mp_lexer_t {
     qstr source_name;           // name of source
     void *stream_data;          // data for stream
-    mp_lexer_stream_next_byte_t stream_next_byte;   // stream callback to get next byte
+    mp_lexer_stream_next_chunk_t stream_next_chunk; // stream callback to get next chunk
     mp_lexer_stream_close_t stream_close;           // stream callback to free
+    const byte *buf_cur;        // unread part of the current chunk
+    const byte *buf_end;
 
     unichar chr0, chr1, chr2;   // current cached characters from source
 
@@ -170,6 +172,42 @@ STATIC bool is_tail_of_identifier(mp_lexer_t *lex) {
     return is_head_of_identifier(lex) || is_digit(lex);
 }
 
+// plain ASCII identifier characters, which are copied in runs by copy_run
+STATIC bool is_id_byte(unichar c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// like is_id_byte, but for the tail of a number; e and E are left out because
+// they may be followed by an exponent sign
+STATIC bool is_num_byte(unichar c) {
+    return (is_id_byte(c) && c != 'e' && c != 'E') || c == '.';
+}
+
+STATIC unichar stream_next_byte(mp_lexer_t *lex) {
+    if (lex->buf_cur == lex->buf_end) {
+        mp_uint_t n = lex->stream_next_chunk(lex->stream_data, &lex->buf_cur);
+        if (n == 0) {
+            lex->buf_cur = lex->buf_end = NULL;
+            return MP_LEXER_EOF;
+        }
+        lex->buf_end = lex->buf_cur + n;
+    }
+    return *lex->buf_cur++;
+}
+
+// shift the cached characters along by one, reading a new chr2
+STATIC void shift_char(mp_lexer_t *lex) {
+    lex->chr0 = lex->chr1;
+    lex->chr1 = lex->chr2;
+    lex->chr2 = stream_next_byte(lex);
+    if (lex->chr2 == MP_LEXER_EOF) {
+        // EOF
+        if (lex->chr1 != MP_LEXER_EOF && lex->chr1 != '\n' && lex->chr1 != '\r') {
+            lex->chr2 = '\n'; // insert newline at end of file
+        }
+    }
+}
+
 STATIC void next_char(mp_lexer_t *lex) {
     if (lex->chr0 == MP_LEXER_EOF) {
         return;
@@ -198,18 +236,37 @@ STATIC void next_char(mp_lexer_t *lex) {
     }
 
     for (; advance > 0; advance--) {
-        lex->chr0 = lex->chr1;
-        lex->chr1 = lex->chr2;
-        lex->chr2 = lex->stream_next_byte(lex->stream_data);
-        if (lex->chr2 == MP_LEXER_EOF) {
-            // EOF
-            if (lex->chr1 != MP_LEXER_EOF && lex->chr1 != '\n' && lex->chr1 != '\r') {
-                lex->chr2 = '\n'; // insert newline at end of file
-            }
-        }
+        shift_char(lex);
     }
 }
 
+// If chr0, chr1 and chr2 all belong to the current name or number, add them
+// and the rest of the run in the current chunk to the token text in one go,
+// rather than one next_char at a time.  Returns false, having done nothing,
+// if the cached characters don't all qualify.
+STATIC bool copy_run(mp_lexer_t *lex, bool number) {
+    bool (*is_run_byte)(unichar) = number ? is_num_byte : is_id_byte;
+    if (!is_run_byte(lex->chr0) || !is_run_byte(lex->chr1) || !is_run_byte(lex->chr2)) {
+        return false;
+    }
+    const byte *top = lex->buf_cur;
+    while (top < lex->buf_end && is_run_byte(*top)) {
+        top++;
+    }
+    mp_uint_t len = top - lex->buf_cur;
+    char cached[3] = {lex->chr0, lex->chr1, lex->chr2};
+    vstr_add_strn(&lex->vstr, cached, 3);
+    vstr_add_strn(&lex->vstr, (const char*)lex->buf_cur, len);
+    // none of the run is a tab or newline, so each byte is one column
+    lex->column += 3 + len;
+    lex->buf_cur = top;
+    // reload the cached characters from what follows the run
+    shift_char(lex);
+    shift_char(lex);
+    shift_char(lex);
+    return true;
+}
+
 void indent_push(mp_lexer_t *lex, mp_uint_t indent) {
     if (lex->num_indent_level >= lex->alloc_indent_level) {
         // TODO use m_renew_maybe and somehow indicate an error if it fails... probably by using MP_TOKEN_MEMORY_ERROR
@@ -581,8 +638,10 @@ STATIC void mp_lexer_next_token_into(mp_lexer_t *lex, mp_token_t *tok, bool firs
 
         // get tail chars
         while (!is_end(lex) && is_tail_of_identifier(lex)) {
-            vstr_add_char(&lex->vstr, CUR_CHAR(lex));
-            next_char(lex);
+            if (!copy_run(lex, false)) {
+                vstr_add_char(&lex->vstr, CUR_CHAR(lex));
+                next_char(lex);
+            }
         }
 
     } else if (is_digit(lex) || (is_char(lex, '.') && is_following_digit(lex))) {
@@ -602,8 +661,10 @@ STATIC void mp_lexer_next_token_into(mp_lexer_t *lex, mp_token_t *tok, bool firs
                     next_char(lex);
                 }
             } else if (is_letter(lex) || is_digit(lex) || is_char_or(lex, '_', '.')) {
-                vstr_add_char(&lex->vstr, CUR_CHAR(lex));
-                next_char(lex);
+                if (!copy_run(lex, true)) {
+                    vstr_add_char(&lex->vstr, CUR_CHAR(lex));
+                    next_char(lex);
+                }
             } else {
                 break;
             }
@@ -730,7 +791,7 @@ STATIC void mp_lexer_next_token_into(mp_lexer_t *lex, mp_token_t *tok, bool firs
     }
 }
 
-mp_lexer_t *mp_lexer_new(qstr src_name, void *stream_data, mp_lexer_stream_next_byte_t stream_next_byte, mp_lexer_stream_close_t stream_close) {
+mp_lexer_t *mp_lexer_new(qstr src_name, void *stream_data, mp_lexer_stream_next_chunk_t stream_next_chunk, mp_lexer_stream_close_t stream_close) {
     mp_lexer_t *lex = m_new_obj_maybe(mp_lexer_t);
 
     // check for memory allocation error
@@ -743,8 +804,10 @@ mp_lexer_t *mp_lexer_new(qstr src_name, void *stream_data, mp_lexer_stream_next_
 
     lex->source_name = src_name;
     lex->stream_data = stream_data;
-    lex->stream_next_byte = stream_next_byte;
+    lex->stream_next_chunk = stream_next_chunk;
     lex->stream_close = stream_close;
+    lex->buf_cur = NULL;
+    lex->buf_end = NULL;
     lex->line = 1;
     lex->column = 1;
     lex->emit_dent = 0;
@@ -764,9 +827,9 @@ mp_lexer_t *mp_lexer_new(qstr src_name, void *stream_data, mp_lexer_stream_next_
     lex->indent_level[0] = 0;
 
     // preload characters
-    lex->chr0 = stream_next_byte(stream_data);
-    lex->chr1 = stream_next_byte(stream_data);
-    lex->chr2 = stream_next_byte(stream_data);
+    lex->chr0 = stream_next_byte(lex);
+    lex->chr1 = stream_next_byte(lex);
+    lex->chr2 = stream_next_byte(lex);
 
     // if input stream is 0, 1 or 2 characters long and doesn't end in a newline, then insert a newline at the end
     if (lex->chr0 == MP_LEXER_EOF) {
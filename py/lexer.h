@@ -139,18 +139,18 @@ typedef struct _mp_token_t {
     mp_uint_t len;              // (byte) length of string of token
 } mp_token_t;
 
-// the next-byte function must return the next byte in the stream
-// it must return MP_LEXER_EOF if end of stream
-// it can be called again after returning MP_LEXER_EOF, and in that case must return MP_LEXER_EOF
+// the next-chunk function must set *buf to the next chunk of the stream and return its length
+// it must return 0 at end of stream, and again on any call after that
+// the chunk only needs to stay valid until the next call
 #define MP_LEXER_EOF (-1)
-typedef mp_uint_t (*mp_lexer_stream_next_byte_t)(void*);
+typedef mp_uint_t (*mp_lexer_stream_next_chunk_t)(void*, const byte **buf);
 typedef void (*mp_lexer_stream_close_t)(void*);
 
 typedef struct _mp_lexer_t mp_lexer_t;
 
 void mp_token_show(const mp_token_t *tok);
 
-mp_lexer_t *mp_lexer_new(qstr src_name, void *stream_data, mp_lexer_stream_next_byte_t stream_next_byte, mp_lexer_stream_close_t stream_close);
+mp_lexer_t *mp_lexer_new(qstr src_name, void *stream_data, mp_lexer_stream_next_chunk_t stream_next_chunk, mp_lexer_stream_close_t stream_close);
 mp_lexer_t *mp_lexer_new_from_str_len(qstr src_name, const char *str, mp_uint_t len, mp_uint_t free_len);
 
 void mp_lexer_free(mp_lexer_t *lex);
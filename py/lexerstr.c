@@ -36,12 +36,12 @@ typedef struct _mp_lexer_str_buf_t {
     const char *src_end;        // end (exclusive) of source
 } mp_lexer_str_buf_t;
 
-STATIC mp_uint_t str_buf_next_byte(mp_lexer_str_buf_t *sb) {
-    if (sb->src_cur < sb->src_end) {
-        return *sb->src_cur++;
-    } else {
-        return MP_LEXER_EOF;
-    }
+// the whole string is handed over as a single chunk
+STATIC mp_uint_t str_buf_next_chunk(mp_lexer_str_buf_t *sb, const byte **buf) {
+    mp_uint_t len = sb->src_end - sb->src_cur;
+    *buf = (const byte*)sb->src_cur;
+    sb->src_cur = sb->src_end;
+    return len;
 }
 
 STATIC void str_buf_free(mp_lexer_str_buf_t *sb) {
@@ -60,5 +60,5 @@ mp_lexer_t *mp_lexer_new_from_str_len(qstr src_name, const char *str, mp_uint_t
     sb->src_beg = str;
     sb->src_cur = str;
     sb->src_end = str + len;
-    return mp_lexer_new(src_name, sb, (mp_lexer_stream_next_byte_t)str_buf_next_byte, (mp_lexer_stream_close_t)str_buf_free);
+    return mp_lexer_new(src_name, sb, (mp_lexer_stream_next_chunk_t)str_buf_next_chunk, (mp_lexer_stream_close_t)str_buf_free);
 }
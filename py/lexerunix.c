@@ -41,26 +41,21 @@
 
 typedef struct _mp_lexer_file_buf_t {
     int fd;
-    byte buf[20];
-    mp_uint_t len;
-    mp_uint_t pos;
+    bool eof;
+    byte buf[MICROPY_ALLOC_LEXER_FILE_BUF];
 } mp_lexer_file_buf_t;
 
-STATIC mp_uint_t file_buf_next_byte(mp_lexer_file_buf_t *fb) {
-    if (fb->pos >= fb->len) {
-        if (fb->len == 0) {
-            return MP_LEXER_EOF;
-        } else {
-            int n = read(fb->fd, fb->buf, sizeof(fb->buf));
-            if (n <= 0) {
-                fb->len = 0;
-                return MP_LEXER_EOF;
-            }
-            fb->len = n;
-            fb->pos = 0;
-        }
+STATIC mp_uint_t file_buf_next_chunk(mp_lexer_file_buf_t *fb, const byte **buf) {
+    if (fb->eof) {
+        return 0;
     }
-    return fb->buf[fb->pos++];
+    int n = read(fb->fd, fb->buf, sizeof(fb->buf));
+    if (n <= 0) {
+        fb->eof = true;
+        return 0;
+    }
+    *buf = fb->buf;
+    return n;
 }
 
 STATIC void file_buf_close(mp_lexer_file_buf_t *fb) {
@@ -78,10 +73,8 @@ mp_lexer_t *mp_lexer_new_from_file(const char *filename) {
         m_del_obj(mp_lexer_file_buf_t, fb);
         return NULL;
     }
-    int n = read(fb->fd, fb->buf, sizeof(fb->buf));
-    fb->len = n;
-    fb->pos = 0;
-    return mp_lexer_new(qstr_from_str(filename), fb, (mp_lexer_stream_next_byte_t)file_buf_next_byte, (mp_lexer_stream_close_t)file_buf_close);
+    fb->eof = false;
+    return mp_lexer_new(qstr_from_str(filename), fb, (mp_lexer_stream_next_chunk_t)file_buf_next_chunk, (mp_lexer_stream_close_t)file_buf_close);
 }
 
 #endif // MICROPY_HELPER_LEXER_UNIX
@@ -28,9 +28,11 @@
 #include <assert.h>
 #include <string.h>
 #include "mpconfig.h"
+#include "nlr.h"
 #include "misc.h"
 #include "qstr.h"
 #include "obj.h"
+#include "runtime.h"
 #include "builtin.h"
 #include "objtuple.h"
 #include "objstr.h"
@@ -85,124 +87,286 @@ STATIC mp_uint_t get_fmt_num(const char **p) {
     return val;
 }
 
-STATIC uint calcsize_items(const char *fmt) {
-    uint cnt = 0;
-    while (*fmt) {
-        // TODO supports size spec only for "s"
-        if (!unichar_isdigit(*fmt++)) {
-            cnt++;
-        }
-    }
-    return cnt;
-}
+/******************************************************************************/
+// compiled format
 
-STATIC mp_obj_t struct_calcsize(mp_obj_t fmt_in) {
-    const char *fmt = mp_obj_str_get_str(fmt_in);
+// A format string is compiled once into a list of ops, one per value to be
+// packed/unpacked, each with its byte offset from the start of the packed
+// data.  Packing and unpacking then just walk the list.
+typedef struct _struct_op_t {
+    char type;      // value typecode, or 's' for a fixed-length byte string
+    mp_uint_t offset;
+    mp_uint_t len;  // size in bytes of the value
+} struct_op_t;
+
+typedef struct _mp_obj_struct_t {
+    mp_obj_base_t base;
+    mp_obj_t fmt;
+    bool big_endian;
+    mp_uint_t size; // total size in bytes of the packed data
+    mp_uint_t n_ops;
+    struct_op_t *ops;
+} mp_obj_struct_t;
+
+STATIC const mp_obj_type_t struct_Struct_type;
+
+// number of ops that the module-level functions can compile on the stack
+#define STRUCT_STACK_OPS (8)
+
+// Parse the format string, returning the number of ops needed.  If ops is
+// not NULL then it is filled in with the compiled ops.
+STATIC mp_uint_t struct_parse_fmt(const char *fmt, mp_obj_struct_t *st, struct_op_t *ops) {
     char fmt_type = get_fmt_type(&fmt);
-    mp_uint_t size;
-    for (size = 0; *fmt; fmt++) {
-        mp_uint_t align = 1;
+    #if MP_ENDIANNESS_LITTLE
+    st->big_endian = (fmt_type == '>');
+    #else
+    st->big_endian = (fmt_type != '<');
+    #endif
+    mp_uint_t size = 0;
+    mp_uint_t n_ops = 0;
+    for (; *fmt; fmt++) {
         mp_uint_t cnt = 1;
         if (unichar_isdigit(*fmt)) {
             cnt = get_fmt_num(&fmt);
         }
-        if (cnt > 1) {
-            // TODO: count spec support only for string len
-            assert(*fmt == 's');
-        }
 
-        mp_uint_t sz;
         if (*fmt == 's') {
-            sz = cnt;
+            // a count for "s" is the length of the string, which is one value
+            if (ops != NULL) {
+                ops[n_ops].type = 's';
+                ops[n_ops].offset = size;
+                ops[n_ops].len = cnt;
+            }
+            n_ops += 1;
+            size += cnt;
+        } else if (*fmt == 'x') {
+            // pad bytes, no value
+            size += cnt;
         } else {
-            sz = (mp_uint_t)mp_binary_get_size(fmt_type, *fmt, &align);
+            mp_uint_t align = 1;
+            mp_uint_t sz = (mp_uint_t)mp_binary_get_size(fmt_type, *fmt, &align);
+            if (sz == 0) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "bad typecode"));
+            }
+            for (; cnt > 0; cnt--) {
+                // Apply alignment
+                size = (size + align - 1) & ~(align - 1);
+                if (ops != NULL) {
+                    ops[n_ops].type = *fmt;
+                    ops[n_ops].offset = size;
+                    ops[n_ops].len = sz;
+                }
+                n_ops += 1;
+                size += sz;
+            }
         }
-        // TODO
-        assert(sz != (mp_uint_t)-1);
-        // Apply alignment
-        size = (size + align - 1) & ~(align - 1);
-        size += sz;
     }
-    return MP_OBJ_NEW_SMALL_INT(size);
+    st->size = size;
+    st->n_ops = n_ops;
+    return n_ops;
 }
-MP_DEFINE_CONST_FUN_OBJ_1(struct_calcsize_obj, struct_calcsize);
 
-STATIC mp_obj_t struct_unpack(mp_obj_t fmt_in, mp_obj_t data_in) {
-    // TODO: "The buffer must contain exactly the amount of data required by the format (len(bytes) must equal calcsize(fmt))."
+// Compile the format, using ops_buf (which has room for STRUCT_STACK_OPS ops)
+// if it is big enough, and the heap otherwise.
+STATIC void struct_compile(mp_obj_t fmt_in, mp_obj_struct_t *st, struct_op_t *ops_buf) {
     const char *fmt = mp_obj_str_get_str(fmt_in);
-    char fmt_type = get_fmt_type(&fmt);
-    uint size = calcsize_items(fmt);
-    mp_obj_tuple_t *res = mp_obj_new_tuple(size, NULL);
-    mp_buffer_info_t bufinfo;
-    mp_get_buffer_raise(data_in, &bufinfo, MP_BUFFER_READ);
-    byte *p = bufinfo.buf;
+    st->base.type = &struct_Struct_type;
+    st->fmt = fmt_in;
+    mp_uint_t n_ops = struct_parse_fmt(fmt, st, NULL);
+    if (ops_buf == NULL || n_ops > STRUCT_STACK_OPS) {
+        ops_buf = m_new(struct_op_t, n_ops);
+    }
+    st->ops = ops_buf;
+    struct_parse_fmt(fmt, st, ops_buf);
+}
 
-    for (uint i = 0; i < size; i++) {
-        mp_uint_t sz = 1;
-        if (unichar_isdigit(*fmt)) {
-            sz = get_fmt_num(&fmt);
-        }
-        if (sz > 1) {
-            // TODO: size spec support only for string len
-            assert(*fmt == 's');
+// Get a buffer and offset into it, checking that the packed data fits.
+STATIC byte *struct_get_buf(mp_obj_struct_t *st, mp_obj_t buf_in, mp_obj_t offset_in, mp_uint_t flags) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, flags);
+    mp_int_t offset = 0;
+    if (offset_in != MP_OBJ_NULL) {
+        offset = mp_obj_get_int(offset_in);
+        if (offset < 0) {
+            // negative offsets count from the end of the buffer
+            offset += bufinfo.len;
         }
-        mp_obj_t item;
-        if (*fmt == 's') {
-            item = mp_obj_new_bytes(p, sz);
-            p += sz;
-            fmt++;
+    }
+    if (offset < 0 || (mp_uint_t)offset > bufinfo.len || bufinfo.len - offset < st->size) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "buffer too small"));
+    }
+    return (byte*)bufinfo.buf + offset;
+}
+
+STATIC mp_obj_t struct_unpack_internal(mp_obj_struct_t *st, const byte *p) {
+    mp_obj_tuple_t *res = mp_obj_new_tuple(st->n_ops, NULL);
+    for (mp_uint_t i = 0; i < st->n_ops; i++) {
+        const struct_op_t *op = &st->ops[i];
+        if (op->type == 's') {
+            res->items[i] = mp_obj_new_bytes(p + op->offset, op->len);
         } else {
-            item = mp_binary_get_val(fmt_type, *fmt++, &p);
+            res->items[i] = mp_binary_get_val_at(op->type, op->len, st->big_endian, p + op->offset);
         }
-        res->items[i] = item;
     }
     return res;
 }
-MP_DEFINE_CONST_FUN_OBJ_2(struct_unpack_obj, struct_unpack);
-
-STATIC mp_obj_t struct_pack(mp_uint_t n_args, const mp_obj_t *args) {
-    // TODO: "The arguments must match the values required by the format exactly."
-    const char *fmt = mp_obj_str_get_str(args[0]);
-    char fmt_type = get_fmt_type(&fmt);
-    mp_int_t size = MP_OBJ_SMALL_INT_VALUE(struct_calcsize(args[0]));
-    byte *p;
-    mp_obj_t res = mp_obj_str_builder_start(&mp_type_bytes, size, &p);
-    memset(p, 0, size);
-
-    for (mp_uint_t i = 1; i < n_args; i++) {
-        mp_uint_t sz = 1;
-        if (unichar_isdigit(*fmt)) {
-            sz = get_fmt_num(&fmt);
-        }
-        if (sz > 1) {
-            // TODO: size spec support only for string len
-            assert(*fmt == 's');
-        }
 
-        if (*fmt == 's') {
+STATIC void struct_pack_internal(mp_obj_struct_t *st, byte *p, mp_uint_t n_args, const mp_obj_t *args) {
+    if (n_args != st->n_ops) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "pack expected %d items", st->n_ops));
+    }
+    // zero the whole area first so that padding is deterministic
+    memset(p, 0, st->size);
+    for (mp_uint_t i = 0; i < n_args; i++) {
+        const struct_op_t *op = &st->ops[i];
+        if (op->type == 's') {
             mp_buffer_info_t bufinfo;
             mp_get_buffer_raise(args[i], &bufinfo, MP_BUFFER_READ);
-            mp_uint_t to_copy = sz;
+            mp_uint_t to_copy = op->len;
             if (bufinfo.len < to_copy) {
                 to_copy = bufinfo.len;
             }
-            memcpy(p, bufinfo.buf, to_copy);
-            memset(p + to_copy, 0, sz - to_copy);
-            p += sz;
-            fmt++;
+            memcpy(p + op->offset, bufinfo.buf, to_copy);
         } else {
-            mp_binary_set_val(fmt_type, *fmt++, args[i], &p);
+            mp_binary_set_val_at(op->type, op->len, st->big_endian, args[i], p + op->offset);
         }
     }
-    return res;
+}
+
+STATIC mp_obj_t struct_pack_new(mp_obj_struct_t *st, mp_uint_t n_args, const mp_obj_t *args) {
+    byte *p;
+    mp_obj_t res = mp_obj_str_builder_start(&mp_type_bytes, st->size, &p);
+    struct_pack_internal(st, p, n_args, args);
+    return mp_obj_str_builder_end(res);
+}
+
+/******************************************************************************/
+// module functions
+
+STATIC mp_obj_t struct_calcsize(mp_obj_t fmt_in) {
+    mp_obj_struct_t st;
+    struct_parse_fmt(mp_obj_str_get_str(fmt_in), &st, NULL);
+    return MP_OBJ_NEW_SMALL_INT(st.size);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(struct_calcsize_obj, struct_calcsize);
+
+STATIC mp_obj_t struct_unpack(mp_obj_t fmt_in, mp_obj_t data_in) {
+    // TODO: "The buffer must contain exactly the amount of data required by the format (len(bytes) must equal calcsize(fmt))."
+    mp_obj_struct_t st;
+    struct_op_t ops[STRUCT_STACK_OPS];
+    struct_compile(fmt_in, &st, ops);
+    return struct_unpack_internal(&st, struct_get_buf(&st, data_in, MP_OBJ_NULL, MP_BUFFER_READ));
+}
+MP_DEFINE_CONST_FUN_OBJ_2(struct_unpack_obj, struct_unpack);
+
+STATIC mp_obj_t struct_unpack_from(mp_uint_t n_args, const mp_obj_t *args) {
+    mp_obj_struct_t st;
+    struct_op_t ops[STRUCT_STACK_OPS];
+    struct_compile(args[0], &st, ops);
+    return struct_unpack_internal(&st, struct_get_buf(&st, args[1], n_args > 2 ? args[2] : MP_OBJ_NULL, MP_BUFFER_READ));
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(struct_unpack_from_obj, 2, 3, struct_unpack_from);
+
+STATIC mp_obj_t struct_pack(mp_uint_t n_args, const mp_obj_t *args) {
+    mp_obj_struct_t st;
+    struct_op_t ops[STRUCT_STACK_OPS];
+    struct_compile(args[0], &st, ops);
+    return struct_pack_new(&st, n_args - 1, args + 1);
 }
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(struct_pack_obj, 1, MP_OBJ_FUN_ARGS_MAX, struct_pack);
 
+STATIC mp_obj_t struct_pack_into(mp_uint_t n_args, const mp_obj_t *args) {
+    mp_obj_struct_t st;
+    struct_op_t ops[STRUCT_STACK_OPS];
+    struct_compile(args[0], &st, ops);
+    byte *p = struct_get_buf(&st, args[1], args[2], MP_BUFFER_WRITE);
+    struct_pack_internal(&st, p, n_args - 3, args + 3);
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(struct_pack_into_obj, 3, MP_OBJ_FUN_ARGS_MAX, struct_pack_into);
+
+/******************************************************************************/
+// Struct class
+
+STATIC void struct_Struct_print(void (*print)(void *env, const char *fmt, ...), void *env, mp_obj_t self_in, mp_print_kind_t kind) {
+    mp_obj_struct_t *self = self_in;
+    print(env, "Struct(%s)", mp_obj_str_get_str(self->fmt));
+}
+
+STATIC mp_obj_t struct_Struct_make_new(mp_obj_t type_in, mp_uint_t n_args, mp_uint_t n_kw, const mp_obj_t *args) {
+    mp_arg_check_num(n_args, n_kw, 1, 1, false);
+    mp_obj_struct_t *self = m_new_obj(mp_obj_struct_t);
+    struct_compile(args[0], self, NULL);
+    return self;
+}
+
+STATIC mp_obj_t struct_Struct_unpack(mp_obj_t self_in, mp_obj_t data_in) {
+    mp_obj_struct_t *self = self_in;
+    return struct_unpack_internal(self, struct_get_buf(self, data_in, MP_OBJ_NULL, MP_BUFFER_READ));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(struct_Struct_unpack_obj, struct_Struct_unpack);
+
+STATIC mp_obj_t struct_Struct_unpack_from(mp_uint_t n_args, const mp_obj_t *args) {
+    mp_obj_struct_t *self = args[0];
+    return struct_unpack_internal(self, struct_get_buf(self, args[1], n_args > 2 ? args[2] : MP_OBJ_NULL, MP_BUFFER_READ));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(struct_Struct_unpack_from_obj, 2, 3, struct_Struct_unpack_from);
+
+STATIC mp_obj_t struct_Struct_pack(mp_uint_t n_args, const mp_obj_t *args) {
+    return struct_pack_new(args[0], n_args - 1, args + 1);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(struct_Struct_pack_obj, 1, MP_OBJ_FUN_ARGS_MAX, struct_Struct_pack);
+
+STATIC mp_obj_t struct_Struct_pack_into(mp_uint_t n_args, const mp_obj_t *args) {
+    mp_obj_struct_t *self = args[0];
+    byte *p = struct_get_buf(self, args[1], args[2], MP_BUFFER_WRITE);
+    struct_pack_internal(self, p, n_args - 3, args + 3);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(struct_Struct_pack_into_obj, 3, MP_OBJ_FUN_ARGS_MAX, struct_Struct_pack_into);
+
+STATIC const mp_map_elem_t struct_Struct_locals_dict_table[] = {
+    { MP_OBJ_NEW_QSTR(MP_QSTR_pack), (mp_obj_t)&struct_Struct_pack_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_pack_into), (mp_obj_t)&struct_Struct_pack_into_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_unpack), (mp_obj_t)&struct_Struct_unpack_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_unpack_from), (mp_obj_t)&struct_Struct_unpack_from_obj },
+};
+
+STATIC MP_DEFINE_CONST_DICT(struct_Struct_locals_dict, struct_Struct_locals_dict_table);
+
+// Struct has the attributes "size" and "format" as well as its methods
+STATIC void struct_Struct_load_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
+    mp_obj_struct_t *self = self_in;
+    if (attr == MP_QSTR_size) {
+        dest[0] = MP_OBJ_NEW_SMALL_INT(self->size);
+    } else if (attr == MP_QSTR_format) {
+        dest[0] = self->fmt;
+    } else {
+        mp_map_elem_t *elem = mp_map_lookup((mp_map_t*)&struct_Struct_locals_dict.map, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP);
+        if (elem != NULL) {
+            dest[0] = elem->value;
+            dest[1] = self_in;
+        }
+    }
+}
+
+STATIC const mp_obj_type_t struct_Struct_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_Struct,
+    .print = struct_Struct_print,
+    .make_new = struct_Struct_make_new,
+    .load_attr = struct_Struct_load_attr,
+    .locals_dict = (mp_obj_t)&struct_Struct_locals_dict,
+};
+
 STATIC const mp_map_elem_t mp_module_struct_globals_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR___name__), MP_OBJ_NEW_QSTR(MP_QSTR_struct) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_calcsize), (mp_obj_t)&struct_calcsize_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_pack), (mp_obj_t)&struct_pack_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_pack_into), (mp_obj_t)&struct_pack_into_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_unpack), (mp_obj_t)&struct_unpack_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_unpack_from), (mp_obj_t)&struct_unpack_from_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_Struct), (mp_obj_t)&struct_Struct_type },
 };
 
 STATIC const mp_obj_dict_t mp_module_struct_globals = {
@@ -46,6 +46,11 @@
 #define MICROPY_ALLOC_LEXEL_INDENT_INC (8)
 #endif
 
+// Size of the buffer the file lexers read source into, a chunk at a time
+#ifndef MICROPY_ALLOC_LEXER_FILE_BUF
+#define MICROPY_ALLOC_LEXER_FILE_BUF (128)
+#endif
+
 // Initial amount for parse rule stack
 #ifndef MICROPY_ALLOC_PARSE_RULE_INIT
 #define MICROPY_ALLOC_PARSE_RULE_INIT (64)
@@ -292,6 +297,18 @@ typedef double mp_float_t;
 #define MICROPY_PY_BUILTINS_MEMORYVIEW (0)
 #endif
 
+// Number of compiled str.format templates to cache, keyed by the qstr of
+// the format string (0 to disable)
+#ifndef MICROPY_PY_STR_FORMAT_CACHE
+#define MICROPY_PY_STR_FORMAT_CACHE (0)
+#endif
+
+// Whether to support slice assignment and deletion for array, bytearray
+// and memoryview (memoryview slices can be assigned but not resized)
+#ifndef MICROPY_PY_ARRAY_SLICE_ASSIGN
+#define MICROPY_PY_ARRAY_SLICE_ASSIGN (0)
+#endif
+
 // Whether to support set object
 #ifndef MICROPY_PY_BUILTINS_SET
 #define MICROPY_PY_BUILTINS_SET (1)
@@ -233,6 +233,7 @@ void mp_get_buffer_raise(mp_obj_t obj, mp_buffer_info_t *bufinfo, mp_uint_t flag
 #define MP_STREAM_ERROR (-1)
 #define MP_STREAM_FLUSH (1)
 #define MP_STREAM_POLL  (2)
+#define MP_STREAM_SEEK  (3)
 typedef struct _mp_stream_p_t {
     // On error, functions should return MP_STREAM_ERROR and fill in *errcode (values
     // are implementation-dependent, but will be exposed to user, e.g. via exception).
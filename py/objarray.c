@@ -57,7 +57,7 @@
 #if MICROPY_PY_BUILTINS_MEMORYVIEW
 #define TYPECODE_MASK (0x7f)
 #else
-#define TYPECODE_MASK (~(mp_uint_t)1)
+#define TYPECODE_MASK (~(mp_uint_t)0)
 #endif
 
 typedef struct _mp_obj_array_t {
@@ -255,29 +255,123 @@ STATIC mp_obj_t array_append(mp_obj_t self_in, mp_obj_t arg) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(array_append_obj, array_append);
 
+#if MICROPY_PY_ARRAY_SLICE_ASSIGN
+// Replace elements [slice->start, slice->stop) of the array with the src_len
+// elements at src_items, resizing the array in place if the number of elements
+// changes (a memoryview can't change size).  src_items may point into the
+// array itself: if the tail has to move then the source is copied aside first.
+STATIC void array_replace_slice(mp_obj_array_t *o, const mp_bound_slice_t *slice, const byte *src_items, mp_uint_t src_len) {
+    mp_uint_t item_sz = mp_binary_get_size('@', o->typecode & TYPECODE_MASK, NULL);
+    byte *dest_items = o->items;
+    mp_int_t len_adj = src_len - (slice->stop - slice->start);
+
+    #if MICROPY_PY_BUILTINS_MEMORYVIEW
+    if (o->base.type == &mp_type_memoryview) {
+        if (len_adj != 0) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "memoryview can't change size"));
+        }
+        dest_items += (mp_uint_t)o->free * item_sz;
+    }
+    #endif
+
+    if (len_adj == 0) {
+        // same size: a single copy, no allocation
+        memmove(dest_items + slice->start * item_sz, src_items, src_len * item_sz);
+        return;
+    }
+
+    mp_uint_t alloc_len = o->len + o->free;
+    byte *src_copy = NULL;
+    if (src_len > 0 && src_items < dest_items + alloc_len * item_sz && src_items + src_len * item_sz > dest_items) {
+        src_copy = m_new(byte, src_len * item_sz);
+        memcpy(src_copy, src_items, src_len * item_sz);
+        src_items = src_copy;
+    }
+
+    if (len_adj > 0) {
+        if ((mp_uint_t)len_adj > o->free) {
+            // grow to exactly the size needed; append adds its own headroom
+            o->items = m_realloc(o->items, alloc_len * item_sz, (o->len + len_adj) * item_sz);
+            o->free = len_adj;
+            dest_items = o->items;
+        }
+    }
+    memmove(dest_items + (slice->stop + len_adj) * item_sz, dest_items + slice->stop * item_sz, (o->len - slice->stop) * item_sz);
+    memcpy(dest_items + slice->start * item_sz, src_items, src_len * item_sz);
+    if (len_adj < 0) {
+        // clear "freed" elements at the end of the array
+        mp_seq_clear(dest_items, o->len + len_adj, o->len, item_sz);
+    }
+    o->len += len_adj;
+    o->free -= len_adj;
+
+    if (src_copy != NULL) {
+        m_del(byte, src_copy, src_len * item_sz);
+    }
+}
+#endif
+
 STATIC mp_obj_t array_subscr(mp_obj_t self_in, mp_obj_t index_in, mp_obj_t value) {
     if (value == MP_OBJ_NULL) {
         // delete item
-        // TODO implement
-        // TODO: confirmed that both bytearray and array.array support
-        // slice deletion
+        #if MICROPY_PY_ARRAY_SLICE_ASSIGN
+        mp_obj_array_t *o = self_in;
+        #if MICROPY_PY_BUILTINS_MEMORYVIEW
+        if (o->base.type == &mp_type_memoryview) {
+            return MP_OBJ_NULL; // op not supported
+        }
+        #endif
+        mp_bound_slice_t slice;
+        if (0) {
+#if MICROPY_PY_BUILTINS_SLICE
+        } else if (MP_OBJ_IS_TYPE(index_in, &mp_type_slice)) {
+            if (!mp_seq_get_fast_slice_indexes(o->len, index_in, &slice)) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_NotImplementedError,
+                    "only slices with step=1 (aka None) are supported"));
+            }
+#endif
+        } else {
+            slice.start = mp_get_index(o->base.type, o->len, index_in, false);
+            slice.stop = slice.start + 1;
+        }
+        array_replace_slice(o, &slice, NULL, 0);
+        return mp_const_none;
+        #else
         return MP_OBJ_NULL; // op not supported
+        #endif
     } else {
         mp_obj_array_t *o = self_in;
         if (0) {
 #if MICROPY_PY_BUILTINS_SLICE
         } else if (MP_OBJ_IS_TYPE(index_in, &mp_type_slice)) {
-            if (value != MP_OBJ_SENTINEL) {
-                // Only getting a slice is suported so far, not assignment
-                // TODO: confirmed that both bytearray and array.array support
-                // slice assignment (incl. of different size)
-                return MP_OBJ_NULL; // op not supported
-            }
             mp_bound_slice_t slice;
             if (!mp_seq_get_fast_slice_indexes(o->len, index_in, &slice)) {
                 nlr_raise(mp_obj_new_exception_msg(&mp_type_NotImplementedError,
                     "only slices with step=1 (aka None) are supported"));
             }
+            if (value != MP_OBJ_SENTINEL) {
+                #if MICROPY_PY_ARRAY_SLICE_ASSIGN
+                // store; the source can be any object with the buffer protocol
+                #if MICROPY_PY_BUILTINS_MEMORYVIEW
+                if (o->base.type == &mp_type_memoryview && (o->typecode & 0x80) == 0) {
+                    // store to read-only memoryview
+                    return MP_OBJ_NULL;
+                }
+                #endif
+                mp_buffer_info_t src_bufinfo;
+                mp_get_buffer_raise(value, &src_bufinfo, MP_BUFFER_READ);
+                mp_uint_t item_sz = mp_binary_get_size('@', o->typecode & TYPECODE_MASK, NULL);
+                // byte-sized arrays take any buffer, others need one of the same type
+                if (item_sz != 1 && src_bufinfo.typecode != (o->typecode & TYPECODE_MASK)) {
+                    nlr_raise(mp_obj_new_exception_msg(&mp_type_TypeError, "lhs and rhs should be compatible"));
+                }
+                array_replace_slice(o, &slice, src_bufinfo.buf, src_bufinfo.len / item_sz);
+                return mp_const_none;
+                #else
+                // Only getting a slice is suported
+                return MP_OBJ_NULL; // op not supported
+                #endif
+            }
             mp_obj_array_t *res;
             int sz = mp_binary_get_size('@', o->typecode & TYPECODE_MASK, NULL);
             assert(sz > 0);
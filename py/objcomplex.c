@@ -56,14 +56,14 @@ mp_obj_t mp_obj_new_complex(mp_float_t real, mp_float_t imag);
 STATIC void complex_print(void (*print)(void *env, const char *fmt, ...), void *env, mp_obj_t o_in, mp_print_kind_t kind) {
     mp_obj_complex_t *o = o_in;
 #if MICROPY_FLOAT_IMPL == MICROPY_FLOAT_IMPL_FLOAT
-    char buf[16];
+    char buf[24];
     if (o->real == 0) {
-        format_float(o->imag, buf, sizeof(buf), 'g', 7, '\0');
+        format_float(o->imag, buf, sizeof(buf), 'r', 0, '\0');
         print(env, "%sj", buf);
     } else {
-        format_float(o->real, buf, sizeof(buf), 'g', 7, '\0');
+        format_float(o->real, buf, sizeof(buf), 'r', 0, '\0');
         print(env, "(%s+", buf);
-        format_float(o->imag, buf, sizeof(buf), 'g', 7, '\0');
+        format_float(o->imag, buf, sizeof(buf), 'r', 0, '\0');
         print(env, "%sj)", buf);
     }
 #else
@@ -48,8 +48,8 @@
 STATIC void float_print(void (*print)(void *env, const char *fmt, ...), void *env, mp_obj_t o_in, mp_print_kind_t kind) {
     mp_obj_float_t *o = o_in;
 #if MICROPY_FLOAT_IMPL == MICROPY_FLOAT_IMPL_FLOAT
-    char buf[16];
-    format_float(o->value, buf, sizeof(buf), 'g', 7, '\0');
+    char buf[24];
+    format_float(o->value, buf, sizeof(buf), 'r', 0, '\0');
     print(env, "%s", buf);
     if (strchr(buf, '.') == NULL && strchr(buf, 'e') == NULL) {
         // Python floats always have decimal point
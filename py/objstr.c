@@ -27,6 +27,8 @@
 
 #include <stdbool.h>
 #include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
 #include <assert.h>
 
 #include "mpconfig.h"
@@ -292,6 +294,15 @@ mp_obj_t mp_obj_str_binary_op(mp_uint_t op, mp_obj_t lhs_in, mp_obj_t rhs_in) {
                 // add 2 strings or bytes
 
                 GET_STR_DATA_LEN(rhs_in, rhs_data, rhs_len);
+
+                // strings are immutable, so adding an empty one needs no copy;
+                // this saves the first copy when building with s = ''; s += x
+                if (lhs_len == 0) {
+                    return rhs_in;
+                } else if (rhs_len == 0) {
+                    return lhs_in;
+                }
+
                 mp_uint_t alloc_len = lhs_len + rhs_len;
 
                 /* code for making qstr
@@ -816,61 +827,128 @@ static mp_obj_t arg_as_int(mp_obj_t arg) {
     return arg;
 }
 
-mp_obj_t mp_obj_str_format(mp_uint_t n_args, const mp_obj_t *args) {
-    assert(MP_OBJ_IS_STR(args[0]));
+// str.format works in two steps: the template is first compiled into a list
+// of fields, each holding the literal text that precedes it and its parsed
+// replacement field, and then the fields are rendered against the arguments.
+// Compiled templates for interned (qstr) format strings are kept in a small
+// cache so that hot templates, eg those used for logging, are parsed once.
+
+#define STR_FORMAT_NO_ARG (-1)
+#define STR_FORMAT_MAX_FIELDS (8)
+
+typedef struct _str_format_field_t {
+    const byte *lit;        // literal text written before the field
+    uint16_t lit_len;
+    int16_t arg;            // argument index, or STR_FORMAT_NO_ARG for literal only
+    int16_t width;
+    int16_t precision;
+    uint16_t flags;
+    char conversion;
+    char fill;
+    char align;
+    char sign;
+    char type;
+    bool has_spec;
+} str_format_field_t;
+
+#if MICROPY_PY_STR_FORMAT_CACHE
+typedef struct _str_format_cache_t {
+    qstr q;
+    mp_uint_t n_fields;
+    str_format_field_t fields[STR_FORMAT_MAX_FIELDS];
+} str_format_cache_t;
+
+// the literal pointers point into qstr data, so this must be cleared
+// whenever the qstr pool is reset
+STATIC str_format_cache_t str_format_cache[MICROPY_PY_STR_FORMAT_CACHE];
+STATIC mp_uint_t str_format_cache_next;
+
+void mp_obj_str_format_cache_clear(void) {
+    memset(str_format_cache, 0, sizeof(str_format_cache));
+    str_format_cache_next = 0;
+}
+#endif
 
-    GET_STR_DATA_LEN(args[0], str, len);
+STATIC void str_format_add_field(str_format_field_t *fields, mp_uint_t max_fields, mp_uint_t *n_fields, const str_format_field_t *field) {
+    if (*n_fields < max_fields) {
+        fields[*n_fields] = *field;
+    }
+    *n_fields += 1;
+}
+
+STATIC void str_format_add_lit(str_format_field_t *fields, mp_uint_t max_fields, mp_uint_t *n_fields, const byte *lit, mp_uint_t lit_len) {
+    str_format_field_t field = {0};
+    field.lit = lit;
+    field.lit_len = lit_len;
+    field.arg = STR_FORMAT_NO_ARG;
+    str_format_add_field(fields, max_fields, n_fields, &field);
+}
+
+// Compile the format string into at most max_fields fields.  Returns the
+// number of fields needed, which may be more than max_fields, in which case
+// the caller should call again with a larger array.
+STATIC mp_uint_t str_format_compile(const byte *str, mp_uint_t len, str_format_field_t *fields, mp_uint_t max_fields) {
+    const byte *top = str + len;
+    const byte *lit = str;
+    mp_uint_t n_fields = 0;
     int arg_i = 0;
-    vstr_t *vstr = vstr_new();
-    pfenv_t pfenv_vstr;
-    pfenv_vstr.data = vstr;
-    pfenv_vstr.print_strn = pfenv_vstr_add_strn;
 
-    for (const byte *top = str + len; str < top; str++) {
+    for (;;) {
+        while (str < top && *str != '{' && *str != '}' && str - lit < 0xffff) {
+            str++;
+        }
+        if (str >= top || str - lit == 0xffff) {
+            if (str > lit) {
+                str_format_add_lit(fields, max_fields, &n_fields, lit, str - lit);
+            }
+            if (str >= top) {
+                break;
+            }
+            lit = str;
+            continue;
+        }
         if (*str == '}') {
             str++;
             if (str < top && *str == '}') {
-                vstr_add_char(vstr, '}');
+                // the literal includes the first '}' of the pair
+                str_format_add_lit(fields, max_fields, &n_fields, lit, str - lit);
+                lit = ++str;
                 continue;
             }
             nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "single '}' encountered in format string"));
         }
-        if (*str != '{') {
-            vstr_add_char(vstr, *str);
-            continue;
-        }
+
+        str_format_field_t field = {0};
+        field.lit = lit;
+        field.lit_len = str - lit;
 
         str++;
         if (str < top && *str == '{') {
-            vstr_add_char(vstr, '{');
+            str_format_add_lit(fields, max_fields, &n_fields, lit, str - lit);
+            lit = ++str;
             continue;
         }
 
         // replacement_field ::=  "{" [field_name] ["!" conversion] [":" format_spec] "}"
 
-        vstr_t *field_name = NULL;
-        char conversion = '\0';
-        vstr_t *format_spec = NULL;
-
-        if (str < top && *str != '}' && *str != '!' && *str != ':') {
-            field_name = vstr_new();
-            while (str < top && *str != '}' && *str != '!' && *str != ':') {
-                vstr_add_char(field_name, *str++);
-            }
-            vstr_add_char(field_name, '\0');
+        const byte *field_name = str;
+        while (str < top && *str != '}' && *str != '!' && *str != ':') {
+            str++;
         }
+        mp_uint_t field_name_len = str - field_name;
 
         // conversion ::=  "r" | "s"
 
         if (str < top && *str == '!') {
             str++;
             if (str < top && (*str == 'r' || *str == 's')) {
-                conversion = *str++;
+                field.conversion = *str++;
             } else {
                 nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "end of format while looking for conversion specifier"));
             }
         }
 
+        const byte *spec = NULL;
         if (str < top && *str == ':') {
             str++;
             // {:} is the same as {}, which is the same as {!s}
@@ -879,11 +957,10 @@ mp_obj_t mp_obj_str_format(mp_uint_t n_args, const mp_obj_t *args) {
             // '{:d}'.format(True) returns '1'
             // So we treat {:} as {} and this later gets treated to be {!s}
             if (*str != '}') {
-                format_spec = vstr_new();
+                spec = str;
                 while (str < top && *str != '}') {
-                    vstr_add_char(format_spec, *str++);
+                    str++;
                 }
-                vstr_add_char(format_spec, '\0');
             }
         }
         if (str >= top) {
@@ -893,60 +970,33 @@ mp_obj_t mp_obj_str_format(mp_uint_t n_args, const mp_obj_t *args) {
             nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "expected ':' after format specifier"));
         }
 
-        mp_obj_t arg = mp_const_none;
-
-        if (field_name) {
+        if (field_name_len > 0) {
             if (arg_i > 0) {
                 nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "can't switch from automatic field numbering to manual field specification"));
             }
             int index = 0;
-            if (str_to_int(vstr_str(field_name), &index) != vstr_len(field_name) - 1) {
+            if (str_to_int((const char*)field_name, &index) != field_name_len) {
                 nlr_raise(mp_obj_new_exception_msg(&mp_type_KeyError, "attributes not supported yet"));
             }
-            if (index >= n_args - 1) {
+            if (index > 0x7fff) {
                 nlr_raise(mp_obj_new_exception_msg(&mp_type_IndexError, "tuple index out of range"));
             }
-            arg = args[index + 1];
+            field.arg = index;
             arg_i = -1;
-            vstr_free(field_name);
-            field_name = NULL;
         } else {
             if (arg_i < 0) {
                 nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "can't switch from manual field specification to automatic field numbering"));
             }
-            if (arg_i >= n_args - 1) {
+            if (arg_i > 0x7fff) {
                 nlr_raise(mp_obj_new_exception_msg(&mp_type_IndexError, "tuple index out of range"));
             }
-            arg = args[arg_i + 1];
-            arg_i++;
-        }
-        if (!format_spec && !conversion) {
-            conversion = 's';
-        }
-        if (conversion) {
-            mp_print_kind_t print_kind;
-            if (conversion == 's') {
-                print_kind = PRINT_STR;
-            } else if (conversion == 'r') {
-                print_kind = PRINT_REPR;
-            } else {
-                nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "unknown conversion specifier %c", conversion));
-            }
-            vstr_t *arg_vstr = vstr_new();
-            mp_obj_print_helper((void (*)(void*, const char*, ...))vstr_printf, arg_vstr, arg, print_kind);
-            arg = mp_obj_new_str(vstr_str(arg_vstr), vstr_len(arg_vstr), false);
-            vstr_free(arg_vstr);
+            field.arg = arg_i++;
         }
 
-        char sign = '\0';
-        char fill = '\0';
-        char align = '\0';
         int width = -1;
         int precision = -1;
-        char type = '\0';
-        int flags = 0;
 
-        if (format_spec) {
+        if (spec) {
             // The format specifier (from http://docs.python.org/2/library/string.html#formatspec)
             //
             // [[fill]align][sign][#][0][width][,][.precision][type]
@@ -957,12 +1007,16 @@ mp_obj_t mp_obj_str_format(mp_uint_t n_args, const mp_obj_t *args) {
             // precision   ::=  integer
             // type        ::=  "b" | "c" | "d" | "e" | "E" | "f" | "F" | "g" | "G" | "n" | "o" | "s" | "x" | "X" | "%"
 
-            const char *s = vstr_str(format_spec);
+            // the spec ends at the closing '}', which is never a valid spec
+            // character, so it can be scanned like a null terminated string
+            const char *s = (const char*)spec;
+            int flags = 0;
+            field.has_spec = true;
             if (isalignment(*s)) {
-                align = *s++;
-            } else if (*s && isalignment(s[1])) {
-                fill = *s++;
-                align = *s++;
+                field.align = *s++;
+            } else if (*s != '}' && isalignment(s[1])) {
+                field.fill = *s++;
+                field.align = *s++;
             }
             if (*s == '+' || *s == '-' || *s == ' ') {
                 if (*s == '+') {
@@ -970,18 +1024,18 @@ mp_obj_t mp_obj_str_format(mp_uint_t n_args, const mp_obj_t *args) {
                 } else if (*s == ' ') {
                     flags |= PF_FLAG_SPACE_SIGN;
                 }
-                sign = *s++;
+                field.sign = *s++;
             }
             if (*s == '#') {
                 flags |= PF_FLAG_SHOW_PREFIX;
                 s++;
             }
             if (*s == '0') {
-                if (!align) {
-                    align = '=';
+                if (!field.align) {
+                    field.align = '=';
                 }
-                if (!fill) {
-                    fill = '0';
+                if (!field.fill) {
+                    field.fill = '0';
                 }
             }
             s += str_to_int(s, &width);
@@ -994,187 +1048,378 @@ mp_obj_t mp_obj_str_format(mp_uint_t n_args, const mp_obj_t *args) {
                 s += str_to_int(s, &precision);
             }
             if (istype(*s)) {
-                type = *s++;
+                field.type = *s++;
             }
-            if (*s) {
+            if (*s != '}') {
                 nlr_raise(mp_obj_new_exception_msg(&mp_type_KeyError, "Invalid conversion specification"));
             }
-            vstr_free(format_spec);
-            format_spec = NULL;
-        }
-        if (!align) {
-            if (arg_looks_numeric(arg)) {
-                align = '>';
-            } else {
-                align = '<';
+            if (width > 0x7fff || precision > 0x7fff) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "format width too large"));
             }
+            field.flags = flags;
         }
-        if (!fill) {
-            fill = ' ';
-        }
+        field.width = width;
+        field.precision = precision;
 
-        if (sign) {
-            if (type == 's') {
+        if (field.sign) {
+            if (field.type == 's') {
                 nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Sign not allowed in string format specifier"));
             }
-            if (type == 'c') {
+            if (field.type == 'c') {
                 nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Sign not allowed with integer format specifier 'c'"));
             }
         } else {
-            sign = '-';
+            field.sign = '-';
+        }
+        if (!field.has_spec && !field.conversion) {
+            field.conversion = 's';
+        }
+
+        str_format_add_field(fields, max_fields, &n_fields, &field);
+        lit = ++str;
+    }
+
+    return n_fields;
+}
+
+// The rendered fields are written to a scratch buffer that starts on the C
+// stack and only moves to the heap if the fields don't fit.
+STATIC void str_format_scratch_spill(vstr_t *vstr, mp_uint_t len) {
+    if (vstr->fixed_buf && vstr->len + len + 1 > vstr->alloc) {
+        size_t alloc = (vstr->len + len + 1) * 2;
+        char *buf = m_new(char, alloc);
+        memcpy(buf, vstr->buf, vstr->len + 1);
+        vstr->buf = buf;
+        vstr->alloc = alloc;
+        vstr->fixed_buf = false;
+    }
+}
+
+STATIC void str_format_scratch_add_strn(void *data, const char *str, mp_uint_t len) {
+    str_format_scratch_spill(data, len);
+    vstr_add_strn(data, str, len);
+}
+
+STATIC void str_format_scratch_printf(void *data, const char *fmt, ...) {
+    // print into the space left in the buffer, and only if the output doesn't
+    // fit grow the buffer to the length vsnprintf asked for and print again
+    vstr_t *vstr = data;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(vstr->buf + vstr->len, vstr->alloc - vstr->len, fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        return;
+    }
+    if ((mp_uint_t)n >= vstr->alloc - vstr->len) {
+        str_format_scratch_spill(vstr, n);
+        vstr_hint_size(vstr, n);
+        va_start(ap, fmt);
+        n = vsnprintf(vstr->buf + vstr->len, vstr->alloc - vstr->len, fmt, ap);
+        va_end(ap);
+    }
+    vstr->len += n;
+}
+
+typedef struct _str_format_piece_t {
+    const byte *data;       // rendered text, or NULL if it's in the scratch buffer
+    mp_uint_t off;
+    mp_uint_t len;
+} str_format_piece_t;
+
+// Render one field into the scratch buffer, or point piece at existing data
+// when the field is a plain str argument.
+STATIC void str_format_render_field(const str_format_field_t *field, mp_obj_t arg, const pfenv_t *pfenv_scratch, str_format_piece_t *piece) {
+    vstr_t *scratch = pfenv_scratch->data;
+    mp_print_kind_t print_kind = field->conversion == 'r' ? PRINT_REPR : PRINT_STR;
+
+    if (field->conversion) {
+        if (field->conversion == 's' && MP_OBJ_IS_STR(arg)) {
+            // str of a str is itself
+        } else if (!field->has_spec && MP_OBJ_IS_INT(arg)) {
+            // str and repr of an int are the same, and need no printf
+            pfenv_print_mp_int(pfenv_scratch, arg, 1, 10, 'a', 0, ' ', 0, 0);
+            return;
+        } else if (!field->has_spec) {
+            mp_obj_print_helper(str_format_scratch_printf, scratch, arg, print_kind);
+            return;
+        } else {
+            vstr_t *arg_vstr = vstr_new();
+            mp_obj_print_helper((void (*)(void*, const char*, ...))vstr_printf, arg_vstr, arg, print_kind);
+            arg = mp_obj_new_str(vstr_str(arg_vstr), vstr_len(arg_vstr), false);
+            vstr_free(arg_vstr);
+        }
+        if (!field->has_spec) {
+            GET_STR_DATA_LEN(arg, data, len);
+            piece->data = data;
+            piece->len = len;
+            return;
         }
+    }
 
-        switch (align) {
-            case '<': flags |= PF_FLAG_LEFT_ADJUST;     break;
-            case '=': flags |= PF_FLAG_PAD_AFTER_SIGN;  break;
-            case '^': flags |= PF_FLAG_CENTER_ADJUST;   break;
+    char fill = field->fill;
+    char align = field->align;
+    int width = field->width;
+    int precision = field->precision;
+    char type = field->type;
+    int flags = field->flags;
+
+    if (!align) {
+        if (arg_looks_numeric(arg)) {
+            align = '>';
+        } else {
+            align = '<';
         }
+    }
+    if (!fill) {
+        fill = ' ';
+    }
 
-        if (arg_looks_integer(arg)) {
-            switch (type) {
-                case 'b':
-                    pfenv_print_mp_int(&pfenv_vstr, arg, 1, 2, 'a', flags, fill, width, 0);
-                    continue;
+    switch (align) {
+        case '<': flags |= PF_FLAG_LEFT_ADJUST;     break;
+        case '=': flags |= PF_FLAG_PAD_AFTER_SIGN;  break;
+        case '^': flags |= PF_FLAG_CENTER_ADJUST;   break;
+    }
 
-                case 'c':
-                {
-                    char ch = mp_obj_get_int(arg);
-                    pfenv_print_strn(&pfenv_vstr, &ch, 1, flags, fill, width);
-                    continue;
+    if (arg_looks_integer(arg)) {
+        switch (type) {
+            case 'b':
+                pfenv_print_mp_int(pfenv_scratch, arg, 1, 2, 'a', flags, fill, width, 0);
+                return;
+
+            case 'c':
+            {
+                char ch = mp_obj_get_int(arg);
+                pfenv_print_strn(pfenv_scratch, &ch, 1, flags, fill, width);
+                return;
+            }
+
+            case '\0':  // No explicit format type implies 'd'
+            case 'n':   // I don't think we support locales in uPy so use 'd'
+            case 'd':
+                pfenv_print_mp_int(pfenv_scratch, arg, 1, 10, 'a', flags, fill, width, 0);
+                return;
+
+            case 'o':
+                if (flags & PF_FLAG_SHOW_PREFIX) {
+                    flags |= PF_FLAG_SHOW_OCTAL_LETTER;
                 }
 
-                case '\0':  // No explicit format type implies 'd'
-                case 'n':   // I don't think we support locales in uPy so use 'd'
-                case 'd':
-                    pfenv_print_mp_int(&pfenv_vstr, arg, 1, 10, 'a', flags, fill, width, 0);
-                    continue;
+                pfenv_print_mp_int(pfenv_scratch, arg, 1, 8, 'a', flags, fill, width, 0);
+                return;
 
-                case 'o':
-                    if (flags & PF_FLAG_SHOW_PREFIX) {
-                        flags |= PF_FLAG_SHOW_OCTAL_LETTER;
-                    }
+            case 'X':
+            case 'x':
+                pfenv_print_mp_int(pfenv_scratch, arg, 1, 16, type - ('X' - 'A'), flags, fill, width, 0);
+                return;
 
-                    pfenv_print_mp_int(&pfenv_vstr, arg, 1, 8, 'a', flags, fill, width, 0);
-                    continue;
-
-                case 'X':
-                case 'x':
-                    pfenv_print_mp_int(&pfenv_vstr, arg, 1, 16, type - ('X' - 'A'), flags, fill, width, 0);
-                    continue;
-
-                case 'e':
-                case 'E':
-                case 'f':
-                case 'F':
-                case 'g':
-                case 'G':
-                case '%':
-                    // The floating point formatters all work with anything that
-                    // looks like an integer
-                    break;
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            case '%':
+                // The floating point formatters all work with anything that
+                // looks like an integer
+                break;
 
-                default:
-                    nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError,
-                        "unknown format code '%c' for object of type '%s'", type, mp_obj_get_type_str(arg)));
-            }
+            default:
+                nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError,
+                    "unknown format code '%c' for object of type '%s'", type, mp_obj_get_type_str(arg)));
         }
+    }
 
-        // NOTE: no else here. We need the e, f, g etc formats for integer
-        //       arguments (from above if) to take this if.
-        if (arg_looks_numeric(arg)) {
-            if (!type) {
-
-                // Even though the docs say that an unspecified type is the same
-                // as 'g', there is one subtle difference, when the exponent
-                // is one less than the precision.
-                //
-                // '{:10.1}'.format(0.0) ==> '0e+00'
-                // '{:10.1g}'.format(0.0) ==> '0'
-                //
-                // TODO: Figure out how to deal with this.
-                //
-                // A proper solution would involve adding a special flag
-                // or something to format_float, and create a format_double
-                // to deal with doubles. In order to fix this when using
-                // sprintf, we'd need to use the e format and tweak the
-                // returned result to strip trailing zeros like the g format
-                // does.
-                //
-                // {:10.3} and {:10.2e} with 1.23e2 both produce 1.23e+02
-                // but with 1.e2 you get 1e+02 and 1.00e+02
-                //
-                // Stripping the trailing 0's (like g) does would make the
-                // e format give us the right format.
-                //
-                // CPython sources say:
-                //   Omitted type specifier.  Behaves in the same way as repr(x)
-                //   and str(x) if no precision is given, else like 'g', but with
-                //   at least one digit after the decimal point. */
-
-                type = 'g';
-            }
-            if (type == 'n') {
-                type = 'g';
-            }
+    // NOTE: no else here. We need the e, f, g etc formats for integer
+    //       arguments (from above if) to take this if.
+    if (arg_looks_numeric(arg)) {
+        if (!type) {
+
+            // Even though the docs say that an unspecified type is the same
+            // as 'g', there is one subtle difference, when the exponent
+            // is one less than the precision.
+            //
+            // '{:10.1}'.format(0.0) ==> '0e+00'
+            // '{:10.1g}'.format(0.0) ==> '0'
+            //
+            // TODO: Figure out how to deal with this.
+            //
+            // A proper solution would involve adding a special flag
+            // or something to format_float, and create a format_double
+            // to deal with doubles. In order to fix this when using
+            // sprintf, we'd need to use the e format and tweak the
+            // returned result to strip trailing zeros like the g format
+            // does.
+            //
+            // {:10.3} and {:10.2e} with 1.23e2 both produce 1.23e+02
+            // but with 1.e2 you get 1e+02 and 1.00e+02
+            //
+            // Stripping the trailing 0's (like g) does would make the
+            // e format give us the right format.
+            //
+            // CPython sources say:
+            //   Omitted type specifier.  Behaves in the same way as repr(x)
+            //   and str(x) if no precision is given, else like 'g', but with
+            //   at least one digit after the decimal point. */
+
+            type = 'g';
+        }
+        if (type == 'n') {
+            type = 'g';
+        }
 
-            flags |= PF_FLAG_PAD_NAN_INF; // '{:06e}'.format(float('-inf')) should give '-00inf'
-            switch (type) {
+        flags |= PF_FLAG_PAD_NAN_INF; // '{:06e}'.format(float('-inf')) should give '-00inf'
+        switch (type) {
 #if MICROPY_PY_BUILTINS_FLOAT
-                case 'e':
-                case 'E':
-                case 'f':
-                case 'F':
-                case 'g':
-                case 'G':
-                    pfenv_print_float(&pfenv_vstr, mp_obj_get_float(arg), type, flags, fill, width, precision);
-                    break;
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+                pfenv_print_float(pfenv_scratch, mp_obj_get_float(arg), type, flags, fill, width, precision);
+                break;
 
-                case '%':
-                    flags |= PF_FLAG_ADD_PERCENT;
-                    pfenv_print_float(&pfenv_vstr, mp_obj_get_float(arg) * 100.0F, 'f', flags, fill, width, precision);
-                    break;
+            case '%':
+                flags |= PF_FLAG_ADD_PERCENT;
+                pfenv_print_float(pfenv_scratch, mp_obj_get_float(arg) * 100.0F, 'f', flags, fill, width, precision);
+                break;
 #endif
 
-                default:
-                    nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError,
-                        "unknown format code '%c' for object of type 'float'",
-                        type, mp_obj_get_type_str(arg)));
+            default:
+                nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError,
+                    "unknown format code '%c' for object of type 'float'",
+                    type, mp_obj_get_type_str(arg)));
+        }
+    } else {
+        // arg doesn't look like a number
+
+        if (align == '=') {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "'=' alignment not allowed in string format specifier"));
+        }
+
+        switch (type) {
+            case '\0':
+                mp_obj_print_helper(str_format_scratch_printf, scratch, arg, PRINT_STR);
+                break;
+
+            case 's': {
+                mp_uint_t len;
+                const char *s = mp_obj_str_get_data(arg, &len);
+                if (precision < 0) {
+                    precision = len;
+                }
+                if (len > precision) {
+                    len = precision;
+                }
+                pfenv_print_strn(pfenv_scratch, s, len, flags, fill, width);
+                break;
             }
-        } else {
-            // arg doesn't look like a number
 
-            if (align == '=') {
-                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "'=' alignment not allowed in string format specifier"));
+            default:
+                nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError,
+                    "unknown format code '%c' for object of type 'str'",
+                    type, mp_obj_get_type_str(arg)));
+        }
+    }
+}
+
+// Render the compiled fields against the arguments.  The length of the
+// result is known before it is built, so the only allocation in the common
+// case is the result itself.
+STATIC mp_obj_t str_format_render(const str_format_field_t *fields, mp_uint_t n_fields, mp_uint_t n_args, const mp_obj_t *args) {
+    str_format_piece_t pieces_buf[STR_FORMAT_MAX_FIELDS];
+    str_format_piece_t *pieces = pieces_buf;
+    if (n_fields > STR_FORMAT_MAX_FIELDS) {
+        pieces = m_new(str_format_piece_t, n_fields);
+    }
+
+    VSTR_FIXED(scratch, 64)
+    pfenv_t pfenv_scratch;
+    pfenv_scratch.data = &scratch;
+    pfenv_scratch.print_strn = str_format_scratch_add_strn;
+
+    mp_uint_t total_len = 0;
+    for (mp_uint_t i = 0; i < n_fields; i++) {
+        const str_format_field_t *field = &fields[i];
+        str_format_piece_t *piece = &pieces[i];
+        piece->data = NULL;
+        piece->off = scratch.len;
+        if (field->arg != STR_FORMAT_NO_ARG) {
+            if (field->arg >= n_args) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_IndexError, "tuple index out of range"));
             }
+            str_format_render_field(field, args[field->arg], &pfenv_scratch, piece);
+        }
+        if (piece->data == NULL) {
+            piece->len = scratch.len - piece->off;
+        }
+        total_len += field->lit_len + piece->len;
+    }
 
-            switch (type) {
-                case '\0':
-                    mp_obj_print_helper((void (*)(void*, const char*, ...))vstr_printf, vstr, arg, PRINT_STR);
-                    break;
+    byte *data;
+    mp_obj_t s = mp_obj_str_builder_start(&mp_type_str, total_len, &data);
+    for (mp_uint_t i = 0; i < n_fields; i++) {
+        memcpy(data, fields[i].lit, fields[i].lit_len);
+        data += fields[i].lit_len;
+        const byte *p = pieces[i].data;
+        if (p == NULL) {
+            p = (const byte*)scratch.buf + pieces[i].off;
+        }
+        memcpy(data, p, pieces[i].len);
+        data += pieces[i].len;
+    }
 
-                case 's': {
-                    mp_uint_t len;
-                    const char *s = mp_obj_str_get_data(arg, &len);
-                    if (precision < 0) {
-                        precision = len;
-                    }
-                    if (len > precision) {
-                        len = precision;
-                    }
-                    pfenv_print_strn(&pfenv_vstr, s, len, flags, fill, width);
-                    break;
-                }
+    vstr_clear(&scratch);
+    if (pieces != pieces_buf) {
+        m_del(str_format_piece_t, pieces, n_fields);
+    }
+    return mp_obj_str_builder_end(s);
+}
 
-                default:
-                    nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError,
-                        "unknown format code '%c' for object of type 'str'",
-                        type, mp_obj_get_type_str(arg)));
+mp_obj_t mp_obj_str_format(mp_uint_t n_args, const mp_obj_t *args) {
+    assert(MP_OBJ_IS_STR(args[0]));
+    str_format_field_t fields_buf[STR_FORMAT_MAX_FIELDS];
+
+#if MICROPY_PY_STR_FORMAT_CACHE
+    qstr q = MP_QSTR_NULL;
+    if (MP_OBJ_IS_QSTR(args[0])) {
+        q = MP_OBJ_QSTR_VALUE(args[0]);
+        for (mp_uint_t i = 0; i < MICROPY_PY_STR_FORMAT_CACHE; i++) {
+            if (str_format_cache[i].q == q) {
+                // render from a copy: the fields' __str__ and __format__ may
+                // call str.format themselves and replace this cache entry
+                mp_uint_t n_fields = str_format_cache[i].n_fields;
+                memcpy(fields_buf, str_format_cache[i].fields, n_fields * sizeof(str_format_field_t));
+                return str_format_render(fields_buf, n_fields, n_args - 1, args + 1);
             }
         }
     }
+#endif
 
-    mp_obj_t s = mp_obj_new_str(vstr->buf, vstr->len, false);
-    vstr_free(vstr);
+    GET_STR_DATA_LEN(args[0], str, len);
+    str_format_field_t *fields = fields_buf;
+    mp_uint_t n_fields = str_format_compile(str, len, fields, STR_FORMAT_MAX_FIELDS);
+    if (n_fields > STR_FORMAT_MAX_FIELDS) {
+        fields = m_new(str_format_field_t, n_fields);
+        str_format_compile(str, len, fields, n_fields);
+    }
+
+#if MICROPY_PY_STR_FORMAT_CACHE
+    if (q != MP_QSTR_NULL && n_fields <= STR_FORMAT_MAX_FIELDS) {
+        // replace entries round-robin
+        str_format_cache_t *c = &str_format_cache[str_format_cache_next];
+        str_format_cache_next = (str_format_cache_next + 1) % MICROPY_PY_STR_FORMAT_CACHE;
+        c->q = q;
+        c->n_fields = n_fields;
+        memcpy(c->fields, fields, n_fields * sizeof(str_format_field_t));
+    }
+#endif
+
+    mp_obj_t s = str_format_render(fields, n_fields, n_args - 1, args + 1);
+    if (fields != fields_buf) {
+        m_del(str_format_field_t, fields, n_fields);
+    }
     return s;
 }
 
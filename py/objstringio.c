@@ -34,6 +34,7 @@
 #include "qstr.h"
 #include "obj.h"
 #include "runtime.h"
+#include "runtime0.h"
 #include "stream.h"
 #include "objstr.h"
 
@@ -46,6 +47,12 @@ typedef struct _mp_obj_stringio_t {
     mp_uint_t pos;
 } mp_obj_stringio_t;
 
+STATIC void check_stringio_is_open(const mp_obj_stringio_t *o) {
+    if (o->vstr == NULL) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "I/O operation on closed file"));
+    }
+}
+
 STATIC void stringio_print(void (*print)(void *env, const char *fmt, ...), void *env, mp_obj_t self_in, mp_print_kind_t kind) {
     mp_obj_stringio_t *self = self_in;
     print(env, self->base.type == &mp_type_stringio ? "<io.StringIO 0x%x>" : "<io.BytesIO 0x%x>", self->vstr);
@@ -53,6 +60,7 @@ STATIC void stringio_print(void (*print)(void *env, const char *fmt, ...), void
 
 STATIC mp_uint_t stringio_read(mp_obj_t o_in, void *buf, mp_uint_t size, int *errcode) {
     mp_obj_stringio_t *o = o_in;
+    check_stringio_is_open(o);
     mp_uint_t remaining = o->vstr->len - o->pos;
     if (size > remaining) {
         size = remaining;
@@ -64,6 +72,7 @@ STATIC mp_uint_t stringio_read(mp_obj_t o_in, void *buf, mp_uint_t size, int *er
 
 STATIC mp_uint_t stringio_write(mp_obj_t o_in, const void *buf, mp_uint_t size, int *errcode) {
     mp_obj_stringio_t *o = o_in;
+    check_stringio_is_open(o);
     mp_uint_t remaining = o->vstr->alloc - o->pos;
     if (size > remaining) {
         // Take all what's already allocated...
@@ -83,10 +92,44 @@ STATIC mp_uint_t stringio_write(mp_obj_t o_in, const void *buf, mp_uint_t size,
 
 STATIC mp_obj_t stringio_getvalue(mp_obj_t self_in) {
     mp_obj_stringio_t *self = self_in;
+    check_stringio_is_open(self);
     return mp_obj_new_str_of_type(STREAM_TO_CONTENT_TYPE(self), (byte*)self->vstr->buf, self->vstr->len);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(stringio_getvalue_obj, stringio_getvalue);
 
+STATIC mp_obj_t stringio_unary_op(mp_uint_t op, mp_obj_t self_in) {
+    mp_obj_stringio_t *self = self_in;
+    switch (op) {
+        case MP_UNARY_OP_LEN:
+            check_stringio_is_open(self);
+            return MP_OBJ_NEW_SMALL_INT(self->vstr->len);
+        default: return MP_OBJ_NULL; // op not supported
+    }
+}
+
+// buf += data appends data and leaves the position at the end, so a StringIO
+// can be used in place of a str that is built up with +=.  The vstr grows
+// geometrically, so building a string from N pieces takes time linear in
+// its length and O(log N) allocations, instead of copying the whole string
+// on every step.
+STATIC mp_obj_t stringio_binary_op(mp_uint_t op, mp_obj_t lhs_in, mp_obj_t rhs_in) {
+    mp_obj_stringio_t *lhs = lhs_in;
+    if (op != MP_BINARY_OP_INPLACE_ADD) {
+        return MP_OBJ_NULL; // op not supported
+    }
+    if (lhs->base.type == &mp_type_stringio && !MP_OBJ_IS_STR(rhs_in)) {
+        return MP_OBJ_NULL; // op not supported
+    }
+    mp_buffer_info_t bufinfo;
+    if (!mp_get_buffer(rhs_in, &bufinfo, MP_BUFFER_READ)) {
+        return MP_OBJ_NULL; // op not supported
+    }
+    check_stringio_is_open(lhs);
+    lhs->pos = lhs->vstr->len;
+    stringio_write(lhs, bufinfo.buf, bufinfo.len, NULL);
+    return lhs;
+}
+
 STATIC mp_obj_t stringio_close(mp_obj_t self_in) {
     mp_obj_stringio_t *self = self_in;
     vstr_free(self->vstr);
@@ -150,6 +193,8 @@ const mp_obj_type_t mp_type_stringio = {
     .name = MP_QSTR_StringIO,
     .print = stringio_print,
     .make_new = stringio_make_new,
+    .unary_op = stringio_unary_op,
+    .binary_op = stringio_binary_op,
     .getiter = mp_identity,
     .iternext = mp_stream_unbuffered_iter,
     .stream_p = &stringio_stream_p,
@@ -162,6 +207,8 @@ const mp_obj_type_t mp_type_bytesio = {
     .name = MP_QSTR_BytesIO,
     .print = stringio_print,
     .make_new = stringio_make_new,
+    .unary_op = stringio_unary_op,
+    .binary_op = stringio_binary_op,
     .getiter = mp_identity,
     .iternext = mp_stream_unbuffered_iter,
     .stream_p = &bytesio_stream_p,
@@ -39,6 +39,9 @@
 
 #if MICROPY_PY_BUILTINS_FLOAT
 #include <math.h>
+#if MICROPY_FLOAT_IMPL == MICROPY_FLOAT_IMPL_FLOAT
+#include "formatfloat.h"
+#endif
 #endif
 
 mp_obj_t mp_parse_num_integer(const char *restrict str_, mp_uint_t len, mp_uint_t base) {
@@ -193,17 +196,40 @@ mp_obj_t mp_parse_num_decimal(const char *str, mp_uint_t len, bool allow_imag, b
         bool exp_neg = false;
         mp_int_t exp_val = 0;
         mp_int_t exp_extra = 0;
+#if MICROPY_FLOAT_IMPL == MICROPY_FLOAT_IMPL_FLOAT
+        // accumulate up to 19 significant digits exactly, and let
+        // float_from_decimal do a single correctly rounded conversion
+        uint64_t dec_mant = 0;
+        bool dec_truncated = false;
+#endif
         for (; str < top; str++) {
             mp_uint_t dig = *str;
             if ('0' <= dig && dig <= '9') {
                 dig -= '0';
                 if (in == PARSE_DEC_IN_EXP) {
-                    exp_val = 10 * exp_val + dig;
+                    if (exp_val < 10000) {
+                        exp_val = 10 * exp_val + dig;
+                    }
                 } else {
+#if MICROPY_FLOAT_IMPL == MICROPY_FLOAT_IMPL_FLOAT
+                    if (dec_mant < 1000000000000000000ULL) {
+                        dec_mant = 10 * dec_mant + dig;
+                        if (in == PARSE_DEC_IN_FRAC) {
+                            exp_extra -= 1;
+                        }
+                    } else {
+                        // digit doesn't fit, drop it but remember it for rounding
+                        dec_truncated |= dig != 0;
+                        if (in == PARSE_DEC_IN_INTG) {
+                            exp_extra += 1;
+                        }
+                    }
+#else
                     dec_val = 10 * dec_val + dig;
                     if (in == PARSE_DEC_IN_FRAC) {
                         exp_extra -= 1;
                     }
+#endif
                 }
             } else if (in == PARSE_DEC_IN_INTG && dig == '.') {
                 in = PARSE_DEC_IN_FRAC;
@@ -232,12 +258,16 @@ mp_obj_t mp_parse_num_decimal(const char *str, mp_uint_t len, bool allow_imag, b
         exp_val += exp_extra;
 
         // apply the exponent
+#if MICROPY_FLOAT_IMPL == MICROPY_FLOAT_IMPL_FLOAT
+        dec_val = float_from_decimal(dec_mant, exp_val, dec_truncated);
+#else
         for (; exp_val > 0; exp_val--) {
             dec_val *= 10;
         }
         for (; exp_val < 0; exp_val++) {
             dec_val *= 0.1;
         }
+#endif
     }
 
     // negate value if needed
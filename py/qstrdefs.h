@@ -404,7 +404,11 @@ Q(maxsize)
 #if MICROPY_PY_STRUCT
 Q(struct)
 Q(pack)
+Q(pack_into)
 Q(unpack)
+Q(unpack_from)
+Q(Struct)
+Q(size)
 #endif
 
 #if MICROPY_PY_UCTYPES
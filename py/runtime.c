@@ -37,6 +37,7 @@
 #include "objtuple.h"
 #include "objlist.h"
 #include "objmodule.h"
+#include "objstr.h"
 #include "parsenum.h"
 #include "runtime0.h"
 #include "runtime.h"
@@ -82,6 +83,11 @@ void mp_init(void) {
     qstr_init();
     mp_stack_ctrl_init();
 
+#if MICROPY_PY_STR_FORMAT_CACHE
+    // cached str.format templates refer to qstr data
+    mp_obj_str_format_cache_clear();
+#endif
+
     // no pending exceptions to start with
     mp_pending_exception = MP_OBJ_NULL;
 
@@ -372,6 +372,39 @@ STATIC mp_obj_t stream_unbuffered_readlines(mp_obj_t self) {
 }
 MP_DEFINE_CONST_FUN_OBJ_1(mp_stream_unbuffered_readlines_obj, stream_unbuffered_readlines);
 
+STATIC mp_obj_t stream_seek(mp_uint_t n_args, const mp_obj_t *args) {
+    struct _mp_obj_base_t *o = (struct _mp_obj_base_t *)args[0];
+    if (o->type->stream_p == NULL || o->type->stream_p->ioctl == NULL) {
+        // CPython: io.UnsupportedOperation, OSError subclass
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Operation not supported"));
+    }
+
+    struct mp_stream_seek_t seek_s;
+    seek_s.offset = mp_obj_get_int(args[1]);
+    seek_s.whence = 0;
+    if (n_args == 3) {
+        seek_s.whence = mp_obj_get_int(args[2]);
+    }
+    if (seek_s.whence < 0 || seek_s.whence > 2) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "invalid whence"));
+    }
+
+    int error;
+    mp_uint_t res = o->type->stream_p->ioctl(o, MP_STREAM_SEEK, &error, &seek_s);
+    if (res == MP_STREAM_ERROR) {
+        nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(error)));
+    }
+
+    return mp_obj_new_int_from_uint(seek_s.offset);
+}
+
+STATIC mp_obj_t stream_tell(mp_obj_t self) {
+    mp_obj_t offset = MP_OBJ_NEW_SMALL_INT(0);
+    mp_obj_t whence = MP_OBJ_NEW_SMALL_INT(1); // SEEK_CUR
+    const mp_obj_t args[3] = {self, offset, whence};
+    return stream_seek(3, args);
+}
+
 mp_obj_t mp_stream_unbuffered_iter(mp_obj_t self) {
     mp_obj_t l_in = stream_unbuffered_readline(1, &self);
     if (mp_obj_is_true(l_in)) {
@@ -385,3 +418,5 @@ MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_stream_readinto_obj, 2, 3, stream_readint
 MP_DEFINE_CONST_FUN_OBJ_1(mp_stream_readall_obj, stream_readall);
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_stream_unbuffered_readline_obj, 1, 2, stream_unbuffered_readline);
 MP_DEFINE_CONST_FUN_OBJ_2(mp_stream_write_obj, stream_write_method);
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_stream_seek_obj, 2, 3, stream_seek);
+MP_DEFINE_CONST_FUN_OBJ_1(mp_stream_tell_obj, stream_tell);
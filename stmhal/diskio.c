@@ -118,10 +118,8 @@ DRESULT disk_read (
 {
     switch (pdrv) {
         case PD_FLASH:
-            for (int i = 0; i < count; i++) {
-                if (!storage_read_block(buff + i * FLASH_BLOCK_SIZE, sector + i)) {
-                    return RES_ERROR;
-                }
+            if (!storage_read_blocks(buff, sector, count)) {
+                return RES_ERROR;
             }
             return RES_OK;
 
@@ -151,10 +149,8 @@ DRESULT disk_write (
 {
     switch (pdrv) {
         case PD_FLASH:
-            for (int i = 0; i < count; i++) {
-                if (!storage_write_block(buff + i * FLASH_BLOCK_SIZE, sector + i)) {
-                    return RES_ERROR;
-                }
+            if (!storage_write_blocks(buff, sector, count)) {
+                return RES_ERROR;
             }
             return RES_OK;
 
@@ -25,6 +25,7 @@
  */
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <errno.h>
 
 #include "mpconfig.h"
@@ -36,6 +37,7 @@
 #include "stream.h"
 #include "file.h"
 #include "ff.h"
+#include "fscache.h"
 
 extern const mp_obj_type_t mp_type_fileio;
 extern const mp_obj_type_t mp_type_textio;
@@ -64,9 +66,25 @@ const byte fresult_to_errno_table[20] = {
     [FR_INVALID_PARAMETER] = EINVAL,
 };
 
+#if _USE_FASTSEEK
+// Initial and maximum size, in DWORDs, of the cluster link map table built for
+// read-only files.  A table of n DWORDs maps a file with up to (n - 1) / 2
+// fragments; more fragmented files fall back to walking the FAT.
+#ifndef MICROPY_FATFS_CLMT_SIZE
+#define MICROPY_FATFS_CLMT_SIZE (16)
+#endif
+#ifndef MICROPY_FATFS_CLMT_MAX
+#define MICROPY_FATFS_CLMT_MAX (128)
+#endif
+#endif
+
 typedef struct _pyb_file_obj_t {
     mp_obj_base_t base;
     FIL fp;
+    #if _USE_FASTSEEK
+    // fp.cltbl points here; kept in the object so the GC can see it
+    DWORD *clmt;
+    #endif
 } pyb_file_obj_t;
 
 void file_obj_print(void (*print)(void *env, const char *fmt, ...), void *env, mp_obj_t self_in, mp_print_kind_t kind) {
@@ -88,6 +106,7 @@ STATIC mp_uint_t file_obj_write(mp_obj_t self_in, const void *buf, mp_uint_t siz
     pyb_file_obj_t *self = self_in;
     UINT sz_out;
     FRESULT res = f_write(&self->fp, buf, size, &sz_out);
+    fscache_invalidate();
     if (res != FR_OK) {
         *errcode = fresult_to_errno_table[res];
         return MP_STREAM_ERROR;
@@ -97,6 +116,10 @@ STATIC mp_uint_t file_obj_write(mp_obj_t self_in, const void *buf, mp_uint_t siz
 
 STATIC mp_obj_t file_obj_flush(mp_obj_t self_in) {
     pyb_file_obj_t *self = self_in;
+    if (self->fp.flag & FA__WRITTEN) {
+        // syncing updates the size and date in the directory entry
+        fscache_invalidate();
+    }
     f_sync(&self->fp);
     return mp_const_none;
 }
@@ -104,7 +127,14 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(file_obj_flush_obj, file_obj_flush);
 
 mp_obj_t file_obj_close(mp_obj_t self_in) {
     pyb_file_obj_t *self = self_in;
+    if (self->fp.flag & FA__WRITTEN) {
+        fscache_invalidate();
+    }
     f_close(&self->fp);
+    #if _USE_FASTSEEK
+    self->fp.cltbl = NULL;
+    self->clmt = NULL;
+    #endif
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(file_obj_close_obj, file_obj_close);
@@ -114,51 +144,71 @@ mp_obj_t file_obj___exit__(mp_uint_t n_args, const mp_obj_t *args) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(file_obj___exit___obj, 4, 4, file_obj___exit__);
 
-mp_obj_t file_obj_seek(mp_uint_t n_args, const mp_obj_t *args) {
-    pyb_file_obj_t *self = args[0];
-    mp_int_t offset = mp_obj_get_int(args[1]);
-    mp_int_t whence = 0;
-    if (n_args == 3) {
-        whence = mp_obj_get_int(args[2]);
+STATIC mp_uint_t file_obj_ioctl(mp_obj_t self_in, mp_uint_t request, int *errcode, ...) {
+    pyb_file_obj_t *self = self_in;
+    va_list vargs;
+    va_start(vargs, errcode);
+    mp_uint_t ret = 0;
+    if (request == MP_STREAM_SEEK) {
+        struct mp_stream_seek_t *s = va_arg(vargs, struct mp_stream_seek_t*);
+        mp_int_t pos = s->offset;
+        switch (s->whence) {
+            case 1: // SEEK_CUR
+                pos += f_tell(&self->fp);
+                break;
+            case 2: // SEEK_END
+                pos += f_size(&self->fp);
+                break;
+        }
+        FRESULT res;
+        if (pos < 0) {
+            res = FR_INVALID_PARAMETER;
+        } else {
+            res = f_lseek(&self->fp, pos);
+        }
+        if (res != FR_OK) {
+            *errcode = fresult_to_errno_table[res];
+            ret = MP_STREAM_ERROR;
+        }
+        s->offset = f_tell(&self->fp);
+    } else {
+        *errcode = EINVAL;
+        ret = MP_STREAM_ERROR;
     }
+    va_end(vargs);
+    return ret;
+}
 
-    switch (whence) {
-        case 0: // SEEK_SET
-            f_lseek(&self->fp, offset);
-            break;
-
-        case 1: // SEEK_CUR
-            if (offset != 0) {
-                goto error;
-            }
-            // no-operation
+#if _USE_FASTSEEK
+// Build the cluster link map table for a file that won't be written, so that
+// f_lseek and f_read find clusters without following the FAT chain.  The table
+// is an optimisation only: if it can't be made the file is used as normal.
+STATIC void file_obj_make_clmt(pyb_file_obj_t *self) {
+    mp_uint_t len = MICROPY_FATFS_CLMT_SIZE;
+    for (;;) {
+        DWORD *tbl = m_new_maybe(DWORD, len);
+        if (tbl == NULL) {
             break;
-
-        case 2: // SEEK_END
-            if (offset != 0) {
-                goto error;
-            }
-            f_lseek(&self->fp, f_size(&self->fp));
+        }
+        tbl[0] = len;
+        self->fp.cltbl = tbl;
+        FRESULT res = f_lseek(&self->fp, CREATE_LINKMAP);
+        if (res == FR_OK) {
+            self->clmt = tbl;
+            return;
+        }
+        // on FR_NOT_ENOUGH_CORE tbl[0] holds the length that is needed
+        mp_uint_t need = tbl[0];
+        self->fp.cltbl = NULL;
+        m_del(DWORD, tbl, len);
+        if (res != FR_NOT_ENOUGH_CORE || need > MICROPY_FATFS_CLMT_MAX) {
             break;
-
-        default:
-            goto error;
+        }
+        len = need;
     }
-
-    return mp_obj_new_int_from_uint(f_tell(&self->fp));
-
-error:
-    // A bad whence is a ValueError, while offset!=0 is an io.UnsupportedOperation.
-    // But the latter inherits ValueError (as well as IOError), so we just raise ValueError.
-    nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "invalid whence and/or offset"));
+    self->fp.cltbl = NULL;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(file_obj_seek_obj, 2, 3, file_obj_seek);
-
-mp_obj_t file_obj_tell(mp_obj_t self_in) {
-    pyb_file_obj_t *self = self_in;
-    return mp_obj_new_int_from_uint(f_tell(&self->fp));
-}
-STATIC MP_DEFINE_CONST_FUN_OBJ_1(file_obj_tell_obj, file_obj_tell);
+#endif
 
 // Note: encoding is ignored for now; it's also not a valid kwarg for CPython's FileIO,
 // but by adding it here we can use one single mp_arg_t array for open() and FileIO's constructor
@@ -203,9 +253,16 @@ STATIC mp_obj_t file_open(mp_obj_t type, mp_arg_val_t *args) {
 
     pyb_file_obj_t *o = m_new_obj_with_finaliser(pyb_file_obj_t);
     o->base.type = type;
+    #if _USE_FASTSEEK
+    o->clmt = NULL;
+    #endif
 
     const char *fname = mp_obj_str_get_str(args[0].u_obj);
     FRESULT res = f_open(&o->fp, fname, mode);
+    if ((mode & FA_WRITE) != 0) {
+        // the file may have been created or truncated
+        fscache_invalidate();
+    }
     if (res != FR_OK) {
         m_del_obj(pyb_file_obj_t, o);
         nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(fresult_to_errno_table[res])));
@@ -216,6 +273,13 @@ STATIC mp_obj_t file_open(mp_obj_t type, mp_arg_val_t *args) {
         f_lseek(&o->fp, f_size(&o->fp));
     }
 
+    #if _USE_FASTSEEK
+    // the link map can't follow the file growing, so only use it for reading
+    if ((mode & FA_WRITE) == 0) {
+        file_obj_make_clmt(o);
+    }
+    #endif
+
     return o;
 }
 
@@ -236,8 +300,8 @@ STATIC const mp_map_elem_t rawfile_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_write), (mp_obj_t)&mp_stream_write_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_flush), (mp_obj_t)&file_obj_flush_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_close), (mp_obj_t)&file_obj_close_obj },
-    { MP_OBJ_NEW_QSTR(MP_QSTR_seek), (mp_obj_t)&file_obj_seek_obj },
-    { MP_OBJ_NEW_QSTR(MP_QSTR_tell), (mp_obj_t)&file_obj_tell_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_seek), (mp_obj_t)&mp_stream_seek_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_tell), (mp_obj_t)&mp_stream_tell_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR___del__), (mp_obj_t)&file_obj_close_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR___enter__), (mp_obj_t)&mp_identity_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR___exit__), (mp_obj_t)&file_obj___exit___obj },
@@ -249,6 +313,7 @@ STATIC MP_DEFINE_CONST_DICT(rawfile_locals_dict, rawfile_locals_dict_table);
 STATIC const mp_stream_p_t fileio_stream_p = {
     .read = file_obj_read,
     .write = file_obj_write,
+    .ioctl = file_obj_ioctl,
 };
 
 const mp_obj_type_t mp_type_fileio = {
@@ -266,6 +331,7 @@ const mp_obj_type_t mp_type_fileio = {
 STATIC const mp_stream_p_t textio_stream_p = {
     .read = file_obj_read,
     .write = file_obj_write,
+    .ioctl = file_obj_ioctl,
     .is_text = true,
 };
 
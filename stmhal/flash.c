@@ -102,17 +102,15 @@ void flash_erase(uint32_t flash_dest, const uint32_t *src, uint32_t num_word32)
     }
 }
 
-/*
-// erase the sector using an interrupt
-void flash_erase_it(uint32_t flash_dest, const uint32_t *src, uint32_t num_word32) {
+// Start erasing the sector(s) and return.  The flash must already be
+// unlocked; completion is signalled by the flash end-of-operation interrupt,
+// with the flash left unlocked.  Returns the HAL status of starting it.
+HAL_StatusTypeDef flash_erase_it(uint32_t flash_dest, const uint32_t *src, uint32_t num_word32) {
     // check there is something to write
     if (num_word32 == 0) {
-        return;
+        return HAL_OK;
     }
 
-    // unlock
-    HAL_FLASH_Unlock();
-
     // Clear pending flags (if any)
     __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
                            FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR|FLASH_FLAG_PGSERR);
@@ -123,15 +121,13 @@ void flash_erase_it(uint32_t flash_dest, const uint32_t *src, uint32_t num_word3
     EraseInitStruct.VoltageRange = VOLTAGE_RANGE_3; // voltage range needs to be 2.7V to 3.6V
     EraseInitStruct.Sector = flash_get_sector_info(flash_dest, NULL, NULL);
     EraseInitStruct.NbSectors = flash_get_sector_info(flash_dest + 4 * num_word32 - 1, NULL, NULL) - EraseInitStruct.Sector + 1;
-    if (HAL_FLASHEx_Erase_IT(&EraseInitStruct) != HAL_OK) {
-        // error occurred during sector erase
-        HAL_FLASH_Lock(); // lock the flash
-        return;
-    }
+    return HAL_FLASHEx_Erase_IT(&EraseInitStruct);
 }
-*/
 
 void flash_write(uint32_t flash_dest, const uint32_t *src, uint32_t num_word32) {
+    // unlock, in case there was no erase before this write
+    HAL_FLASH_Unlock();
+
     // program the flash word by word
     for (int i = 0; i < num_word32; i++) {
         if (HAL_FLASH_Program(TYPEPROGRAM_WORD, flash_dest, *src) != HAL_OK) {
@@ -0,0 +1,248 @@
+/*
+ * This file is part of the Micro Python project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013, 2014 Damien P. George
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "flashlog.h"
+
+// Sector header: magic, sequence number, inverted sequence number.
+// Record: a word with the length in the low half and its inverse in the high
+// half, the data padded with 0xff to a whole number of words, then the CRC32
+// of the length word and the data.  The header goes in first and the CRC
+// last, so a record cut short by a reset fails its CRC, and is skipped, but
+// can still be stepped over.  The length word is in the CRC because four
+// bytes of 0xff have a CRC32 of 0xffffffff, so a 4 byte record cut short
+// after its length would otherwise read back as erased data with a good CRC.
+
+#define FLASHLOG_MAGIC (0x474f4c50) // "PLOG"
+#define SECTOR_HEADER_SIZE (12)
+#define RECORD_OVERHEAD (8)
+#define ERASED_WORD (0xffffffff)
+
+#define WORD_AT(addr) (*(const uint32_t*)(uintptr_t)(addr))
+
+#define RECORD_OK (0)
+#define RECORD_ERASED (1)           // free space; the sector ends here
+#define RECORD_BAD (2)              // damaged header; nothing after it can be found
+
+static const uint32_t crc32_table[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+};
+
+// the same CRC32 as zlib and binascii.crc32, a nibble at a time; crc is 0 to
+// start, or the CRC so far to carry on from
+static uint32_t flashlog_crc32(uint32_t crc, const uint8_t *data, uint32_t len) {
+    crc = ~crc;
+    for (; len > 0; len--) {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ crc32_table[crc & 15];
+        crc = (crc >> 4) ^ crc32_table[crc & 15];
+    }
+    return ~crc;
+}
+
+static uint32_t sector_addr(const flashlog_t *log, uint32_t sector) {
+    return log->base + sector * log->sector_size;
+}
+
+// returns the sequence number of the sector, or 0 if it has no valid header
+static uint32_t sector_seq(const flashlog_t *log, uint32_t sector) {
+    uint32_t addr = sector_addr(log, sector);
+    uint32_t seq = WORD_AT(addr + 4);
+    if (WORD_AT(addr) != FLASHLOG_MAGIC || WORD_AT(addr + 8) != ~seq || seq == 0 || seq == ERASED_WORD) {
+        return 0;
+    }
+    return seq;
+}
+
+static bool sector_is_erased(const flashlog_t *log, uint32_t sector) {
+    const uint32_t *p = (const uint32_t*)(uintptr_t)sector_addr(log, sector);
+    for (uint32_t i = 0; i < log->sector_size / 4; i++) {
+        if (p[i] != ERASED_WORD) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint32_t record_size(uint32_t len) {
+    return RECORD_OVERHEAD + ((len + 3) & ~3);
+}
+
+static int record_at(const flashlog_t *log, uint32_t sector, uint32_t off, uint32_t *len) {
+    if (off + RECORD_OVERHEAD > log->sector_size) {
+        return RECORD_BAD;
+    }
+    uint32_t hdr = WORD_AT(sector_addr(log, sector) + off);
+    if (hdr == ERASED_WORD) {
+        return RECORD_ERASED;
+    }
+    uint32_t l = hdr & 0xffff;
+    if ((hdr >> 16) != (~l & 0xffff) || off + record_size(l) > log->sector_size) {
+        return RECORD_BAD;
+    }
+    *len = l;
+    return RECORD_OK;
+}
+
+void flashlog_mount(flashlog_t *log) {
+    // the tail is the sector with the highest sequence number
+    log->tail = log->num_sectors - 1;
+    log->tail_seq = 0;
+    for (uint32_t s = 0; s < log->num_sectors; s++) {
+        uint32_t seq = sector_seq(log, s);
+        if (seq > log->tail_seq) {
+            log->tail = s;
+            log->tail_seq = seq;
+        }
+    }
+
+    // find the end of the records in it; with no tail, or when the records
+    // can't be followed to free space, the next append moves on a sector
+    log->write_off = log->sector_size;
+    if (log->tail_seq != 0) {
+        uint32_t off = SECTOR_HEADER_SIZE;
+        uint32_t len;
+        int res;
+        while ((res = record_at(log, log->tail, off, &len)) == RECORD_OK) {
+            off += record_size(len);
+        }
+        if (res == RECORD_ERASED) {
+            log->write_off = off;
+        }
+    }
+}
+
+// start a new tail in the next sector of the ring, which holds the oldest records
+static void flashlog_next_sector(flashlog_t *log) {
+    uint32_t s = (log->tail + 1) % log->num_sectors;
+    if (!sector_is_erased(log, s)) {
+        log->erase(sector_addr(log, s), log->sector_size);
+    }
+    uint32_t seq = log->tail_seq + 1;
+    uint32_t hdr[3] = {FLASHLOG_MAGIC, seq, ~seq};
+    log->program(sector_addr(log, s), hdr, 3);
+    log->tail = s;
+    log->tail_seq = seq;
+    log->write_off = SECTOR_HEADER_SIZE;
+}
+
+uint32_t flashlog_max_record_len(const flashlog_t *log) {
+    uint32_t max = log->sector_size - SECTOR_HEADER_SIZE - RECORD_OVERHEAD;
+    return max < 0xfffe ? max : 0xfffe;
+}
+
+int flashlog_append(flashlog_t *log, const void *data, uint32_t len) {
+    if (len > flashlog_max_record_len(log)) {
+        return FLASHLOG_TOO_BIG;
+    }
+    if (log->write_off + record_size(len) > log->sector_size) {
+        flashlog_next_sector(log);
+    }
+
+    uint32_t addr = sector_addr(log, log->tail) + log->write_off;
+    uint32_t buf[16];
+    const uint32_t buf_len = sizeof(buf) / sizeof(buf[0]);
+    buf[0] = len | ((~len & 0xffff) << 16);
+    uint32_t crc = flashlog_crc32(0, (const uint8_t*)buf, 4);
+    log->program(addr, buf, 1);
+    addr += 4;
+
+    // the data, through an aligned buffer
+    const uint8_t *src = data;
+    uint32_t n = len / 4;
+    while (n > 0) {
+        uint32_t k = n < buf_len ? n : buf_len;
+        memcpy(buf, src, 4 * k);
+        log->program(addr, buf, k);
+        addr += 4 * k;
+        src += 4 * k;
+        n -= k;
+    }
+    if (len & 3) {
+        buf[0] = ERASED_WORD;
+        memcpy(buf, src, len & 3);
+        log->program(addr, buf, 1);
+        addr += 4;
+    }
+
+    buf[0] = flashlog_crc32(crc, data, len);
+    log->program(addr, buf, 1);
+
+    log->write_off += record_size(len);
+    return FLASHLOG_OK;
+}
+
+void flashlog_clear(flashlog_t *log) {
+    for (uint32_t s = 0; s < log->num_sectors; s++) {
+        if (!sector_is_erased(log, s)) {
+            log->erase(sector_addr(log, s), log->sector_size);
+        }
+    }
+    // carry on round the ring from where we were, with the same numbering
+    log->write_off = log->sector_size;
+}
+
+void flashlog_iter_init(const flashlog_t *log, flashlog_iter_t *iter) {
+    // the first step takes us to the sector after the tail, the oldest one
+    iter->sector = log->tail;
+    iter->seq = 0;
+    iter->off = 0;
+    iter->left = log->num_sectors;
+}
+
+int flashlog_iter_next(const flashlog_t *log, flashlog_iter_t *iter, const uint8_t **data, uint32_t *len) {
+    for (;;) {
+        if (iter->seq != 0) {
+            if (sector_seq(log, iter->sector) != iter->seq) {
+                return FLASHLOG_LOST;
+            }
+            uint32_t l;
+            if (record_at(log, iter->sector, iter->off, &l) == RECORD_OK) {
+                const uint8_t *d = (const uint8_t*)(uintptr_t)(sector_addr(log, iter->sector) + iter->off + 4);
+                iter->off += record_size(l);
+                if (WORD_AT(d + ((l + 3) & ~3)) != flashlog_crc32(0, d - 4, 4 + l)) {
+                    // cut short by a reset, or damaged; skip it
+                    continue;
+                }
+                *data = d;
+                *len = l;
+                return FLASHLOG_OK;
+            }
+        }
+        // nothing (more) in this sector
+        if (iter->left == 0) {
+            return FLASHLOG_END;
+        }
+        iter->left -= 1;
+        iter->sector = (iter->sector + 1) % log->num_sectors;
+        iter->seq = sector_seq(log, iter->sector);
+        iter->off = SECTOR_HEADER_SIZE;
+    }
+}
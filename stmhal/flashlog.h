@@ -0,0 +1,68 @@
+/*
+ * This file is part of the Micro Python project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013, 2014 Damien P. George
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// An append-only store of variable length records, kept in a run of equal
+// sized flash sectors that are used as a ring.  Each sector starts with a
+// header holding its sequence number; records follow it back to back, each
+// with its length and a CRC32 of its data.  When the sector being appended
+// to is full the next sector in the ring is erased, dropping the oldest
+// records, so all the sectors wear at the same rate.
+//
+// Flash is read through the memory map, and written only through the erase
+// and program hooks, so the same code runs on a RAM stand-in.
+
+typedef struct _flashlog_t {
+    // set up by the user of the log
+    uint32_t base;              // address of the first sector
+    uint32_t sector_size;
+    uint32_t num_sectors;
+    void (*erase)(uint32_t addr, uint32_t len);
+    void (*program)(uint32_t addr, const uint32_t *src, uint32_t num_word32);
+
+    // set by flashlog_mount
+    uint32_t tail;              // sector being appended to
+    uint32_t tail_seq;          // its sequence number; 0 if the log is empty
+    uint32_t write_off;         // where the next record goes in the tail sector
+} flashlog_t;
+
+typedef struct _flashlog_iter_t {
+    uint32_t sector;
+    uint32_t seq;               // sequence number the sector had when we got to it
+    uint32_t off;
+    uint32_t left;              // sectors still to visit after this one
+} flashlog_iter_t;
+
+#define FLASHLOG_OK (0)
+#define FLASHLOG_TOO_BIG (1)    // record doesn't fit in a sector
+#define FLASHLOG_END (2)        // no more records
+#define FLASHLOG_LOST (3)       // the sector being read was reused for new records
+
+void flashlog_mount(flashlog_t *log);
+int flashlog_append(flashlog_t *log, const void *data, uint32_t len);
+void flashlog_clear(flashlog_t *log);
+uint32_t flashlog_max_record_len(const flashlog_t *log);
+void flashlog_iter_init(const flashlog_t *log, flashlog_iter_t *iter);
+int flashlog_iter_next(const flashlog_t *log, flashlog_iter_t *iter, const uint8_t **data, uint32_t *len);
@@ -0,0 +1,117 @@
+/*
+ * This file is part of the Micro Python project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013, 2014 Damien P. George
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mpconfig.h"
+#include "misc.h"
+#include "qstr.h"
+#include "ff.h"
+#include "fscache.h"
+
+#ifndef MICROPY_FSCACHE_ENTRIES
+#define MICROPY_FSCACHE_ENTRIES (16)
+#endif
+
+// longer paths are looked up every time
+#ifndef MICROPY_FSCACHE_PATH_MAX
+#define MICROPY_FSCACHE_PATH_MAX (48)
+#endif
+
+typedef struct _fscache_entry_t {
+    uint32_t gen;       // entry is valid while this equals fscache_gen
+    uint16_t hash;
+    uint8_t len;
+    uint8_t fattrib;
+    FRESULT res;        // FR_OK, FR_NO_FILE or FR_NO_PATH
+    DWORD fsize;
+    WORD fdate;
+    WORD ftime;
+    char path[MICROPY_FSCACHE_PATH_MAX];
+} fscache_entry_t;
+
+STATIC fscache_entry_t fscache_table[MICROPY_FSCACHE_ENTRIES];
+STATIC uint32_t fscache_next;
+
+// Bumping the generation drops every entry at once.  It starts at 1 so that
+// the zeroed table is empty, and a single store makes this safe to call from
+// interrupts (eg the USB MSC write handler).
+STATIC volatile uint32_t fscache_gen = 1;
+
+void fscache_invalidate(void) {
+    fscache_gen += 1;
+}
+
+FRESULT fscache_stat(const char *path, FILINFO *fno) {
+    mp_uint_t len = strlen(path);
+    if (len > MICROPY_FSCACHE_PATH_MAX) {
+        return f_stat(path, fno);
+    }
+    uint16_t hash = qstr_compute_hash((const byte*)path, len);
+    uint32_t gen = fscache_gen;
+
+    for (mp_uint_t i = 0; i < MICROPY_FSCACHE_ENTRIES; i++) {
+        fscache_entry_t *e = &fscache_table[i];
+        if (e->gen == gen && e->hash == hash && e->len == len && memcmp(e->path, path, len) == 0) {
+            if (e->res == FR_OK) {
+                fno->fsize = e->fsize;
+                fno->fdate = e->fdate;
+                fno->ftime = e->ftime;
+                fno->fattrib = e->fattrib;
+                #if _USE_LFN
+                if (fno->lfname != NULL && fno->lfsize > 0) {
+                    fno->lfname[0] = '\0';
+                }
+                #endif
+            }
+            return e->res;
+        }
+    }
+
+    FRESULT res = f_stat(path, fno);
+    if (res != FR_OK && res != FR_NO_FILE && res != FR_NO_PATH) {
+        // don't remember disk errors
+        return res;
+    }
+
+    // if the cache was invalidated during the lookup this entry is already
+    // stale, which the generation it's stored with takes care of
+    fscache_entry_t *e = &fscache_table[fscache_next];
+    fscache_next = (fscache_next + 1) % MICROPY_FSCACHE_ENTRIES;
+    e->gen = gen;
+    e->hash = hash;
+    e->len = len;
+    e->res = res;
+    if (res == FR_OK) {
+        e->fsize = fno->fsize;
+        e->fdate = fno->fdate;
+        e->ftime = fno->ftime;
+        e->fattrib = fno->fattrib;
+    }
+    memcpy(e->path, path, len);
+    return res;
+}
@@ -32,6 +32,7 @@
 #include "qstr.h"
 #include "lexer.h"
 #include "ff.h"
+#include "fscache.h"
 
 mp_import_stat_t mp_import_stat(const char *path) {
     FILINFO fno;
@@ -39,7 +40,7 @@ mp_import_stat_t mp_import_stat(const char *path) {
     fno.lfname = NULL;
     fno.lfsize = 0;
 #endif
-    FRESULT res = f_stat(path, &fno);
+    FRESULT res = fscache_stat(path, &fno);
     if (res == FR_OK) {
         if ((fno.fattrib & AM_DIR) != 0) {
             return MP_IMPORT_STAT_DIR;
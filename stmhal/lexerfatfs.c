@@ -36,26 +36,16 @@
 
 typedef struct _mp_lexer_file_buf_t {
     FIL fp;
-    byte buf[20];
-    uint16_t len;
-    uint16_t pos;
+    byte buf[MICROPY_ALLOC_LEXER_FILE_BUF];
 } mp_lexer_file_buf_t;
 
-STATIC mp_uint_t file_buf_next_byte(mp_lexer_file_buf_t *fb) {
-    if (fb->pos >= fb->len) {
-        if (fb->len < sizeof(fb->buf)) {
-            return MP_LEXER_EOF;
-        } else {
-            UINT n;
-            f_read(&fb->fp, fb->buf, sizeof(fb->buf), &n);
-            if (n == 0) {
-                return MP_LEXER_EOF;
-            }
-            fb->len = n;
-            fb->pos = 0;
-        }
+STATIC mp_uint_t file_buf_next_chunk(mp_lexer_file_buf_t *fb, const byte **buf) {
+    UINT n;
+    if (f_read(&fb->fp, fb->buf, sizeof(fb->buf), &n) != FR_OK) {
+        return 0;
     }
-    return fb->buf[fb->pos++];
+    *buf = fb->buf;
+    return n;
 }
 
 STATIC void file_buf_close(mp_lexer_file_buf_t *fb) {
@@ -73,9 +63,5 @@ mp_lexer_t *mp_lexer_new_from_file(const char *filename) {
         m_del_obj(mp_lexer_file_buf_t, fb);
         return NULL;
     }
-    UINT n;
-    f_read(&fb->fp, fb->buf, sizeof(fb->buf), &n);
-    fb->len = n;
-    fb->pos = 0;
-    return mp_lexer_new(qstr_from_str(filename), fb, (mp_lexer_stream_next_byte_t)file_buf_next_byte, (mp_lexer_stream_close_t)file_buf_close);
+    return mp_lexer_new(qstr_from_str(filename), fb, (mp_lexer_stream_next_chunk_t)file_buf_next_chunk, (mp_lexer_stream_close_t)file_buf_close);
 }
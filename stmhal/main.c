@@ -58,6 +58,7 @@
 #include "storage.h"
 #include "sdcard.h"
 #include "ff.h"
+#include "fscache.h"
 #include "rng.h"
 #include "accel.h"
 #include "servo.h"
@@ -448,6 +449,9 @@ soft_reset:
     }
 #endif
 
+    // the filesystems and current directory have just been set up
+    fscache_invalidate();
+
     // reset config variables; they should be set by boot.py
     pyb_config_main = MP_OBJ_NULL;
     pyb_config_usb_mode = MP_OBJ_NULL;
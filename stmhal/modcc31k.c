@@ -63,10 +63,14 @@
 // CC3100 defines (different from standard one!)
 #define ENOENT  -2
 #define EPIPE   -32
+#define EINPROGRESS -115
 
 #define CC31K_SOCKET_MAX     SL_MAX_SOCKETS   // the maximum number of sockets that the CC31K could support
 #define CC31K_MAX_RX_PACKET  (16000)
 #define CC31K_MAX_TX_PACKET  (1460)
+#define CC31K_TX_BURST       (CC31K_MAX_TX_PACKET * 32) // largest span handed to sl_Send at once
+#define CC31K_SENDFILE_BUF   (4096)
+#define CC31K_POLL_MAX_WAIT_MS (100) // longest single sl_Select wait when polling
 
 typedef struct _netapp_ipconfig_ret_args_t
 {
@@ -86,21 +90,44 @@ int CC3100_EXPORT(errno); // for cc3100 driver
 STATIC int cc31k_init(void);
 
 STATIC mp_obj_t cc31k_socket_new(mp_uint_t family, mp_uint_t type, mp_uint_t protocol, int *_errno);
+STATIC mp_int_t cc31k_poll(mp_obj_t nic, mp_uint_t n, const mp_obj_t *socket, mp_uint_t *flags, mp_uint_t timeout, int *_errno);
+STATIC const mp_obj_type_t cc31k_socket_type;
+
+// Per-socket readiness, updated from the driver's async events (select
+// results, tx failures, closes) and consumed by recv/send/accept, so that
+// poll can answer from here without a round trip to the NWP.
+#define SOCK_STATE_RD       (0x01) // data or a connection waiting
+#define SOCK_STATE_WR       (0x02) // room to send
+#define SOCK_STATE_CLOSED   (0x04) // closed under us
+#define SOCK_STATE_ERR      (0x08) // transmit or non-blocking connect failed
+#define SOCK_STATE_CONNECTING (0x10) // non-blocking connect in progress
 
-STATIC volatile uint32_t fd_closed_state = 0;
+STATIC volatile uint8_t fd_state[BSD_SOCKET_ID_MASK + 1];
 STATIC volatile bool wlan_connected      = false;
 STATIC volatile bool ip_obtained         = false;
 
+STATIC int cc31k_get_fd_state(int fd) {
+    return fd_state[fd & BSD_SOCKET_ID_MASK];
+}
+
+STATIC void cc31k_set_fd_state(int fd, int state) {
+    fd_state[fd & BSD_SOCKET_ID_MASK] |= state;
+}
+
+STATIC void cc31k_clear_fd_state(int fd, int state) {
+    fd_state[fd & BSD_SOCKET_ID_MASK] &= ~state;
+}
+
 STATIC int cc31k_get_fd_closed_state(int fd) {
-    return fd_closed_state & (1 << fd);
+    return cc31k_get_fd_state(fd) & SOCK_STATE_CLOSED;
 }
 
 STATIC void cc31k_set_fd_closed_state(int fd) {
-    fd_closed_state |= 1 << fd;
+    cc31k_set_fd_state(fd, SOCK_STATE_CLOSED);
 }
 
 STATIC void cc31k_reset_fd_closed_state(int fd) {
-    fd_closed_state &= ~(1 << fd);
+    fd_state[fd & BSD_SOCKET_ID_MASK] = 0;
 }
 
 STATIC mp_obj_t cc31k_socket(mp_obj_t nic, int domain, int type, int fileno, int *_errno) {
@@ -380,6 +407,36 @@ STATIC mp_obj_t cc31k_patch_program(mp_obj_t self_in, mp_obj_t key_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(cc31k_patch_program_obj, cc31k_patch_program);
 
+/// \method pool_stats([reset])
+/// Return the usage of the driver's static pools as a pair of tuples.  The
+/// first, for the async event buffers, is `(allocs, failures, in_use,
+/// max_in_use)`; the second, for the action objects, is `(waits, failures,
+/// in_use, max_in_use)`.  If `reset` is true the counters are cleared and the
+/// high water marks restarted.
+STATIC mp_obj_t cc31k_pool_stats(mp_uint_t n_args, const mp_obj_t *args) {
+    SlPoolStats_t stats;
+    sl_PoolStatsGet(&stats, n_args > 1 && mp_obj_is_true(args[1]));
+
+    mp_obj_t async_buf[4] = {
+        mp_obj_new_int_from_uint(stats.AsyncBufAllocs),
+        mp_obj_new_int_from_uint(stats.AsyncBufFailures),
+        MP_OBJ_NEW_SMALL_INT(stats.AsyncBufInUse),
+        MP_OBJ_NEW_SMALL_INT(stats.AsyncBufMaxInUse),
+    };
+    mp_obj_t obj_pool[4] = {
+        mp_obj_new_int_from_uint(stats.ObjPoolWaits),
+        mp_obj_new_int_from_uint(stats.ObjPoolFailures),
+        MP_OBJ_NEW_SMALL_INT(stats.ObjPoolInUse),
+        MP_OBJ_NEW_SMALL_INT(stats.ObjPoolMaxInUse),
+    };
+    mp_obj_t tuple[2] = {
+        mp_obj_new_tuple(4, async_buf),
+        mp_obj_new_tuple(4, obj_pool),
+    };
+    return mp_obj_new_tuple(2, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(cc31k_pool_stats_obj, 1, 2, cc31k_pool_stats);
+
 STATIC const mp_map_elem_t cc31k_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_connect),         (mp_obj_t)&cc31k_connect_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_disconnect),      (mp_obj_t)&cc31k_disconnect_obj },
@@ -389,6 +446,7 @@ STATIC const mp_map_elem_t cc31k_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_ifconfig),        (mp_obj_t)&cc31k_ifconfig_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_patch_version),   (mp_obj_t)&cc31k_patch_version_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_patch_program),   (mp_obj_t)&cc31k_patch_program_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_pool_stats),      (mp_obj_t)&cc31k_pool_stats_obj },
 
     // class constants
     { MP_OBJ_NEW_QSTR(MP_QSTR_WEP), MP_OBJ_NEW_SMALL_INT(SL_SEC_TYPE_WEP) },
@@ -408,6 +466,8 @@ const mod_network_nic_type_t mod_network_nic_type_cc31k = {
     },
     .socket = cc31k_socket,
     .gethostbyname = cc31k_gethostbyname,
+    .socket_type = &cc31k_socket_type,
+    .poll = cc31k_poll,
 };
 
 /******************************************************************************/
@@ -420,14 +480,23 @@ const mod_network_nic_type_t mod_network_nic_type_cc31k = {
 typedef struct _cc31k_socket_obj_t {
     mp_obj_base_t base;
     int fd;
+    bool nonblocking;
+    byte *rx_buf;       // optional read-ahead buffer, see setrxbuf
+    uint16_t rx_size;
+    uint16_t rx_pos;    // next byte of rx_buf to hand out
+    uint16_t rx_len;    // end of the data held in rx_buf
+    int16_t connect_err; // result of a failed non-blocking connect, 0 if none
+    sockaddr_in peer;   // address of a non-blocking connect in progress
 } cc31k_socket_obj_t;
 
-STATIC const mp_obj_type_t cc31k_socket_type;
-
 STATIC mp_obj_t cc31k_socket_new(mp_uint_t family, mp_uint_t type, mp_uint_t protocol, int *_errno) {
     // create socket object
     cc31k_socket_obj_t *s = m_new_obj_with_finaliser(cc31k_socket_obj_t);
     s->base.type = (mp_obj_t)&cc31k_socket_type;
+    s->nonblocking = false;
+    s->rx_buf = NULL;
+    s->rx_size = s->rx_pos = s->rx_len = 0;
+    s->connect_err = 0;
 
     // open socket
     s->fd = sl_Socket(family, type, protocol);
@@ -448,6 +517,65 @@ STATIC void cc31k_socket_print(void (*print)(void *env, const char *fmt, ...), v
     printf("<CC31k.socket fd=%d>", self->fd);
 }
 
+STATIC bool cc31k_is_stream(int fd) {
+    switch (fd & SL_SOCKET_PAYLOAD_TYPE_MASK) {
+        case SL_SOCKET_PAYLOAD_TYPE_TCP_IPV4:
+        case SL_SOCKET_PAYLOAD_TYPE_TCP_IPV6:
+        case SL_SOCKET_PAYLOAD_TYPE_TCP_IPV4_SECURE:
+        case SL_SOCKET_PAYLOAD_TYPE_TCP_IPV6_SECURE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// convert a (host, port) tuple to an IPv4 socket address
+STATIC void cc31k_parse_sockaddr(mp_obj_t addr_obj, sockaddr_in *addr_in) {
+    mp_obj_t *addr;
+    mp_obj_get_array_fixed_n(addr_obj, 2, &addr);
+
+    memset(addr_in, 0, sizeof(sockaddr_in));
+    addr_in->sin_family = AF_INET;
+    addr_in->sin_port = sl_Htons(mp_obj_get_int(addr[1]));
+    if (!inet_pton(AF_INET, mp_obj_str_get_str(addr[0]), &addr_in->sin_addr.s_addr)) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "invalid IP address"));
+    }
+}
+
+// convert an IPv4 socket address to a (host, port) tuple
+STATIC mp_obj_t cc31k_make_sockaddr(const sockaddr_in *addr_in) {
+    char buf[MAX_ADDRSTRLEN] = {0};
+    if (inet_ntop(AF_INET, &addr_in->sin_addr, buf, MAX_ADDRSTRLEN) == NULL) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "invalid IP address"));
+    }
+    mp_obj_t tuple[2] = {
+        mp_obj_new_str(buf, strlen(buf), false),
+        mp_obj_new_int(sl_Ntohs(addr_in->sin_port)),
+    };
+    return mp_obj_new_tuple(2, tuple);
+}
+
+// Send all of buf, returning the number of bytes sent or -1 with *_errno set.
+// sl_Send splits a stream span into packets itself and writes them back to
+// back, blocking only when the NWP's TX pool count drops to FLOW_CONT_MIN, so
+// TCP data is handed over in spans of up to CC31K_TX_BURST (its chunk length
+// is 16 bit).  Other socket types go one packet per call so that datagrams
+// are not merged.
+STATIC mp_int_t cc31k_send_buf(int fd, const uint8_t *buf, mp_uint_t len, int *_errno) {
+    mp_uint_t burst = cc31k_is_stream(fd) ? CC31K_TX_BURST : CC31K_MAX_TX_PACKET;
+    mp_uint_t bytes = 0;
+    cc31k_clear_fd_state(fd, SOCK_STATE_WR);
+    while (bytes < len) {
+        int n = sl_Send(fd, buf + bytes, MIN(len - bytes, burst), 0);
+        if (n <= 0) {
+            *_errno = CC3100_EXPORT(errno);
+            return -1;
+        }
+        bytes += n;
+    }
+    return bytes;
+}
+
 STATIC mp_obj_t cc31k_socket_send(mp_obj_t self_in, mp_obj_t buf_in) {
     cc31k_socket_obj_t *self = self_in;
 
@@ -459,26 +587,116 @@ STATIC mp_obj_t cc31k_socket_send(mp_obj_t self_in, mp_obj_t buf_in) {
     mp_buffer_info_t bufinfo;
     mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_READ);
 
-    // CC31K does not handle fragmentation, and will overflow,
-    // split the packet into smaller ones and send them out.
+    int _errno;
+    mp_int_t bytes = cc31k_send_buf(self->fd, bufinfo.buf, bufinfo.len, &_errno);
+    if (bytes == -1) {
+        nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(_errno)));
+    }
+
+    return MP_OBJ_NEW_SMALL_INT(bytes);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(cc31k_socket_send_obj, cc31k_socket_send);
+
+STATIC mp_obj_t cc31k_socket_sendall(mp_obj_t self_in, mp_obj_t buf_in) {
+    cc31k_socket_send(self_in, buf_in);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(cc31k_socket_sendall_obj, cc31k_socket_sendall);
+
+// sendfile(file[, count]) streams a file, or any other readable stream, to the
+// socket until end of file or until count bytes have been sent, and returns
+// the number of bytes sent.
+STATIC mp_obj_t cc31k_socket_sendfile(mp_uint_t n_args, const mp_obj_t *args) {
+    cc31k_socket_obj_t *self = args[0];
+    mp_obj_type_t *type = mp_obj_get_type(args[1]);
+
+    if (type->stream_p == NULL || type->stream_p->read == NULL) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Operation not supported"));
+    }
+
+    if (cc31k_get_fd_closed_state(self->fd)) {
+        sl_Close(self->fd);
+        nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(EPIPE)));
+    }
+
+    mp_int_t count = -1;
+    if (n_args > 2 && args[2] != mp_const_none) {
+        count = mp_obj_get_int(args[2]);
+    }
+
+    byte *buf = m_new(byte, CC31K_SENDFILE_BUF);
     mp_int_t bytes = 0;
-    while (bytes < bufinfo.len) {
-        int n = MIN((bufinfo.len - bytes), CC31K_MAX_TX_PACKET);
-        n = sl_Send(self->fd, (uint8_t*)bufinfo.buf + bytes, n, 0);
-        if (n <= 0) {
-            nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(CC3100_EXPORT(errno))));
+    int _errno;
+    bool failed = false;
+    while (count < 0 || bytes < count) {
+        mp_uint_t n = CC31K_SENDFILE_BUF;
+        if (count >= 0) {
+            n = MIN(n, count - bytes);
+        }
+        n = type->stream_p->read(args[1], buf, n, &_errno);
+        if (n == MP_STREAM_ERROR) {
+            failed = true;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        if (cc31k_send_buf(self->fd, buf, n, &_errno) == -1) {
+            failed = true;
+            break;
         }
         bytes += n;
     }
+    m_del(byte, buf, CC31K_SENDFILE_BUF);
 
-    return MP_OBJ_NEW_SMALL_INT(bytes);
+    if (failed) {
+        nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(_errno)));
+    }
+
+    return mp_obj_new_int(bytes);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(cc31k_socket_sendfile_obj, 2, 3, cc31k_socket_sendfile);
+
+// Receive up to len bytes into buf, returning the number received (0 at the
+// end of the stream) or -1 with *_errno set.  With a read-ahead buffer, reads
+// smaller than it are served from RAM; an empty buffer is refilled with as
+// much as the NWP holds for the socket in one sl_Recv.
+STATIC mp_int_t cc31k_socket_recv_buf(cc31k_socket_obj_t *self, byte *buf, mp_uint_t len, int *_errno) {
+    if (self->rx_pos == self->rx_len && self->rx_buf != NULL && len < self->rx_size) {
+        cc31k_clear_fd_state(self->fd, SOCK_STATE_RD);
+        int n = sl_Recv(self->fd, self->rx_buf, self->rx_size, 0);
+        if (n < 0) {
+            *_errno = CC3100_EXPORT(errno);
+            return -1;
+        }
+        self->rx_pos = 0;
+        self->rx_len = n;
+    }
+
+    if (self->rx_pos < self->rx_len) {
+        len = MIN(len, self->rx_len - self->rx_pos);
+        memcpy(buf, self->rx_buf + self->rx_pos, len);
+        self->rx_pos += len;
+        return len;
+    } else if (self->rx_buf != NULL && len < self->rx_size) {
+        // the refill above hit the end of the stream
+        return 0;
+    }
+
+    cc31k_clear_fd_state(self->fd, SOCK_STATE_RD);
+    int n = sl_Recv(self->fd, buf, MIN(len, CC31K_MAX_RX_PACKET), 0);
+    if (n < 0) {
+        *_errno = CC3100_EXPORT(errno);
+        return -1;
+    }
+    return n;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_2(cc31k_socket_send_obj, cc31k_socket_send);
 
 STATIC mp_obj_t cc31k_socket_recv(mp_obj_t self_in, mp_obj_t len_in) {
     cc31k_socket_obj_t *self = self_in;
 
-    if (cc31k_get_fd_closed_state(self->fd)) {
+    // data already read ahead is still handed out after a close
+    if (self->rx_pos == self->rx_len && cc31k_get_fd_closed_state(self->fd)) {
         sl_Close(self->fd);
         nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(EPIPE)));
     }
@@ -489,17 +707,198 @@ STATIC mp_obj_t cc31k_socket_recv(mp_obj_t self_in, mp_obj_t len_in) {
 
     byte *buf;
     mp_obj_t ret_obj = mp_obj_str_builder_start(&mp_type_bytes, len, &buf);
-    len = sl_Recv(self->fd, buf, len, 0);
+    int _errno;
+    len = cc31k_socket_recv_buf(self, buf, len, &_errno);
     if (len == 0) {
         return mp_const_empty_bytes;
     } else if (len < 0) {
-        nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(CC3100_EXPORT(errno))));
+        nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(_errno)));
     } else {
         return mp_obj_str_builder_end_with_len(ret_obj, len);
     }
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(cc31k_socket_recv_obj, cc31k_socket_recv);
 
+// setrxbuf(size) gives the socket a read-ahead buffer of size bytes, or takes
+// it away if size is 0.  Small reads such as readline() are then served from
+// RAM instead of costing an SPI transaction each.
+STATIC mp_obj_t cc31k_socket_setrxbuf(mp_obj_t self_in, mp_obj_t size_in) {
+    cc31k_socket_obj_t *self = self_in;
+    mp_int_t size = mp_obj_get_int(size_in);
+
+    if (size < 0 || size > CC31K_MAX_RX_PACKET) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "invalid buffer size"));
+    }
+    // reading ahead would merge datagrams
+    if (!cc31k_is_stream(self->fd)) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "not a stream socket"));
+    }
+    if (self->rx_pos != self->rx_len) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "receive buffer not empty"));
+    }
+
+    // the driver transfers whole words
+    size = (size + 3) & ~3;
+    if (self->rx_buf != NULL) {
+        m_del(byte, self->rx_buf, self->rx_size);
+    }
+    self->rx_buf = (size > 0) ? m_new(byte, size) : NULL;
+    self->rx_size = size;
+    self->rx_pos = self->rx_len = 0;
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(cc31k_socket_setrxbuf_obj, cc31k_socket_setrxbuf);
+
+STATIC mp_obj_t cc31k_socket_sendto(mp_obj_t self_in, mp_obj_t data_in, mp_obj_t addr_in) {
+    cc31k_socket_obj_t *self = self_in;
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(data_in, &bufinfo, MP_BUFFER_READ);
+    sockaddr_in addr;
+    cc31k_parse_sockaddr(addr_in, &addr);
+
+    cc31k_clear_fd_state(self->fd, SOCK_STATE_WR);
+    int ret = sl_SendTo(self->fd, bufinfo.buf, bufinfo.len, 0, (sockaddr*)&addr, sizeof(sockaddr_in));
+    if (ret < 0) {
+        nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(CC3100_EXPORT(errno))));
+    }
+    return MP_OBJ_NEW_SMALL_INT(ret);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(cc31k_socket_sendto_obj, cc31k_socket_sendto);
+
+STATIC mp_obj_t cc31k_socket_recvfrom(mp_obj_t self_in, mp_obj_t len_in) {
+    cc31k_socket_obj_t *self = self_in;
+
+    mp_int_t len = mp_obj_get_int(len_in);
+    len = MIN(len, CC31K_MAX_RX_PACKET);
+
+    byte *buf;
+    mp_obj_t ret_obj = mp_obj_str_builder_start(&mp_type_bytes, len, &buf);
+    sockaddr_in addr = {0};
+    socklen_t addr_len = sizeof(sockaddr_in);
+    cc31k_clear_fd_state(self->fd, SOCK_STATE_RD);
+    int ret = sl_RecvFrom(self->fd, buf, len, 0, (sockaddr*)&addr, &addr_len);
+    if (ret < 0) {
+        nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(CC3100_EXPORT(errno))));
+    }
+
+    mp_obj_t tuple[2] = {
+        (ret == 0) ? mp_const_empty_bytes : mp_obj_str_builder_end_with_len(ret_obj, ret),
+        cc31k_make_sockaddr(&addr),
+    };
+    return mp_obj_new_tuple(2, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(cc31k_socket_recvfrom_obj, cc31k_socket_recvfrom);
+
+// sendmmsg(bufs[, address]) sends each buffer in bufs as one datagram, to
+// address or else to the connected peer, and returns the number sent.  The
+// driver writes datagrams back to back without waiting for a response, so
+// the whole batch costs one Python call.  An error after the first datagram
+// ends the batch early; it is raised if nothing was sent.
+STATIC mp_obj_t cc31k_socket_sendmmsg(mp_uint_t n_args, const mp_obj_t *args) {
+    cc31k_socket_obj_t *self = args[0];
+
+    mp_uint_t n_msg;
+    mp_obj_t *msg;
+    mp_obj_get_array(args[1], &n_msg, &msg);
+
+    sockaddr_in addr;
+    bool to = (n_args > 2 && args[2] != mp_const_none);
+    if (to) {
+        cc31k_parse_sockaddr(args[2], &addr);
+    }
+
+    cc31k_clear_fd_state(self->fd, SOCK_STATE_WR);
+    mp_uint_t i;
+    for (i = 0; i < n_msg; i++) {
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(msg[i], &bufinfo, MP_BUFFER_READ);
+        int ret;
+        if (to) {
+            ret = sl_SendTo(self->fd, bufinfo.buf, bufinfo.len, 0, (sockaddr*)&addr, sizeof(sockaddr_in));
+        } else {
+            ret = sl_Send(self->fd, bufinfo.buf, bufinfo.len, 0);
+        }
+        if (ret < 0) {
+            if (i == 0) {
+                nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(CC3100_EXPORT(errno))));
+            }
+            break;
+        }
+    }
+    return MP_OBJ_NEW_SMALL_INT(i);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(cc31k_socket_sendmmsg_obj, 2, 3, cc31k_socket_sendmmsg);
+
+STATIC void cc31k_socket_set_nonblocking(cc31k_socket_obj_t *self, bool nonblocking) {
+    int optval = nonblocking;
+    if (sl_SetSockOpt(self->fd, SOL_SOCKET, SL_SO_NONBLOCKING, &optval, sizeof(optval)) != 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "setsockopt failed"));
+    }
+}
+
+// recvmmsg(bufs) receives datagrams into the preallocated buffers in bufs and
+// returns a list of (nbytes, address), one per datagram, in buffer order.  It
+// waits only for the first datagram; the rest of the batch takes whatever is
+// already queued on the NWP, reading with the socket switched to non-blocking.
+STATIC mp_obj_t cc31k_socket_recvmmsg(mp_obj_t self_in, mp_obj_t bufs_in) {
+    cc31k_socket_obj_t *self = self_in;
+
+    mp_uint_t n_buf;
+    mp_obj_t *bufs;
+    mp_obj_get_array(bufs_in, &n_buf, &bufs);
+
+    // check the buffers up front, before the socket is switched
+    for (mp_uint_t i = 0; i < n_buf; i++) {
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(bufs[i], &bufinfo, MP_BUFFER_WRITE);
+    }
+
+    mp_obj_t result = mp_obj_new_list(0, NULL);
+    // building the results can still raise, and the socket must not be
+    // left non-blocking when it does
+    volatile bool switched = false;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        for (mp_uint_t i = 0; i < n_buf; i++) {
+            mp_buffer_info_t bufinfo;
+            mp_get_buffer(bufs[i], &bufinfo, MP_BUFFER_WRITE);
+            sockaddr_in addr = {0};
+            socklen_t addr_len = sizeof(sockaddr_in);
+            cc31k_clear_fd_state(self->fd, SOCK_STATE_RD);
+            int ret = sl_RecvFrom(self->fd, bufinfo.buf, MIN(bufinfo.len, CC31K_MAX_RX_PACKET), 0, (sockaddr*)&addr, &addr_len);
+            if (ret < 0) {
+                if (i == 0) {
+                    nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(CC3100_EXPORT(errno))));
+                }
+                // SL_EAGAIN once the queue is drained; any other error shows up
+                // on the next call
+                break;
+            }
+
+            mp_obj_t tuple[2] = {MP_OBJ_NEW_SMALL_INT(ret), cc31k_make_sockaddr(&addr)};
+            mp_obj_list_append(result, mp_obj_new_tuple(2, tuple));
+
+            if (i + 1 < n_buf && !self->nonblocking && !switched) {
+                cc31k_socket_set_nonblocking(self, true);
+                switched = true;
+            }
+        }
+        nlr_pop();
+    } else {
+        if (switched) {
+            cc31k_socket_set_nonblocking(self, false);
+        }
+        nlr_raise(nlr.ret_val);
+    }
+    if (switched) {
+        cc31k_socket_set_nonblocking(self, false);
+    }
+    return result;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(cc31k_socket_recvmmsg_obj, cc31k_socket_recvmmsg);
+
 STATIC mp_obj_t cc31k_socket_bind(mp_obj_t self_in, mp_obj_t addr_obj) {
     cc31k_socket_obj_t *self = self_in;
 
@@ -545,8 +944,13 @@ STATIC mp_obj_t cc31k_socket_accept(mp_obj_t self_in) {
     sockaddr addr;
     socklen_t addr_len = sizeof(sockaddr);
 
-    // accept incoming connection
+    // accept incoming connection; a non-blocking socket gets SL_EAGAIN when
+    // none is waiting and becomes readable through poll when one arrives
+    cc31k_clear_fd_state(self->fd, SOCK_STATE_RD);
     if ((fd = sl_Accept(self->fd, &addr, &addr_len)) < 0) {
+        if (fd == SL_EAGAIN) {
+            nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(EAGAIN)));
+        }
         nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "accept failed"));
     }
 
@@ -557,6 +961,10 @@ STATIC mp_obj_t cc31k_socket_accept(mp_obj_t self_in) {
     cc31k_socket_obj_t *socket_obj = m_new_obj_with_finaliser(cc31k_socket_obj_t);
     socket_obj->base.type = (mp_obj_t)&cc31k_socket_type;
     socket_obj->fd  = fd;
+    socket_obj->nonblocking = false;
+    socket_obj->rx_buf = NULL;
+    socket_obj->rx_size = socket_obj->rx_pos = socket_obj->rx_len = 0;
+    socket_obj->connect_err = 0;
 
     char buf[MAX_ADDRSTRLEN]={0};
     if (inet_ntop(addr.sa_family,
@@ -598,7 +1006,28 @@ STATIC mp_obj_t cc31k_socket_connect(mp_obj_t self_in, mp_obj_t addr_obj) {
 
     //printf("doing connect: fd=%d, sockaddr=(%d, %d, %lu)\n", self->fd, addr_in.sin_family, addr_in.sin_port, addr_in.sin_addr.s_addr);
 
+    // report the outcome of an earlier non-blocking connect that failed
+    if (self->connect_err != 0) {
+        int err = self->connect_err;
+        self->connect_err = 0;
+        nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(err)));
+    }
+
+    bool connecting = cc31k_get_fd_state(self->fd) & SOCK_STATE_CONNECTING;
     int ret = sl_Connect(self->fd, (sockaddr*)&addr_in, sizeof(sockaddr_in));
+    if (ret == SL_EALREADY) {
+        // a non-blocking socket: the NWP runs the handshake and poll finishes
+        // it, reporting the socket writable once it is up
+        self->peer = addr_in;
+        cc31k_clear_fd_state(self->fd, SOCK_STATE_WR | SOCK_STATE_ERR);
+        cc31k_set_fd_state(self->fd, SOCK_STATE_CONNECTING);
+        nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(connecting ? SL_EALREADY : EINPROGRESS)));
+    }
+    cc31k_clear_fd_state(self->fd, SOCK_STATE_CONNECTING);
+    if (ret == SL_EISCONN && connecting) {
+        // finished since the last poll
+        ret = 0;
+    }
     if (ret != 0) {
         nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_OSError, "[Errno %d] connect failed", ret));
     }
@@ -626,18 +1055,10 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_2(cc31k_socket_settimeout_obj, cc31k_socket_setti
 
 STATIC mp_obj_t cc31k_socket_setblocking(mp_obj_t self_in, mp_obj_t blocking) {
     cc31k_socket_obj_t *self = self_in;
-    int optval;
-    socklen_t optlen = sizeof(optval);
 
-    if (mp_obj_get_int(blocking)) {
-        optval = 0; 
-    } else {
-        optval = 1; // Enable non-blocking
-    }
-
-    if (sl_SetSockOpt(self->fd, SOL_SOCKET, SL_SO_NONBLOCKING, &optval, optlen) != 0) {
-        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "setsockopt failed"));
-    }
+    bool nonblocking = !mp_obj_get_int(blocking);
+    cc31k_socket_set_nonblocking(self, nonblocking);
+    self->nonblocking = nonblocking;
 
     return mp_const_true;
 }
@@ -673,13 +1094,24 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(cc31k_socket_setsockopt_obj, 4, 4, cc
 STATIC mp_obj_t cc31k_socket_close(mp_obj_t self_in) {
     cc31k_socket_obj_t *self = self_in;
     sl_Close(self->fd);
+    cc31k_reset_fd_closed_state(self->fd);
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(cc31k_socket_close_obj, cc31k_socket_close);
 
 STATIC const mp_map_elem_t cc31k_socket_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_send),        (mp_obj_t)&cc31k_socket_send_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_sendall),     (mp_obj_t)&cc31k_socket_sendall_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_sendfile),    (mp_obj_t)&cc31k_socket_sendfile_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_recv),        (mp_obj_t)&cc31k_socket_recv_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_setrxbuf),    (mp_obj_t)&cc31k_socket_setrxbuf_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_sendto),      (mp_obj_t)&cc31k_socket_sendto_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_recvfrom),    (mp_obj_t)&cc31k_socket_recvfrom_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_sendmmsg),    (mp_obj_t)&cc31k_socket_sendmmsg_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_recvmmsg),    (mp_obj_t)&cc31k_socket_recvmmsg_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_read),        (mp_obj_t)&mp_stream_read_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_readline),    (mp_obj_t)&mp_stream_unbuffered_readline_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_write),       (mp_obj_t)&mp_stream_write_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_bind),        (mp_obj_t)&cc31k_socket_bind_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_listen),      (mp_obj_t)&cc31k_socket_listen_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_accept),      (mp_obj_t)&cc31k_socket_accept_obj },
@@ -693,60 +1125,118 @@ STATIC const mp_map_elem_t cc31k_socket_locals_dict_table[] = {
 
 STATIC MP_DEFINE_CONST_DICT(cc31k_socket_locals_dict, cc31k_socket_locals_dict_table);
 
-mp_uint_t cc31k_ioctl(mp_obj_t self_in, mp_uint_t request, int *errcode, ...) {
-    cc31k_socket_obj_t *self = self_in;
-    va_list vargs;
-    va_start(vargs, errcode);
-    mp_uint_t ret;
-    if (request == MP_IOCTL_POLL) {
-        mp_uint_t flags = va_arg(vargs, mp_uint_t);
-        ret = 0;
-        int fd = self->fd;
-
-        // init fds
-        /*fd_set*/ SlFdSet_t rfds, wfds, xfds;
-        FD_ZERO(&rfds);
-        FD_ZERO(&wfds);
-        FD_ZERO(&xfds);
-
-        // set fds if needed
-        if (flags & MP_IOCTL_POLL_RD) {
-            SL_FD_SET(fd, &rfds);
-
-            // A socket that just closed is available for reading.  A call to
-            // recv() returns 0 which is consistent with BSD.
-            if (cc31k_get_fd_closed_state(fd)) {
-                ret |= MP_IOCTL_POLL_RD;
-            }
+// Finish a non-blocking connect.  The NWP sends no event when the handshake
+// completes; asking sl_Connect again answers SL_EALREADY while it is running
+// and 0 (or SL_EISCONN) once the socket is up, so poll asks on every pass.
+// The outcome makes the socket writable, with ERR set and the error kept for
+// the next connect() call if it failed.
+STATIC void cc31k_connect_check(cc31k_socket_obj_t *s) {
+    if (!(cc31k_get_fd_state(s->fd) & SOCK_STATE_CONNECTING)) {
+        return;
+    }
+    int ret = sl_Connect(s->fd, (sockaddr*)&s->peer, sizeof(sockaddr_in));
+    if (ret == SL_EALREADY) {
+        return;
+    }
+    cc31k_clear_fd_state(s->fd, SOCK_STATE_CONNECTING);
+    if (ret == 0 || ret == SL_EISCONN) {
+        cc31k_set_fd_state(s->fd, SOCK_STATE_WR);
+    } else {
+        s->connect_err = ret;
+        cc31k_set_fd_state(s->fd, SOCK_STATE_WR | SOCK_STATE_ERR);
+    }
+}
+
+// Work out the ready flags of each socket from the cached state, returning
+// the number of sockets with at least one requested flag set.
+STATIC mp_int_t cc31k_poll_ready(mp_uint_t n, const mp_obj_t *socket, const mp_uint_t *flags, mp_uint_t *ret) {
+    mp_int_t n_ready = 0;
+    for (mp_uint_t i = 0; i < n; i++) {
+        cc31k_socket_obj_t *s = socket[i];
+        cc31k_connect_check(s);
+        int state = cc31k_get_fd_state(s->fd);
+        ret[i] = 0;
+        // A socket that just closed is available for reading.  A call to
+        // recv() returns 0 which is consistent with BSD.
+        if ((flags[i] & MP_IOCTL_POLL_RD)
+            && (s->rx_pos < s->rx_len || (state & (SOCK_STATE_RD | SOCK_STATE_CLOSED)))) {
+            ret[i] |= MP_IOCTL_POLL_RD;
+        }
+        if ((flags[i] & MP_IOCTL_POLL_WR) && (state & SOCK_STATE_WR) && !(state & SOCK_STATE_CONNECTING)) {
+            ret[i] |= MP_IOCTL_POLL_WR;
+        }
+        if ((flags[i] & MP_IOCTL_POLL_HUP) && (state & SOCK_STATE_CLOSED)) {
+            ret[i] |= MP_IOCTL_POLL_HUP;
         }
-        if (flags & MP_IOCTL_POLL_WR) {
-            SL_FD_SET(fd, &wfds);
+        if ((flags[i] & MP_IOCTL_POLL_ERR) && (state & SOCK_STATE_ERR)) {
+            ret[i] |= MP_IOCTL_POLL_ERR;
         }
-        if (flags & MP_IOCTL_POLL_HUP) {
-            SL_FD_SET(fd, &xfds);
+        if (ret[i] != 0) {
+            n_ready += 1;
         }
+    }
+    return n_ready;
+}
 
-        // call cc3100 select with minimum timeout
-        timeval tv;
-        tv.tv_sec = 0;
-        tv.tv_usec = 1;
-        int nfds = sl_Select(fd + 1, &rfds, &wfds, &xfds, &tv);
+// Poll many sockets, waiting up to timeout ms (-1 for no limit).  Pending
+// async events are processed first and, if they already make a socket ready,
+// no SPI traffic is needed.  Otherwise a single sl_Select is issued whose
+// result lands in the cached state through SimpleLinkSockSelectEventHandler.
+// Each wait is capped at CC31K_POLL_MAX_WAIT_MS so that sockets closed under
+// us (which sl_Select does not report) are still noticed, and so that a
+// non-blocking connect in progress is checked again.  n is at most
+// MOD_NETWORK_POLL_MAX.
+STATIC mp_int_t cc31k_poll(mp_obj_t nic, mp_uint_t n, const mp_obj_t *socket, mp_uint_t *flags, mp_uint_t timeout, int *_errno) {
+    mp_uint_t ret[MOD_NETWORK_POLL_MAX];
 
-        // check for error
-        if (nfds == -1) {
-            *errcode = CC3100_EXPORT(errno);
-            return -1;
+    _SlNonOsMainLoopTask();
+    mp_int_t n_ready = cc31k_poll_ready(n, socket, flags, ret);
+
+    if (n_ready == 0) {
+        SlFdSet_t rfds, wfds;
+        SL_FD_ZERO(&rfds);
+        SL_FD_ZERO(&wfds);
+        int nfds = 0;
+        for (mp_uint_t i = 0; i < n; i++) {
+            int fd = ((cc31k_socket_obj_t*)socket[i])->fd;
+            nfds = MAX(nfds, (fd & BSD_SOCKET_ID_MASK) + 1);
+            if (flags[i] & MP_IOCTL_POLL_RD) {
+                SL_FD_SET(fd, &rfds);
+            }
+            if (flags[i] & MP_IOCTL_POLL_WR) {
+                SL_FD_SET(fd, &wfds);
+            }
         }
 
-        // check return of select
-        if (SL_FD_ISSET(fd, &rfds)) {
-            ret |= MP_IOCTL_POLL_RD;
+        if (timeout == -1 || timeout > CC31K_POLL_MAX_WAIT_MS) {
+            timeout = CC31K_POLL_MAX_WAIT_MS;
         }
-        if (SL_FD_ISSET(fd, &wfds)) {
-            ret |= MP_IOCTL_POLL_WR;
+        timeval tv;
+        tv.tv_sec = timeout / 1000;
+        tv.tv_usec = (timeout % 1000) * 1024; // the driver divides by 1024 to get ms
+        if (sl_Select(nfds, &rfds, &wfds, NULL, &tv) < 0) {
+            *_errno = CC3100_EXPORT(errno);
+            return -1;
         }
-        if (SL_FD_ISSET(fd, &xfds)) {
-            ret |= MP_IOCTL_POLL_HUP;
+        n_ready = cc31k_poll_ready(n, socket, flags, ret);
+    }
+
+    for (mp_uint_t i = 0; i < n; i++) {
+        flags[i] = ret[i];
+    }
+    return n_ready;
+}
+
+mp_uint_t cc31k_ioctl(mp_obj_t self_in, mp_uint_t request, int *errcode, ...) {
+    va_list vargs;
+    va_start(vargs, errcode);
+    mp_uint_t ret;
+    if (request == MP_IOCTL_POLL) {
+        mp_uint_t flags = va_arg(vargs, mp_uint_t);
+        if (cc31k_poll(MP_OBJ_NULL, 1, &self_in, &flags, 0, errcode) == -1) {
+            ret = -1;
+        } else {
+            ret = flags;
         }
     } else {
         *errcode = EINVAL;
@@ -756,7 +1246,28 @@ mp_uint_t cc31k_ioctl(mp_obj_t self_in, mp_uint_t request, int *errcode, ...) {
     return ret;
 }
 
+STATIC mp_uint_t cc31k_socket_read(mp_obj_t self_in, void *buf, mp_uint_t size, int *errcode) {
+    cc31k_socket_obj_t *self = self_in;
+    if (self->rx_pos == self->rx_len && cc31k_get_fd_closed_state(self->fd)) {
+        return 0;
+    }
+    mp_int_t ret = cc31k_socket_recv_buf(self, buf, size, errcode);
+    return (ret < 0) ? MP_STREAM_ERROR : ret;
+}
+
+STATIC mp_uint_t cc31k_socket_write(mp_obj_t self_in, const void *buf, mp_uint_t size, int *errcode) {
+    cc31k_socket_obj_t *self = self_in;
+    if (cc31k_get_fd_closed_state(self->fd)) {
+        *errcode = EPIPE;
+        return MP_STREAM_ERROR;
+    }
+    mp_int_t ret = cc31k_send_buf(self->fd, buf, size, errcode);
+    return (ret < 0) ? MP_STREAM_ERROR : ret;
+}
+
 STATIC const mp_stream_p_t cc31k_socket_stream_p = {
+    .read = cc31k_socket_read,
+    .write = cc31k_socket_write,
     .ioctl = cc31k_ioctl,
     .is_text = false,
 };
@@ -1073,6 +1584,7 @@ void SimpleLinkSockEventHandler(SlSockEvent_t *pSock)
              * SlSockEventData_t *pEventData = NULL;
              * pEventData = & pSock->EventData;
              */
+            cc31k_set_fd_state(pSock->EventData.sd, SOCK_STATE_ERR);
             switch(pSock->EventData.status)
             {
                 case SL_ECLOSE:
@@ -1094,4 +1606,22 @@ void SimpleLinkSockEventHandler(SlSockEvent_t *pSock)
     }
 }
 
+// --------------------------------------------------------------------------------------
+//    This function handles the result of every completed select
+//
+//    readFds and writeFds are bitmasks of the socket ids that are ready
+//
+// --------------------------------------------------------------------------------------
+void SimpleLinkSockSelectEventHandler(uint16_t readFds, uint16_t writeFds)
+{
+    for (int fd = 0; fd <= BSD_SOCKET_ID_MASK; fd++) {
+        if (readFds & (1 << fd)) {
+            fd_state[fd] |= SOCK_STATE_RD;
+        }
+        if (writeFds & (1 << fd)) {
+            fd_state[fd] |= SOCK_STATE_WR;
+        }
+    }
+}
+
 
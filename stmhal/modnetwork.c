@@ -66,6 +66,144 @@ STATIC mp_obj_t network_route(void) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(network_route_obj, network_route);
 
+/******************************************************************************/
+// DNS cache
+//
+// Name lookups are shared by all NICs and kept for a fixed time, since none
+// of the NICs report the TTL of a record.  Failed lookups are kept too, for
+// a shorter time, so that a reconnect loop does not hammer the resolver.
+
+#ifndef MOD_NETWORK_DNS_CACHE_SIZE
+#define MOD_NETWORK_DNS_CACHE_SIZE (8)
+#endif
+
+#ifndef MOD_NETWORK_DNS_NAME_MAX
+#define MOD_NETWORK_DNS_NAME_MAX (63) // longer names are looked up but not cached
+#endif
+
+#ifndef MOD_NETWORK_DNS_TTL_MS
+#define MOD_NETWORK_DNS_TTL_MS (5 * 60 * 1000)
+#endif
+
+#ifndef MOD_NETWORK_DNS_NEG_TTL_MS
+#define MOD_NETWORK_DNS_NEG_TTL_MS (10 * 1000)
+#endif
+
+typedef struct _dns_cache_entry_t {
+    uint32_t expires;   // HAL_GetTick() value at which the entry goes stale
+    uint32_t used;      // HAL_GetTick() value of the last hit, for eviction
+    int err;            // 0 for a resolved name, else the error of the lookup
+    uint8_t ip[MOD_NETWORK_IPADDR_BUF_SIZE];
+    uint8_t len;        // 0 for a free entry
+    char name[MOD_NETWORK_DNS_NAME_MAX];
+} dns_cache_entry_t;
+
+STATIC dns_cache_entry_t dns_cache[MOD_NETWORK_DNS_CACHE_SIZE];
+
+STATIC dns_cache_entry_t *dns_cache_find(const char *name, mp_uint_t len) {
+    for (mp_uint_t i = 0; i < MOD_NETWORK_DNS_CACHE_SIZE; i++) {
+        dns_cache_entry_t *e = &dns_cache[i];
+        if (e->len == len && memcmp(e->name, name, len) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+STATIC void dns_cache_store(const char *name, mp_uint_t len, int err, const uint8_t *ip) {
+    if (len == 0 || len > MOD_NETWORK_DNS_NAME_MAX) {
+        return;
+    }
+    uint32_t now = HAL_GetTick();
+    dns_cache_entry_t *e = dns_cache_find(name, len);
+    if (e == NULL) {
+        // take a free or stale entry, else the least recently used one
+        e = &dns_cache[0];
+        for (mp_uint_t i = 0; i < MOD_NETWORK_DNS_CACHE_SIZE; i++) {
+            dns_cache_entry_t *c = &dns_cache[i];
+            if (c->len == 0 || (int32_t)(c->expires - now) <= 0) {
+                e = c;
+                break;
+            }
+            if ((int32_t)(c->used - e->used) < 0) {
+                e = c;
+            }
+        }
+        memcpy(e->name, name, len);
+        e->len = len;
+    }
+    e->err = err;
+    if (err == 0) {
+        memcpy(e->ip, ip, MOD_NETWORK_IPADDR_BUF_SIZE);
+    }
+    e->used = now;
+    e->expires = now + (err == 0 ? MOD_NETWORK_DNS_TTL_MS : MOD_NETWORK_DNS_NEG_TTL_MS);
+}
+
+STATIC int mod_network_resolve(const char *name, mp_uint_t len, uint8_t *out_ip) {
+    // use the first NIC that can do a name lookup
+    for (mp_uint_t i = 0; i < mod_network_nic_list.len; i++) {
+        mp_obj_t nic = mod_network_nic_list.items[i];
+        mod_network_nic_type_t *nic_type = (mod_network_nic_type_t*)mp_obj_get_type(nic);
+        if (nic_type->gethostbyname != NULL) {
+            int ret = nic_type->gethostbyname(nic, name, len, out_ip);
+            dns_cache_store(name, len, ret, out_ip);
+            return ret;
+        }
+    }
+    nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "no available NIC"));
+}
+
+// Look up name, from the cache if it holds a fresh answer, else through the
+// first NIC that can.  Returns 0 and fills out_ip on success, else the error
+// of the (possibly cached) failed lookup.
+int mod_network_gethostbyname(const char *name, mp_uint_t len, uint8_t *out_ip) {
+    dns_cache_entry_t *e = dns_cache_find(name, len);
+    if (e != NULL) {
+        uint32_t now = HAL_GetTick();
+        if ((int32_t)(e->expires - now) > 0) {
+            e->used = now;
+            if (e->err == 0) {
+                memcpy(out_ip, e->ip, MOD_NETWORK_IPADDR_BUF_SIZE);
+            }
+            return e->err;
+        }
+    }
+    return mod_network_resolve(name, len, out_ip);
+}
+
+/// \function dns_flush([host])
+/// Drop `host` from the DNS cache, or the whole cache if no host is given.
+STATIC mp_obj_t network_dns_flush(mp_uint_t n_args, const mp_obj_t *args) {
+    if (n_args == 0) {
+        memset(dns_cache, 0, sizeof(dns_cache));
+    } else {
+        mp_uint_t len;
+        const char *name = mp_obj_str_get_data(args[0], &len);
+        dns_cache_entry_t *e = dns_cache_find(name, len);
+        if (e != NULL) {
+            e->len = 0;
+        }
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(network_dns_flush_obj, 0, 1, network_dns_flush);
+
+/// \function dns_prefetch(host)
+/// Look up `host` now, whatever the cache holds, and cache the answer.
+/// Returns the IP address as a string.
+STATIC mp_obj_t network_dns_prefetch(mp_obj_t host_in) {
+    mp_uint_t len;
+    const char *name = mp_obj_str_get_data(host_in, &len);
+    uint8_t out_ip[MOD_NETWORK_IPADDR_BUF_SIZE];
+    int ret = mod_network_resolve(name, len, out_ip);
+    if (ret != 0) {
+        nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(ret)));
+    }
+    return mod_network_format_ipv4_addr(out_ip);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(network_dns_prefetch_obj, network_dns_prefetch);
+
 STATIC const mp_map_elem_t mp_module_network_globals_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR___name__), MP_OBJ_NEW_QSTR(MP_QSTR_network) },
 
@@ -80,6 +218,8 @@ STATIC const mp_map_elem_t mp_module_network_globals_table[] = {
     #endif
 
     { MP_OBJ_NEW_QSTR(MP_QSTR_route), (mp_obj_t)&network_route_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_dns_flush), (mp_obj_t)&network_dns_flush_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_dns_prefetch), (mp_obj_t)&network_dns_prefetch_obj },
 };
 
 STATIC const mp_obj_dict_t mp_module_network_globals = {
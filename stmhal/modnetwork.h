@@ -39,8 +39,18 @@ typedef struct _mod_network_nic_type_t {
     // API for a generic NIC
     mp_obj_t (*socket)(mp_obj_t nic, int domain, int type, int fileno, int *_errno);
     int (*gethostbyname)(mp_obj_t nic, const char *name, mp_uint_t len, uint8_t *ip_out);
+
+    // Optional batched poll over sockets of type socket_type.  On entry flags[i]
+    // holds the MP_IOCTL_POLL_xxx events wanted for socket[i], on return the
+    // events that are ready.  Waits up to timeout ms (-1 for no limit) for one
+    // to become ready, and returns the number ready or -1 with *_errno set.
+    const mp_obj_type_t *socket_type;
+    mp_int_t (*poll)(mp_obj_t nic, mp_uint_t n, const mp_obj_t *socket, mp_uint_t *flags, mp_uint_t timeout, int *_errno);
 } mod_network_nic_type_t;
 
+// maximum number of sockets handed to a NIC's poll in one call
+#define MOD_NETWORK_POLL_MAX (16)
+
 extern struct _mp_obj_list_t mod_network_nic_list;
 extern const mod_network_nic_type_t mod_network_nic_type_wiznet5k;
 extern const mod_network_nic_type_t mod_network_nic_type_cc3k;
@@ -48,6 +58,7 @@ extern const mod_network_nic_type_t mod_network_nic_type_cc31k;
 
 void mod_network_init(void);
 void mod_network_register_nic(mp_obj_t nic);
+int mod_network_gethostbyname(const char *name, mp_uint_t len, uint8_t *out_ip);
 
 void mod_network_parse_ipv4_addr(mp_obj_t addr_in, uint8_t *out_ip);
 mp_uint_t mod_network_parse_inet_addr(mp_obj_t addr_in, uint8_t *out_ip);
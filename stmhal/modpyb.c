@@ -59,6 +59,7 @@
 #include "lcd.h"
 #include "usb.h"
 #include "pybstdio.h"
+#include "pyblog.h"
 #include "ff.h"
 #include "portmodules.h"
 
@@ -156,6 +157,14 @@ STATIC mp_obj_t pyb_info(mp_uint_t n_args, const mp_obj_t *args) {
         printf("LFS free: %u bytes\n", (uint)(nclst * fatfs->csize * 512));
     }
 
+    // flash cache counters
+    {
+        storage_stats_t stats;
+        storage_get_stats(&stats);
+        printf("flash cache:\n  hits=%lu misses=%lu evictions=%lu\n  erases=%lu blocks_programmed=%lu\n",
+               stats.cache_hits, stats.cache_misses, stats.cache_evictions, stats.erases, stats.blocks_programmed);
+    }
+
     if (n_args == 1) {
         // arg given means dump gc allocation table
         gc_dump_alloc_table();
@@ -507,6 +516,10 @@ STATIC const mp_map_elem_t pyb_module_globals_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_SD), (mp_obj_t)&pyb_sdcard_obj },
 #endif
 
+#if MICROPY_HW_ENABLE_LOG
+    { MP_OBJ_NEW_QSTR(MP_QSTR_Log), (mp_obj_t)&pyb_log_type },
+#endif
+
     { MP_OBJ_NEW_QSTR(MP_QSTR_LED), (mp_obj_t)&pyb_led_type },
     { MP_OBJ_NEW_QSTR(MP_QSTR_I2C), (mp_obj_t)&pyb_i2c_type },
     { MP_OBJ_NEW_QSTR(MP_QSTR_SPI), (mp_obj_t)&pyb_spi_type },
@@ -37,6 +37,7 @@
 #include "rng.h"
 #include "storage.h"
 #include "ff.h"
+#include "fscache.h"
 #include "file.h"
 #include "sdcard.h"
 #include "portmodules.h"
@@ -79,6 +80,9 @@ STATIC mp_obj_t os_chdir(mp_obj_t path_in) {
         res = f_chdir(path);
     }
 
+    // relative paths in the stat cache now refer to somewhere else
+    fscache_invalidate();
+
     if (res != FR_OK) {
         // TODO should be mp_type_FileNotFoundError
         nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_OSError, "No such file or directory: '%s'", path));
@@ -185,6 +189,7 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(os_listdir_obj, 0, 1, os_listdir);
 STATIC mp_obj_t os_mkdir(mp_obj_t path_o) {
     const char *path = mp_obj_str_get_str(path_o);
     FRESULT res = f_mkdir(path);
+    fscache_invalidate();
     switch (res) {
         case FR_OK:
             return mp_const_none;
@@ -203,6 +208,7 @@ STATIC mp_obj_t os_remove(mp_obj_t path_o) {
     const char *path = mp_obj_str_get_str(path_o);
     // TODO check that path is actually a file before trying to unlink it
     FRESULT res = f_unlink(path);
+    fscache_invalidate();
     switch (res) {
         case FR_OK:
             return mp_const_none;
@@ -218,6 +224,7 @@ STATIC mp_obj_t os_rmdir(mp_obj_t path_o) {
     const char *path = mp_obj_str_get_str(path_o);
     // TODO check that path is actually a directory before trying to unlink it
     FRESULT res = f_unlink(path);
+    fscache_invalidate();
     switch (res) {
         case FR_OK:
             return mp_const_none;
@@ -266,7 +273,7 @@ STATIC mp_obj_t os_stat(mp_obj_t path_in) {
 	fno.ftime = 0;
 	fno.fattrib = AM_DIR;
     } else {
-        res = f_stat(path, &fno);
+        res = fscache_stat(path, &fno);
         if (res != FR_OK) {
             goto error;
         }
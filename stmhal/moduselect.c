@@ -37,6 +37,7 @@
 #include "obj.h"
 #include "objlist.h"
 #include "pybioctl.h"
+#include "modnetwork.h"
 
 /// \module select - Provides select function to wait for events on a stream
 ///
@@ -47,6 +48,7 @@ typedef struct _poll_obj_t {
     mp_uint_t (*ioctl)(mp_obj_t obj, mp_uint_t request, int *errcode, ...);
     mp_uint_t flags;
     mp_uint_t flags_ret;
+    bool batched;
 } poll_obj_t;
 
 STATIC void poll_map_add(mp_map_t *poll_map, const mp_obj_t *obj, mp_uint_t obj_len, mp_uint_t flags, bool or_flags) {
@@ -63,6 +65,7 @@ STATIC void poll_map_add(mp_map_t *poll_map, const mp_obj_t *obj, mp_uint_t obj_
             poll_obj->ioctl = type->stream_p->ioctl;
             poll_obj->flags = flags;
             poll_obj->flags_ret = 0;
+            poll_obj->batched = false;
             elem->value = poll_obj;
         } else {
             // object exists; update its flags
@@ -75,8 +78,50 @@ STATIC void poll_map_add(mp_map_t *poll_map, const mp_obj_t *obj, mp_uint_t obj_
     }
 }
 
-// poll each object in the map
-STATIC mp_uint_t poll_map_poll(mp_map_t *poll_map, mp_uint_t *rwx_num) {
+// Poll the sockets of each NIC that has a batched poll with a single call.
+// The NIC is allowed to wait for up to timeout ms only if its sockets are the
+// only objects in the map, otherwise it must return straight away.
+STATIC void poll_map_poll_nics(mp_map_t *poll_map, mp_uint_t timeout) {
+    for (mp_uint_t n = 0; n < mod_network_nic_list.len; n++) {
+        mp_obj_t nic = mod_network_nic_list.items[n];
+        mod_network_nic_type_t *nic_type = (mod_network_nic_type_t*)mp_obj_get_type(nic);
+        if (nic_type->poll == NULL) {
+            continue;
+        }
+
+        poll_obj_t *poll_obj[MOD_NETWORK_POLL_MAX];
+        mp_obj_t socket[MOD_NETWORK_POLL_MAX];
+        mp_uint_t flags[MOD_NETWORK_POLL_MAX];
+        mp_uint_t n_socket = 0;
+        for (mp_uint_t i = 0; i < poll_map->alloc && n_socket < MOD_NETWORK_POLL_MAX; ++i) {
+            if (!MP_MAP_SLOT_IS_FILLED(poll_map, i)) {
+                continue;
+            }
+            poll_obj_t *p = (poll_obj_t*)poll_map->table[i].value;
+            if (!p->batched && mp_obj_get_type(p->obj) == nic_type->socket_type) {
+                poll_obj[n_socket] = p;
+                socket[n_socket] = p->obj;
+                flags[n_socket] = p->flags;
+                n_socket += 1;
+            }
+        }
+        if (n_socket == 0) {
+            continue;
+        }
+
+        int errcode;
+        if (nic_type->poll(nic, n_socket, socket, flags, n_socket == poll_map->used ? timeout : 0, &errcode) == -1) {
+            nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(errcode)));
+        }
+        for (mp_uint_t i = 0; i < n_socket; i++) {
+            poll_obj[i]->flags_ret = flags[i];
+            poll_obj[i]->batched = true;
+        }
+    }
+}
+
+// collect the results of the objects in the map, polling those not done by a NIC
+STATIC mp_uint_t poll_map_collect(mp_map_t *poll_map, mp_uint_t *rwx_num) {
     mp_uint_t n_ready = 0;
     for (mp_uint_t i = 0; i < poll_map->alloc; ++i) {
         if (!MP_MAP_SLOT_IS_FILLED(poll_map, i)) {
@@ -84,13 +129,19 @@ STATIC mp_uint_t poll_map_poll(mp_map_t *poll_map, mp_uint_t *rwx_num) {
         }
 
         poll_obj_t *poll_obj = (poll_obj_t*)poll_map->table[i].value;
-        int errcode;
-        mp_int_t ret = poll_obj->ioctl(poll_obj->obj, MP_IOCTL_POLL, &errcode, poll_obj->flags);
-        poll_obj->flags_ret = ret;
+        mp_int_t ret;
+        if (poll_obj->batched) {
+            poll_obj->batched = false;
+            ret = poll_obj->flags_ret;
+        } else {
+            int errcode;
+            ret = poll_obj->ioctl(poll_obj->obj, MP_IOCTL_POLL, &errcode, poll_obj->flags);
+            poll_obj->flags_ret = ret;
 
-        if (ret == -1) {
-            // error doing ioctl
-            nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(errcode)));
+            if (ret == -1) {
+                // error doing ioctl
+                nlr_raise(mp_obj_new_exception_arg1(&mp_type_OSError, MP_OBJ_NEW_SMALL_INT(errcode)));
+            }
         }
 
         if (ret != 0) {
@@ -112,6 +163,36 @@ STATIC mp_uint_t poll_map_poll(mp_map_t *poll_map, mp_uint_t *rwx_num) {
     return n_ready;
 }
 
+// poll each object in the map, waiting up to timeout ms if the NIC can do so
+STATIC mp_uint_t poll_map_poll(mp_map_t *poll_map, mp_uint_t *rwx_num, mp_uint_t timeout) {
+    mp_uint_t n_ready = 0;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        poll_map_poll_nics(poll_map, timeout);
+        n_ready = poll_map_collect(poll_map, rwx_num);
+        nlr_pop();
+    } else {
+        // a Poll object keeps its map, so results from the NICs that did poll
+        // must not be taken as fresh by the next poll
+        for (mp_uint_t i = 0; i < poll_map->alloc; ++i) {
+            if (MP_MAP_SLOT_IS_FILLED(poll_map, i)) {
+                ((poll_obj_t*)poll_map->table[i].value)->batched = false;
+            }
+        }
+        nlr_raise(nlr.ret_val);
+    }
+    return n_ready;
+}
+
+// time left until timeout ms after start_tick, or -1 if there is no timeout
+STATIC mp_uint_t poll_timeout_left(mp_uint_t start_tick, mp_uint_t timeout) {
+    if (timeout == -1) {
+        return -1;
+    }
+    mp_uint_t elapsed = HAL_GetTick() - start_tick;
+    return elapsed >= timeout ? 0 : timeout - elapsed;
+}
+
 /// \function select(rlist, wlist, xlist[, timeout])
 STATIC mp_obj_t select_select(uint n_args, const mp_obj_t *args) {
     // get array data from tuple/list arguments
@@ -147,7 +228,7 @@ STATIC mp_obj_t select_select(uint n_args, const mp_obj_t *args) {
     rwx_len[0] = rwx_len[1] = rwx_len[2] = 0;
     for (;;) {
         // poll the objects
-        mp_uint_t n_ready = poll_map_poll(&poll_map, rwx_len);
+        mp_uint_t n_ready = poll_map_poll(&poll_map, rwx_len, poll_timeout_left(start_tick, timeout));
 
         if (n_ready > 0 || (timeout != -1 && HAL_GetTick() - start_tick >= timeout)) {
             // one or more objects are ready, or we had a timeout
@@ -240,7 +321,7 @@ STATIC mp_obj_t poll_poll(uint n_args, const mp_obj_t *args) {
     mp_uint_t start_tick = HAL_GetTick();
     for (;;) {
         // poll the objects
-        mp_uint_t n_ready = poll_map_poll(&self->poll_map, NULL);
+        mp_uint_t n_ready = poll_map_poll(&self->poll_map, NULL, poll_timeout_left(start_tick, timeout));
 
         if (n_ready > 0 || (timeout != -1 && HAL_GetTick() - start_tick >= timeout)) {
             // one or more objects are ready, or we had a timeout
@@ -48,9 +48,20 @@
 */
 #define MICROPY_ENABLE_LFN          (1)
 #define MICROPY_LFN_CODE_PAGE       (437) /* 1=SFN/ANSI 437=LFN/U.S.(OEM) */
+/* FatFS file buffering
+    MICROPY_FATFS_TINY: 1 shares the volume's sector buffer between all open
+        files (saves 512 bytes per file); 0 gives each file its own buffer so
+        partial-sector file I/O doesn't thrash the FAT/directory window.
+    MICROPY_FATFS_FASTSEEK: build a cluster link map table on open for files
+        opened read-only, so seeks don't walk the FAT chain.
+*/
+#define MICROPY_FATFS_TINY          (0)
+#define MICROPY_FATFS_FASTSEEK      (1)
 #define MICROPY_MODULE_WEAK_LINKS   (1)
 #define MICROPY_PY_BUILTINS_STR_UNICODE (1)
 #define MICROPY_PY_BUILTINS_MEMORYVIEW (1)
+#define MICROPY_PY_ARRAY_SLICE_ASSIGN (1)
+#define MICROPY_PY_STR_FORMAT_CACHE (4)
 #define MICROPY_PY_BUILTINS_FROZENSET (1)
 #define MICROPY_PY_SYS_EXIT         (1)
 #define MICROPY_PY_SYS_STDFILES     (1)
@@ -167,6 +178,11 @@ static inline mp_uint_t disable_irq(void) {
 // board specific definitions
 #include "mpconfigboard.h"
 
+// pyb.Log keeps its records in flash sectors the firmware doesn't use
+#ifndef MICROPY_HW_ENABLE_LOG
+#define MICROPY_HW_ENABLE_LOG (1)
+#endif
+
 // We need to provide a declaration/definition of alloca()
 #include <alloca.h>
 
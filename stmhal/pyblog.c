@@ -0,0 +1,163 @@
+/*
+ * This file is part of the Micro Python project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013, 2014 Damien P. George
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdint.h>
+
+#include "mpconfig.h"
+#include "nlr.h"
+#include "misc.h"
+#include "qstr.h"
+#include "obj.h"
+#include "runtime.h"
+#include "storage.h"
+#include "flashlog.h"
+#include "pyblog.h"
+
+#if MICROPY_HW_ENABLE_LOG
+
+/// \moduleref pyb
+/// \class Log - append-only record store on the internal flash
+///
+/// Log keeps a sequence of records (bytes objects) in flash sectors of its
+/// own, outside the filesystem.  Appending a record programs it straight
+/// into flash with a CRC, so a reset loses at most the record being written
+/// and never damages the ones before it.  When the log is full the oldest
+/// records are dropped to make room.
+///
+/// Example usage:
+///
+///     log = pyb.Log()
+///     log.append(b'12.5,3.3')
+///     for rec in log:
+///         print(rec)
+
+// sectors 9, 10 and 11, beyond the end of the firmware; see stm32f405.ld
+#ifndef MICROPY_HW_LOG_START_ADDR
+#define MICROPY_HW_LOG_START_ADDR (0x080a0000)
+#endif
+#ifndef MICROPY_HW_LOG_SECTOR_SIZE
+#define MICROPY_HW_LOG_SECTOR_SIZE (0x20000)
+#endif
+#ifndef MICROPY_HW_LOG_NUM_SECTORS
+#define MICROPY_HW_LOG_NUM_SECTORS (3)
+#endif
+
+typedef struct _pyb_log_it_t {
+    mp_obj_base_t base;
+    flashlog_iter_t iter;
+} pyb_log_it_t;
+
+STATIC flashlog_t pyb_log = {
+    .base = MICROPY_HW_LOG_START_ADDR,
+    .sector_size = MICROPY_HW_LOG_SECTOR_SIZE,
+    .num_sectors = MICROPY_HW_LOG_NUM_SECTORS,
+    .erase = storage_direct_erase,
+    .program = storage_direct_program,
+};
+STATIC bool pyb_log_mounted = false;
+
+STATIC const mp_obj_base_t pyb_log_obj = {&pyb_log_type};
+
+/// \classmethod \constructor()
+/// Return the Log object.  There is one log; the first call finds the end
+/// of the records already in it.
+STATIC mp_obj_t pyb_log_make_new(mp_obj_t type_in, mp_uint_t n_args, mp_uint_t n_kw, const mp_obj_t *args) {
+    mp_arg_check_num(n_args, n_kw, 0, 0, false);
+    if (!pyb_log_mounted) {
+        flashlog_mount(&pyb_log);
+        pyb_log_mounted = true;
+    }
+    return (mp_obj_t)&pyb_log_obj;
+}
+
+/// \method append(buf)
+/// Add `buf` to the end of the log as a new record.  This may erase the
+/// oldest sector of records, which takes a second or two.
+STATIC mp_obj_t pyb_log_append(mp_obj_t self_in, mp_obj_t buf_in) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_READ);
+    if (flashlog_append(&pyb_log, bufinfo.buf, bufinfo.len) != FLASHLOG_OK) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "records can be at most %u bytes", flashlog_max_record_len(&pyb_log)));
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(pyb_log_append_obj, pyb_log_append);
+
+/// \method clear()
+/// Erase all the records.
+STATIC mp_obj_t pyb_log_clear(mp_obj_t self_in) {
+    flashlog_clear(&pyb_log);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(pyb_log_clear_obj, pyb_log_clear);
+
+STATIC mp_obj_t pyb_log_it_iternext(mp_obj_t self_in) {
+    pyb_log_it_t *self = self_in;
+    const uint8_t *data;
+    uint32_t len;
+    switch (flashlog_iter_next(&pyb_log, &self->iter, &data, &len)) {
+        case FLASHLOG_OK:
+            return mp_obj_new_bytes(data, len);
+        case FLASHLOG_LOST:
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_RuntimeError, "log records overwritten during iteration"));
+        default:
+            return MP_OBJ_STOP_ITERATION;
+    }
+}
+
+STATIC const mp_obj_type_t pyb_log_it_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_iterator,
+    .getiter = mp_identity,
+    .iternext = pyb_log_it_iternext,
+};
+
+/// \method __iter__()
+/// Iterate over the records, oldest first, as bytes objects.  Records that
+/// fail their CRC are skipped.
+STATIC mp_obj_t pyb_log_getiter(mp_obj_t self_in) {
+    pyb_log_it_t *o = m_new_obj(pyb_log_it_t);
+    o->base.type = &pyb_log_it_type;
+    flashlog_iter_init(&pyb_log, &o->iter);
+    return o;
+}
+
+STATIC const mp_map_elem_t pyb_log_locals_dict_table[] = {
+    { MP_OBJ_NEW_QSTR(MP_QSTR_append), (mp_obj_t)&pyb_log_append_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_clear), (mp_obj_t)&pyb_log_clear_obj },
+};
+
+STATIC MP_DEFINE_CONST_DICT(pyb_log_locals_dict, pyb_log_locals_dict_table);
+
+const mp_obj_type_t pyb_log_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_Log,
+    .make_new = pyb_log_make_new,
+    .getiter = pyb_log_getiter,
+    .locals_dict = (mp_obj_t)&pyb_log_locals_dict,
+};
+
+#endif // MICROPY_HW_ENABLE_LOG
@@ -77,6 +77,7 @@ Q(time)
 Q(rng)
 Q(SD)
 Q(SDcard)
+Q(Log)
 Q(FileIO)
 Q(flush)
 // Entries for sys.path
@@ -162,6 +163,7 @@ Q(bits)
 Q(stop)
 Q(parity)
 Q(read_buf_len)
+Q(write_buf_len)
 Q(buf)
 Q(len)
 Q(timeout)
@@ -383,6 +385,8 @@ Q(SOCK_RAW)
 // for network module
 Q(network)
 Q(route)
+Q(dns_flush)
+Q(dns_prefetch)
 
 // for WIZnet5k class
 #if MICROPY_PY_WIZNET5K
@@ -451,6 +455,7 @@ Q(sleep)
 Q(ifconfig)
 Q(patch_version)
 Q(patch_program)
+Q(pool_stats)
 Q(WEP)
 Q(WPA)
 Q(WPA2)
@@ -459,7 +464,17 @@ Q(key)
 Q(security)
 Q(bssid)
 Q(send)
+Q(sendall)
+Q(sendfile)
 Q(recv)
+Q(setrxbuf)
+Q(sendto)
+Q(recvfrom)
+Q(sendmmsg)
+Q(recvmmsg)
+Q(read)
+Q(readline)
+Q(write)
 Q(bind)
 Q(listen)
 Q(accept)
@@ -24,8 +24,7 @@
  * THE SOFTWARE.
  */
 
-// TODO make it work with DMA
-
+#include <string.h>
 #include <stm32f4xx_hal.h>
 
 #include "mpconfig.h"
@@ -41,7 +40,48 @@
 
 #if MICROPY_HW_HAS_SDCARD
 
+// The SDIO DMA requests are on channel 4 of DMA2 stream 3 (RX) and stream 6
+// (TX).  The SDIO interrupt must be able to preempt the DMA one, whose
+// completion callback in the HAL spins until the SDIO data-end flag is seen,
+// and both must be able to preempt USB, whose mass storage callbacks do SD
+// transfers from within its interrupt.
+#define SD_DMA_RX_STREAM DMA2_Stream3
+#define SD_DMA_RX_IRQN DMA2_Stream3_IRQn
+#define SD_DMA_TX_STREAM DMA2_Stream6
+#define SD_DMA_TX_IRQN DMA2_Stream6_IRQn
+#define SD_DMA_CHANNEL DMA_CHANNEL_4
+#define SD_IRQ_PRI (4)
+#define SD_DMA_IRQ_PRI (5)
+
+// longest a multi-block transfer may take, from start to the card being
+// ready again, before it is abandoned
+#define SD_TIMEOUT_MS (5000)
+
+// the CCM RAM is not reachable by the DMA
+#define SD_DMA_ADDR_OK(addr) (((uint32_t)(addr) & 3) == 0 && (uint32_t)(addr) >= 0x20000000)
+
 static SD_HandleTypeDef sd_handle;
+static DMA_HandleTypeDef sd_rx_dma;
+static DMA_HandleTypeDef sd_tx_dma;
+static volatile bool sd_dma_error;
+static volatile bool sd_busy;
+
+// A transfer started by one of the sdcard_*_blocks_start functions runs on
+// after the call returns, keeping the card claimed, until it is collected
+// by sdcard_transfer_finish.  If the main program wants the card before
+// then it waits for the transfer itself and keeps the result for later.
+#define SD_BG_NONE (0)
+#define SD_BG_RUNNING (1)
+#define SD_BG_FINISHING (2)
+#define SD_BG_DONE (3)
+static volatile uint8_t sd_bg_state;
+static bool sd_bg_write;
+static uint32_t sd_bg_start;
+static HAL_SD_ErrorTypedef sd_bg_err;
+
+// buffers the DMA cannot use directly are transferred through this, a block
+// at a time
+static uint32_t sd_bounce_buf[SDCARD_BLOCK_SIZE / 4];
 
 void sdcard_init(void) {
     GPIO_InitTypeDef GPIO_Init_Structure;
@@ -70,20 +110,75 @@ void sdcard_init(void) {
     HAL_GPIO_Init(MICROPY_HW_SDCARD_DETECT_PIN.gpio, &GPIO_Init_Structure);
 }
 
+STATIC void sdcard_dma_init_stream(DMA_HandleTypeDef *dma, DMA_Stream_TypeDef *stream, uint32_t direction, IRQn_Type irqn) {
+    dma->Instance                   = stream;
+    dma->State                      = HAL_DMA_STATE_RESET;
+    dma->Init.Channel               = SD_DMA_CHANNEL;
+    dma->Init.Direction             = direction;
+    dma->Init.PeriphInc             = DMA_PINC_DISABLE;
+    dma->Init.MemInc                = DMA_MINC_ENABLE;
+    dma->Init.PeriphDataAlignment   = DMA_PDATAALIGN_WORD;
+    dma->Init.MemDataAlignment      = DMA_MDATAALIGN_WORD;
+    dma->Init.Mode                  = DMA_PFCTRL; // the SDIO decides when the transfer ends
+    dma->Init.Priority              = DMA_PRIORITY_VERY_HIGH;
+    dma->Init.FIFOMode              = DMA_FIFOMODE_ENABLE;
+    dma->Init.FIFOThreshold         = DMA_FIFO_THRESHOLD_FULL;
+    dma->Init.MemBurst              = DMA_MBURST_INC4;
+    dma->Init.PeriphBurst           = DMA_PBURST_INC4;
+    HAL_DMA_DeInit(dma);
+    HAL_DMA_Init(dma);
+
+    HAL_NVIC_SetPriority(irqn, SD_DMA_IRQ_PRI, 0);
+    HAL_NVIC_EnableIRQ(irqn);
+}
+
 void HAL_SD_MspInit(SD_HandleTypeDef *hsd) {
     // enable SDIO clock
     __SDIO_CLK_ENABLE();
 
     // GPIO have already been initialised by sdcard_init
 
-    // interrupts are not used at the moment
-    // they are needed only for DMA transfer (I think...)
+    // the SDIO interrupt reports the end of the data phase and errors, and
+    // the DMA streams move the data
+    __DMA2_CLK_ENABLE();
+    sdcard_dma_init_stream(&sd_rx_dma, SD_DMA_RX_STREAM, DMA_PERIPH_TO_MEMORY, SD_DMA_RX_IRQN);
+    sdcard_dma_init_stream(&sd_tx_dma, SD_DMA_TX_STREAM, DMA_MEMORY_TO_PERIPH, SD_DMA_TX_IRQN);
+    __HAL_LINKDMA(hsd, hdmarx, sd_rx_dma);
+    __HAL_LINKDMA(hsd, hdmatx, sd_tx_dma);
+
+    HAL_NVIC_SetPriority(SDIO_IRQn, SD_IRQ_PRI, 0);
+    HAL_NVIC_EnableIRQ(SDIO_IRQn);
 }
 
 void HAL_SD_MspDeInit(SD_HandleTypeDef *hsd) {
+    HAL_NVIC_DisableIRQ(SDIO_IRQn);
+    HAL_NVIC_DisableIRQ(SD_DMA_RX_IRQN);
+    HAL_NVIC_DisableIRQ(SD_DMA_TX_IRQN);
+    HAL_DMA_DeInit(&sd_rx_dma);
+    HAL_DMA_DeInit(&sd_tx_dma);
     __SDIO_CLK_DISABLE();
 }
 
+void sdcard_irq_handler(void) {
+    HAL_SD_IRQHandler(&sd_handle);
+}
+
+void sdcard_dma_irq_handler(int stream) {
+    if (stream == 3) {
+        HAL_DMA_IRQHandler(&sd_rx_dma);
+    } else {
+        HAL_DMA_IRQHandler(&sd_tx_dma);
+    }
+}
+
+void HAL_SD_DMA_RxErrorCallback(DMA_HandleTypeDef *hdma) {
+    sd_dma_error = true;
+}
+
+void HAL_SD_DMA_TxErrorCallback(DMA_HandleTypeDef *hdma) {
+    sd_dma_error = true;
+}
+
 bool sdcard_is_present(void) {
     return HAL_GPIO_ReadPin(MICROPY_HW_SDCARD_DETECT_PIN.gpio, MICROPY_HW_SDCARD_DETECT_PIN.pin_mask) == MICROPY_HW_SDCARD_DETECT_PRESENT;
 }
@@ -127,10 +222,13 @@ error:
     return false;
 }
 
+STATIC bool sdcard_transfer_complete(void);
+
 void sdcard_power_off(void) {
     if (!sd_handle.Instance) {
         return;
     }
+    sdcard_transfer_complete();
     HAL_SD_DeInit(&sd_handle); 
     sd_handle.Instance = NULL;
 }
@@ -144,101 +242,192 @@ uint64_t sdcard_get_capacity_in_bytes(void) {
     return cardinfo.CardCapacity;
 }
 
-mp_uint_t sdcard_read_blocks(uint8_t *dest, uint32_t block_num, uint32_t num_blocks) {
-    // check that dest pointer is aligned on a 4-byte boundary
-    if (((uint32_t)dest & 3) != 0) {
+// Wait for the DMA transfer the HAL just started to end, sleeping between
+// interrupts, then let the HAL stop the transfer and wait for the card.
+STATIC HAL_SD_ErrorTypedef sdcard_wait_finished(DMA_HandleTypeDef *dma, bool write, uint32_t start) {
+    while (!sd_handle.DmaTransferCplt || !sd_handle.SdTransferCplt) {
+        if (sd_handle.SdTransferErr != SD_OK || sd_dma_error) {
+            break;
+        }
+        if (HAL_GetTick() - start >= SD_TIMEOUT_MS) {
+            HAL_DMA_Abort(dma);
+            __HAL_SD_SDIO_DMA_DISABLE();
+            HAL_SD_StopTransfer(&sd_handle);
+            return SD_DATA_TIMEOUT;
+        }
+        __WFI();
+    }
+    if (sd_dma_error || sd_handle.SdTransferErr != SD_OK) {
+        HAL_DMA_Abort(dma);
+    }
+    if (sd_dma_error) {
+        HAL_SD_StopTransfer(&sd_handle);
         return SD_ERROR;
     }
 
-    // check that SD card is initialised
-    if (sd_handle.Instance == NULL) {
-        return SD_ERROR;
+    // the data is all through by now, so these return at once apart from the
+    // write case waiting for the card to finish programming
+    if (write) {
+        return HAL_SD_CheckWriteOperation(&sd_handle, 100000000);
+    } else {
+        return HAL_SD_CheckReadOperation(&sd_handle, 100000000);
     }
+}
 
-    // We must disable IRQs because the SDIO peripheral has a small FIFO
-    // buffer and we can't let it fill up in the middle of a read.
-    // This will not be needed when SD uses DMA for transfer.
+STATIC HAL_SD_ErrorTypedef sdcard_read_blocks_dma(uint8_t *dest, uint32_t block_num, uint32_t num_blocks) {
+    uint32_t start = HAL_GetTick();
+    sd_dma_error = false;
+    HAL_SD_ErrorTypedef err = HAL_SD_ReadBlocks_BlockNumber_DMA(&sd_handle, (uint32_t*)dest, block_num, SDCARD_BLOCK_SIZE, num_blocks);
+    if (err == SD_OK) {
+        err = sdcard_wait_finished(&sd_rx_dma, false, start);
+    } else {
+        HAL_DMA_Abort(&sd_rx_dma);
+    }
+    return err;
+}
+
+STATIC HAL_SD_ErrorTypedef sdcard_write_blocks_dma(const uint8_t *src, uint32_t block_num, uint32_t num_blocks) {
+    uint32_t start = HAL_GetTick();
+    sd_dma_error = false;
+    HAL_SD_ErrorTypedef err = HAL_SD_WriteBlocks_BlockNumber_DMA(&sd_handle, (uint32_t*)src, block_num, SDCARD_BLOCK_SIZE, num_blocks);
+    if (err == SD_OK) {
+        err = sdcard_wait_finished(&sd_tx_dma, true, start);
+    } else {
+        HAL_DMA_Abort(&sd_tx_dma);
+    }
+    return err;
+}
+
+// Claim the SDIO peripheral.  Transfers run with interrupts enabled, so USB
+// mass storage can call in from its interrupt in the middle of one started
+// by the main program; that call fails and the host retries it.
+STATIC bool sdcard_acquire(void) {
     mp_uint_t atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
-    HAL_SD_ErrorTypedef err = HAL_SD_ReadBlocks_BlockNumber(&sd_handle, (uint32_t*)dest, block_num, SDCARD_BLOCK_SIZE, num_blocks);
+    bool ok = !sd_busy;
+    sd_busy = true;
     MICROPY_END_ATOMIC_SECTION(atomic_state);
+    return ok;
+}
 
-    return err;
+// Wait for a transfer left running in the background, if there is one, and
+// release the card.  Returns false if the transfer is already being waited
+// for by the code this call interrupted.
+STATIC bool sdcard_transfer_complete(void) {
+    mp_uint_t atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
+    uint8_t state = sd_bg_state;
+    if (state == SD_BG_RUNNING) {
+        sd_bg_state = SD_BG_FINISHING;
+    }
+    MICROPY_END_ATOMIC_SECTION(atomic_state);
+    if (state != SD_BG_RUNNING) {
+        return state != SD_BG_FINISHING;
+    }
+    sd_bg_err = sdcard_wait_finished(sd_bg_write ? &sd_tx_dma : &sd_rx_dma, sd_bg_write, sd_bg_start);
+    sd_bg_state = SD_BG_DONE;
+    sd_busy = false;
+    return true;
 }
 
-mp_uint_t sdcard_write_blocks(const uint8_t *src, uint32_t block_num, uint32_t num_blocks) {
-    // check that src pointer is aligned on a 4-byte boundary
-    if (((uint32_t)src & 3) != 0) {
+STATIC mp_uint_t sdcard_transfer_start(uint8_t *buf, uint32_t block_num, uint32_t num_blocks, bool write) {
+    if (sd_handle.Instance == NULL || !SD_DMA_ADDR_OK(buf)) {
         return SD_ERROR;
     }
 
-    // check that SD card is initialised
-    if (sd_handle.Instance == NULL) {
+    if (!sdcard_acquire()) {
         return SD_ERROR;
     }
 
-    // We must disable IRQs because the SDIO peripheral has a small FIFO
-    // buffer and we can't let it drain to empty in the middle of a write.
-    // This will not be needed when SD uses DMA for transfer.
-    mp_uint_t atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
-    HAL_SD_ErrorTypedef err = HAL_SD_WriteBlocks_BlockNumber(&sd_handle, (uint32_t*)src, block_num, SDCARD_BLOCK_SIZE, num_blocks);
-    MICROPY_END_ATOMIC_SECTION(atomic_state);
+    // any result not collected by now is of no further interest
+    sd_bg_state = SD_BG_NONE;
+    sd_bg_write = write;
+    sd_bg_start = HAL_GetTick();
+    sd_dma_error = false;
+    HAL_SD_ErrorTypedef err;
+    if (write) {
+        err = HAL_SD_WriteBlocks_BlockNumber_DMA(&sd_handle, (uint32_t*)buf, block_num, SDCARD_BLOCK_SIZE, num_blocks);
+    } else {
+        err = HAL_SD_ReadBlocks_BlockNumber_DMA(&sd_handle, (uint32_t*)buf, block_num, SDCARD_BLOCK_SIZE, num_blocks);
+    }
+    if (err != SD_OK) {
+        HAL_DMA_Abort(write ? &sd_tx_dma : &sd_rx_dma);
+        sd_busy = false;
+        return err;
+    }
+    sd_bg_state = SD_BG_RUNNING;
+    return 0;
+}
 
-    return err;
+mp_uint_t sdcard_read_blocks_start(uint8_t *dest, uint32_t block_num, uint32_t num_blocks) {
+    return sdcard_transfer_start(dest, block_num, num_blocks, false);
 }
 
-#if 0
-DMA not implemented
-bool sdcard_read_blocks_dma(uint8_t *dest, uint32_t block_num, uint32_t num_blocks) {
-    // check that dest pointer is aligned on a 4-byte boundary
-    if (((uint32_t)dest & 3) != 0) {
-        return false;
+mp_uint_t sdcard_write_blocks_start(const uint8_t *src, uint32_t block_num, uint32_t num_blocks) {
+    return sdcard_transfer_start((uint8_t*)src, block_num, num_blocks, true);
+}
+
+mp_uint_t sdcard_transfer_finish(void) {
+    if (!sdcard_transfer_complete() || sd_bg_state != SD_BG_DONE) {
+        return SD_ERROR;
     }
+    sd_bg_state = SD_BG_NONE;
+    return sd_bg_err;
+}
 
+mp_uint_t sdcard_read_blocks(uint8_t *dest, uint32_t block_num, uint32_t num_blocks) {
     // check that SD card is initialised
     if (sd_handle.Instance == NULL) {
-        return false;
+        return SD_ERROR;
     }
 
-    // do the read
-    if (HAL_SD_ReadBlocks_BlockNumber_DMA(&sd_handle, (uint32_t*)dest, block_num, SDCARD_BLOCK_SIZE) != SD_OK) {
-        return false;
+    sdcard_transfer_complete();
+    if (!sdcard_acquire()) {
+        return SD_ERROR;
     }
 
-    // wait for DMA transfer to finish, with a large timeout
-    if (HAL_SD_CheckReadOperation(&sd_handle, 100000000) != SD_OK) {
-        return false;
+    HAL_SD_ErrorTypedef err;
+    if (SD_DMA_ADDR_OK(dest)) {
+        err = sdcard_read_blocks_dma(dest, block_num, num_blocks);
+    } else {
+        err = SD_OK;
+        for (; num_blocks > 0 && err == SD_OK; num_blocks--, block_num++, dest += SDCARD_BLOCK_SIZE) {
+            err = sdcard_read_blocks_dma((uint8_t*)sd_bounce_buf, block_num, 1);
+            memcpy(dest, sd_bounce_buf, SDCARD_BLOCK_SIZE);
+        }
     }
 
-    return true;
+    sd_busy = false;
+    return err;
 }
 
-bool sdcard_write_blocks_dma(const uint8_t *src, uint32_t block_num, uint32_t num_blocks) {
-    // check that src pointer is aligned on a 4-byte boundary
-    if (((uint32_t)src & 3) != 0) {
-        return false;
-    }
-
+mp_uint_t sdcard_write_blocks(const uint8_t *src, uint32_t block_num, uint32_t num_blocks) {
     // check that SD card is initialised
     if (sd_handle.Instance == NULL) {
-        return false;
+        return SD_ERROR;
     }
 
-    SD_Error status;
-
-    status = HAL_SD_WriteBlocks_BlockNumber_DMA(&sd_handle, (uint32_t*)src, block_num, SDCARD_BLOCK_SIZE, num_blocks);
-    if (status != SD_OK) {
-        return false;
+    sdcard_transfer_complete();
+    if (sd_bg_state == SD_BG_DONE && !sd_bg_write) {
+        // the blocks read in the background may be the ones being changed
+        sd_bg_err = SD_ERROR;
+    }
+    if (!sdcard_acquire()) {
+        return SD_ERROR;
     }
 
-    // wait for DMA transfer to finish, with a large timeout
-    status = HAL_SD_CheckWriteOperation(&sd_handle, 100000000);
-    if (status != SD_OK) {
-        return false;
+    HAL_SD_ErrorTypedef err;
+    if (SD_DMA_ADDR_OK(src)) {
+        err = sdcard_write_blocks_dma(src, block_num, num_blocks);
+    } else {
+        err = SD_OK;
+        for (; num_blocks > 0 && err == SD_OK; num_blocks--, block_num++, src += SDCARD_BLOCK_SIZE) {
+            memcpy(sd_bounce_buf, src, SDCARD_BLOCK_SIZE);
+            err = sdcard_write_blocks_dma((uint8_t*)sd_bounce_buf, block_num, 1);
+        }
     }
 
-    return true;
+    sd_busy = false;
+    return err;
 }
-#endif
 
 /******************************************************************************/
 // Micro Python bindings
@@ -34,7 +34,18 @@ void sdcard_power_off(void);
 uint64_t sdcard_get_capacity_in_bytes(void);
 
 // these return 0 on success, non-zero on error
+// transfers go by DMA with interrupts enabled; buffers may have any alignment
 mp_uint_t sdcard_read_blocks(uint8_t *dest, uint32_t block_num, uint32_t num_blocks);
 mp_uint_t sdcard_write_blocks(const uint8_t *src, uint32_t block_num, uint32_t num_blocks);
 
+// start a transfer and return without waiting for it; the buffer must be word
+// aligned and outside the CCM RAM, and be left alone until the result is
+// collected by sdcard_transfer_finish, which waits for the transfer to end
+mp_uint_t sdcard_read_blocks_start(uint8_t *dest, uint32_t block_num, uint32_t num_blocks);
+mp_uint_t sdcard_write_blocks_start(const uint8_t *src, uint32_t block_num, uint32_t num_blocks);
+mp_uint_t sdcard_transfer_finish(void);
+
+void sdcard_irq_handler(void);
+void sdcard_dma_irq_handler(int stream);
+
 extern const struct _mp_obj_base_t pyb_sdcard_obj;
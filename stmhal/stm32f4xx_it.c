@@ -78,6 +78,10 @@
 #include "timer.h"
 #include "uart.h"
 #include "storage.h"
+#include "sdcard.h"
+#if MICROPY_PY_CC31K
+#include "cc31kdrv.h"
+#endif
 
 extern void __fatal_error(const char*);
 extern PCD_HandleTypeDef hpcd;
@@ -271,13 +275,14 @@ void OTG_XX_WKUP_IRQHandler(void) {
 
 // Handle a flash (erase/program) interrupt.
 void FLASH_IRQHandler(void) {
-    // This calls the real flash IRQ handler, if needed
-    /*
-    uint32_t flash_cr = FLASH->CR;
-    if ((flash_cr & FLASH_IT_EOP) || (flash_cr & FLASH_IT_ERR)) {
+    // This calls the real flash IRQ handler, if an operation it started has
+    // ended.  The IRQ is also raised by software, and the HAL handler must not
+    // run then since it clears the operation bits in FLASH->CR.
+    if ((FLASH->CR & (FLASH_IT_EOP | FLASH_IT_ERR))
+        && (FLASH->SR & (FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR
+                         | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR))) {
         HAL_FLASH_IRQHandler();
     }
-    */
     // This call the storage IRQ handler, to check if the flash cache needs flushing
     storage_irq_handler();
 }
@@ -417,3 +422,29 @@ void UART4_IRQHandler(void) {
 void USART6_IRQHandler(void) {
     uart_irq_handler(6);
 }
+
+#if MICROPY_HW_HAS_SDCARD
+void SDIO_IRQHandler(void) {
+    sdcard_irq_handler();
+}
+
+// DMA streams used by the SDIO
+void DMA2_Stream3_IRQHandler(void) {
+    sdcard_dma_irq_handler(3);
+}
+
+void DMA2_Stream6_IRQHandler(void) {
+    sdcard_dma_irq_handler(6);
+}
+#endif
+
+#if MICROPY_PY_CC31K
+// DMA streams used by the CC3100 SPI transport
+void DMA1_Stream3_IRQHandler(void) {
+    cc31k_dma_irq_handler(3);
+}
+
+void DMA1_Stream4_IRQHandler(void) {
+    cc31k_dma_irq_handler(4);
+}
+#endif
@@ -42,59 +42,208 @@
 #define FLASH_PART1_NUM_BLOCKS (224) // 16k+16k+16k+64k=112k
 #define FLASH_MEM_START_ADDR (0x08004000) // sector 1, 16k
 
+// The cache RAM is split into slots of the smallest sector size.  A cached
+// sector takes as many adjacent slots as it needs, so the three 16k sectors
+// can be cached together, while the 64k sector needs all of the RAM.
+#define FLASH_CACHE_SLOT_SIZE (0x4000)
+#define FLASH_CACHE_NUM_SLOTS (4)
+#define FLASH_CACHE_NUM_ENTRIES FLASH_CACHE_NUM_SLOTS
+#define FLASH_SECTOR_MAX_BLOCKS (0x10000 / FLASH_BLOCK_SIZE)
+
 #define FLASH_FLAG_DIRTY        (1)
 #define FLASH_FLAG_FORCE_WRITE  (2)
-#define FLASH_FLAG_ERASED       (4)
+
+// Write-back of an entry runs in the background, driven by the flash
+// end-of-operation interrupt: the sector erase, if needed, is started and
+// the IRQ returns; then each completed operation programs the next word.
+#define FLASH_WB_IDLE           (0)
+#define FLASH_WB_ERASING        (1)
+#define FLASH_WB_PROGRAMMING    (2)
+
+typedef struct _flash_cache_entry_t {
+    uint32_t sector_id;     // 0 if the entry is unused
+    uint32_t sector_start;
+    uint32_t sector_size;
+    uint8_t *buf;           // copy of the sector in the cache RAM
+    uint32_t last_use;      // for LRU eviction
+    uint8_t slot;
+    uint8_t n_slots;
+    volatile uint32_t dirty[FLASH_SECTOR_MAX_BLOCKS / 32]; // one bit per block
+} flash_cache_entry_t;
+
 static bool flash_is_initialised = false;
 static __IO uint8_t flash_flags = 0;
-static uint32_t flash_cache_sector_id;
-static uint32_t flash_cache_sector_start;
-static uint32_t flash_cache_sector_size;
+static flash_cache_entry_t flash_cache[FLASH_CACHE_NUM_ENTRIES];
+static flash_cache_entry_t *volatile flash_flush_entry; // being written back
+static volatile uint8_t flash_wb_state;
+static volatile bool flash_wb_error;
+static bool flash_wb_all;               // program the whole sector, not just the dirty blocks
+static uint32_t flash_wb_offset;        // next word to program
+static uint32_t flash_wb_block;         // last block programmed, for the stats
+static uint32_t flash_wb_dirty[FLASH_SECTOR_MAX_BLOCKS / 32]; // dirty blocks being written back
+static flash_cache_entry_t *volatile flash_force_entry; // forced flush of one entry, NULL for all
+static uint32_t flash_use_counter;
 static uint32_t flash_tick_counter_last_write;
+static storage_stats_t flash_stats;
+
+static bool flash_cache_entry_is_dirty(flash_cache_entry_t *e) {
+    for (int i = 0; i < FLASH_SECTOR_MAX_BLOCKS / 32; i++) {
+        if (e->dirty[i]) {
+            return true;
+        }
+    }
+    return false;
+}
 
-static void flash_cache_flush(void) {
-    if (flash_flags & FLASH_FLAG_DIRTY) {
-        flash_flags |= FLASH_FLAG_FORCE_WRITE;
-        while (flash_flags & FLASH_FLAG_DIRTY) {
-           NVIC->STIR = FLASH_IRQn;
+static bool flash_cache_entry_is_busy(flash_cache_entry_t *e) {
+    return flash_flush_entry == e || flash_cache_entry_is_dirty(e);
+}
+
+// Write back one entry, or all of them if e is NULL, by raising the flash
+// IRQ until storage_irq_handler has done so.
+static void flash_cache_flush(flash_cache_entry_t *e) {
+    if (!(flash_flags & FLASH_FLAG_DIRTY)) {
+        return;
+    }
+    if (e != NULL && !flash_cache_entry_is_busy(e)) {
+        return;
+    }
+    flash_cache_entry_t *old_force_entry = flash_force_entry;
+    uint8_t old_force = flash_flags & FLASH_FLAG_FORCE_WRITE;
+    flash_force_entry = e;
+    flash_flags |= FLASH_FLAG_FORCE_WRITE;
+    while (e == NULL ? (flash_flags & FLASH_FLAG_DIRTY) : flash_cache_entry_is_busy(e)) {
+        NVIC->STIR = FLASH_IRQn;
+    }
+    if (e != NULL) {
+        // restore the state of a flush we may have interrupted
+        flash_force_entry = old_force_entry;
+        if (!old_force) {
+            flash_flags &= ~FLASH_FLAG_FORCE_WRITE;
+        }
+    }
+}
+
+static flash_cache_entry_t *flash_cache_find(uint32_t flash_sector_id) {
+    for (int i = 0; i < FLASH_CACHE_NUM_ENTRIES; i++) {
+        if (flash_cache[i].sector_id == flash_sector_id) {
+            flash_cache[i].last_use = ++flash_use_counter;
+            return &flash_cache[i];
+        }
+    }
+    return NULL;
+}
+
+// Find n_slots adjacent free slots, returning the first or -1 if there are none.
+static int flash_cache_find_slots(int n_slots) {
+    uint32_t used = 0;
+    for (int i = 0; i < FLASH_CACHE_NUM_ENTRIES; i++) {
+        if (flash_cache[i].sector_id != 0) {
+            used |= ((1 << flash_cache[i].n_slots) - 1) << flash_cache[i].slot;
+        }
+    }
+    uint32_t mask = (1 << n_slots) - 1;
+    for (int slot = 0; slot + n_slots <= FLASH_CACHE_NUM_SLOTS; slot++) {
+        if (!(used & (mask << slot))) {
+            return slot;
         }
     }
+    return -1;
 }
 
-static uint8_t *flash_cache_get_addr_for_write(uint32_t flash_addr) {
+// Bring the sector holding flash_addr into the cache, writing back and
+// evicting the least recently used entries until there is room for it.
+static flash_cache_entry_t *flash_cache_load(uint32_t flash_addr) {
     uint32_t flash_sector_start;
     uint32_t flash_sector_size;
     uint32_t flash_sector_id = flash_get_sector_info(flash_addr, &flash_sector_start, &flash_sector_size);
-    if (flash_cache_sector_id != flash_sector_id) {
-        flash_cache_flush();
-        memcpy((void*)CACHE_MEM_START_ADDR, (const void*)flash_sector_start, flash_sector_size);
-        flash_cache_sector_id = flash_sector_id;
-        flash_cache_sector_start = flash_sector_start;
-        flash_cache_sector_size = flash_sector_size;
+    flash_cache_entry_t *e = flash_cache_find(flash_sector_id);
+    if (e != NULL) {
+        flash_stats.cache_hits += 1;
+        return e;
+    }
+    flash_stats.cache_misses += 1;
+
+    int n_slots = flash_sector_size / FLASH_CACHE_SLOT_SIZE;
+    int slot;
+    while ((slot = flash_cache_find_slots(n_slots)) < 0) {
+        flash_cache_entry_t *lru = NULL;
+        for (int i = 0; i < FLASH_CACHE_NUM_ENTRIES; i++) {
+            if (flash_cache[i].sector_id != 0 && (lru == NULL || flash_cache[i].last_use < lru->last_use)) {
+                lru = &flash_cache[i];
+            }
+        }
+        flash_cache_flush(lru);
+        lru->sector_id = 0;
+        flash_stats.cache_evictions += 1;
+    }
+
+    for (e = &flash_cache[0]; e->sector_id != 0; e++) {
+    }
+    e->sector_start = flash_sector_start;
+    e->sector_size = flash_sector_size;
+    e->slot = slot;
+    e->n_slots = n_slots;
+    e->buf = (uint8_t*)CACHE_MEM_START_ADDR + slot * FLASH_CACHE_SLOT_SIZE;
+    e->last_use = ++flash_use_counter;
+    memset((void*)e->dirty, 0, sizeof(e->dirty));
+    memcpy(e->buf, (const void*)flash_sector_start, flash_sector_size);
+    e->sector_id = flash_sector_id;
+    return e;
+}
+
+// Write num_blocks blocks, all in the sector holding flash_addr, to the cache.
+static void flash_cache_write(uint32_t flash_addr, const uint8_t *src, uint32_t num_blocks) {
+    flash_cache_entry_t *e = flash_cache_load(flash_addr);
+    uint32_t block = (flash_addr - e->sector_start) / FLASH_BLOCK_SIZE;
+    memcpy(e->buf + block * FLASH_BLOCK_SIZE, src, num_blocks * FLASH_BLOCK_SIZE);
+    // mark the blocks dirty only once they are all in the cache, so that a
+    // flush that lands in the middle of the copy is followed by another
+    for (uint32_t end = block + num_blocks; block < end; block++) {
+        e->dirty[block / 32] |= 1 << (block % 32);
     }
     flash_flags |= FLASH_FLAG_DIRTY;
     led_state(PYB_LED_R1, 1); // indicate a dirty cache with LED on
     flash_tick_counter_last_write = HAL_GetTick();
-    return (uint8_t*)CACHE_MEM_START_ADDR + flash_addr - flash_sector_start;
 }
 
-static uint8_t *flash_cache_get_addr_for_read(uint32_t flash_addr) {
-    uint32_t flash_sector_start;
-    uint32_t flash_sector_size;
-    uint32_t flash_sector_id = flash_get_sector_info(flash_addr, &flash_sector_start, &flash_sector_size);
-    if (flash_cache_sector_id == flash_sector_id) {
+static const uint8_t *flash_cache_get_addr_for_read(uint32_t flash_addr) {
+    uint32_t flash_sector_id = flash_get_sector_info(flash_addr, NULL, NULL);
+    flash_cache_entry_t *e = flash_cache_find(flash_sector_id);
+    if (e != NULL) {
         // in cache, copy from there
-        return (uint8_t*)CACHE_MEM_START_ADDR + flash_addr - flash_sector_start;
+        flash_stats.cache_hits += 1;
+        return e->buf + flash_addr - e->sector_start;
     }
     // not in cache, copy straight from flash
-    return (uint8_t*)flash_addr;
+    flash_stats.cache_misses += 1;
+    return (const uint8_t*)flash_addr;
+}
+
+// Return the number of blocks from block onwards, up to num_blocks, that are
+// in the same flash sector, and so contiguous both in flash and in the cache.
+static uint32_t flash_run_length(uint32_t block, uint32_t num_blocks) {
+    uint32_t flash_addr = FLASH_MEM_START_ADDR + (block - FLASH_PART1_START_BLOCK) * FLASH_BLOCK_SIZE;
+    uint32_t flash_sector_start;
+    uint32_t flash_sector_size;
+    flash_get_sector_info(flash_addr, &flash_sector_start, &flash_sector_size);
+    uint32_t n = (flash_sector_start + flash_sector_size - flash_addr) / FLASH_BLOCK_SIZE;
+    if (n > FLASH_PART1_START_BLOCK + FLASH_PART1_NUM_BLOCKS - block) {
+        n = FLASH_PART1_START_BLOCK + FLASH_PART1_NUM_BLOCKS - block;
+    }
+    return n < num_blocks ? n : num_blocks;
 }
 
 void storage_init(void) {
     if (!flash_is_initialised) {
         flash_flags = 0;
-        flash_cache_sector_id = 0;
+        memset(flash_cache, 0, sizeof(flash_cache));
+        flash_flush_entry = NULL;
+        flash_wb_state = FLASH_WB_IDLE;
+        flash_force_entry = NULL;
+        flash_use_counter = 0;
         flash_tick_counter_last_write = 0;
+        memset(&flash_stats, 0, sizeof(flash_stats));
         flash_is_initialised = true;
     }
 
@@ -113,51 +262,206 @@ uint32_t storage_get_block_count(void) {
     return FLASH_PART1_START_BLOCK + FLASH_PART1_NUM_BLOCKS;
 }
 
+void storage_get_stats(storage_stats_t *stats) {
+    *stats = flash_stats;
+}
+
+static bool flash_wb_block_is_dirty(uint32_t block) {
+    return flash_wb_dirty[block / 32] & (1 << (block % 32));
+}
+
+// Check whether the dirty blocks of an entry can be programmed over what is
+// in the flash now, that is whether they only clear bits.
+static bool flash_cache_can_program_in_place(flash_cache_entry_t *e) {
+    uint32_t n_blocks = e->sector_size / FLASH_BLOCK_SIZE;
+    for (uint32_t block = 0; block < n_blocks; block++) {
+        if (!flash_wb_block_is_dirty(block)) {
+            continue;
+        }
+        const uint32_t *cache = (const uint32_t*)(e->buf + block * FLASH_BLOCK_SIZE);
+        const uint32_t *flash = (const uint32_t*)(e->sector_start + block * FLASH_BLOCK_SIZE);
+        for (int i = 0; i < FLASH_BLOCK_SIZE / 4; i++) {
+            if ((flash[i] & cache[i]) != cache[i]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Start programming the next word of the entry being written back that
+// differs from the flash, within the dirty blocks or, after an erase, the
+// whole sector.  Returns false once there are none left.
+static bool flash_wb_program_next(void) {
+    flash_cache_entry_t *e = flash_flush_entry;
+    while (flash_wb_offset < e->sector_size) {
+        uint32_t block = flash_wb_offset / FLASH_BLOCK_SIZE;
+        if (!flash_wb_all && !flash_wb_block_is_dirty(block)) {
+            flash_wb_offset = (block + 1) * FLASH_BLOCK_SIZE;
+            continue;
+        }
+        uint32_t word = *(const uint32_t*)(e->buf + flash_wb_offset);
+        if (word == *(const uint32_t*)(e->sector_start + flash_wb_offset)) {
+            flash_wb_offset += 4;
+            continue;
+        }
+        if (HAL_FLASH_Program_IT(TYPEPROGRAM_WORD, e->sector_start + flash_wb_offset, word) != HAL_OK) {
+            // the HAL has yet to see the end of the last operation; its
+            // interrupt is pending and brings us back here
+            return true;
+        }
+        if (block != flash_wb_block) {
+            flash_wb_block = block;
+            flash_stats.blocks_programmed += 1;
+        }
+        flash_wb_offset += 4;
+        return true;
+    }
+    return false;
+}
+
+// Finish the write-back in progress.  If it failed, the blocks it was
+// writing are marked dirty again so that a later one retries them.
+static void flash_wb_finish(void) {
+    HAL_FLASH_Lock();
+    if (flash_wb_error) {
+        for (int i = 0; i < FLASH_SECTOR_MAX_BLOCKS / 32; i++) {
+            flash_flush_entry->dirty[i] |= flash_wb_all ? 0xffffffff : flash_wb_dirty[i];
+        }
+        flash_wb_error = false;
+    }
+    flash_wb_state = FLASH_WB_IDLE;
+    flash_flush_entry = NULL;
+}
+
+void HAL_FLASH_OperationErrorCallback(uint32_t ReturnValue) {
+    flash_wb_error = true;
+}
+
 void storage_irq_handler(void) {
     if (!(flash_flags & FLASH_FLAG_DIRTY)) {
         return;
     }
 
-    // This code uses interrupts to erase the flash
-    /*
-    if (flash_erase_state == 0) {
-        flash_erase_it(flash_cache_sector_start, (const uint32_t*)CACHE_MEM_START_ADDR, flash_cache_sector_size / 4);
-        flash_erase_state = 1;
+    // an erase or program operation is running; its end-of-operation
+    // interrupt calls us again
+    if (__HAL_FLASH_GET_FLAG(FLASH_FLAG_BSY) != RESET) {
         return;
     }
 
-    if (flash_erase_state == 1) {
-        // wait for erase
-        // TODO add timeout
-        #define flash_erase_done() (__HAL_FLASH_GET_FLAG(FLASH_FLAG_BSY) == RESET)
-        if (!flash_erase_done()) {
+    if (flash_wb_state != FLASH_WB_IDLE) {
+        if (flash_wb_error) {
+            flash_wb_finish();
             return;
         }
-        flash_erase_state = 2;
+        if (flash_wb_state == FLASH_WB_ERASING) {
+            flash_wb_state = FLASH_WB_PROGRAMMING;
+            flash_wb_offset = 0;
+        }
+        if (flash_wb_program_next()) {
+            return;
+        }
+        flash_wb_finish();
     }
-    */
 
-    // This code erases the flash directly, waiting for it to finish
-    if (!(flash_flags & FLASH_FLAG_ERASED)) {
-        flash_erase(flash_cache_sector_start, (const uint32_t*)CACHE_MEM_START_ADDR, flash_cache_sector_size / 4);
-        flash_flags |= FLASH_FLAG_ERASED;
+    // If not a forced write, wait at least 5 seconds after last write to flush
+    // On file close and flash unmount we get a forced write, so we can afford to wait a while
+    if (!(flash_flags & FLASH_FLAG_FORCE_WRITE) && !sys_tick_has_passed(flash_tick_counter_last_write, 5000)) {
         return;
     }
 
-    // If not a forced write, wait at least 5 seconds after last write to flush
-    // On file close and flash unmount we get a forced write, so we can afford to wait a while
-    if ((flash_flags & FLASH_FLAG_FORCE_WRITE) || sys_tick_has_passed(flash_tick_counter_last_write, 5000)) {
-        // sync the cache RAM buffer by writing it to the flash page
-        flash_write(flash_cache_sector_start, (const uint32_t*)CACHE_MEM_START_ADDR, flash_cache_sector_size / 4);
+    // pick the entry to write back; all the writes made to it since it was
+    // last written back go out together
+    flash_cache_entry_t *e = flash_force_entry;
+    if (e == NULL || !flash_cache_entry_is_dirty(e)) {
+        e = NULL;
+        for (int i = 0; i < FLASH_CACHE_NUM_ENTRIES; i++) {
+            if (flash_cache[i].sector_id != 0 && flash_cache_entry_is_dirty(&flash_cache[i])) {
+                e = &flash_cache[i];
+                break;
+            }
+        }
+    }
+
+    if (e == NULL) {
         // clear the flash flags now that we have a clean cache
         flash_flags = 0;
         // indicate a clean cache with LED off
         led_state(PYB_LED_R1, 0);
+        return;
+    }
+
+    // Take the dirty blocks over.  Writes made to the entry from now on mark
+    // their blocks dirty again, so they go out with the next write-back even
+    // if this one has already programmed them.  Until the write-back ends
+    // the entry stays in the cache, which serves reads of the sector.
+    for (int i = 0; i < FLASH_SECTOR_MAX_BLOCKS / 32; i++) {
+        flash_wb_dirty[i] = e->dirty[i];
+        e->dirty[i] = 0;
+    }
+    flash_flush_entry = e;
+    flash_wb_offset = 0;
+    flash_wb_block = -1;
+    flash_wb_error = false;
+    HAL_FLASH_Unlock();
+
+    if (flash_cache_can_program_in_place(e)) {
+        // only 1 bits become 0, as when appending to erased space, so the
+        // dirty blocks can be programmed without an erase
+        flash_wb_all = false;
+        flash_wb_state = FLASH_WB_PROGRAMMING;
+        if (!flash_wb_program_next()) {
+            flash_wb_finish();
+        }
+    } else {
+        // erase, then program the whole sector from the cache
+        flash_wb_all = true;
+        if (flash_erase_it(e->sector_start, (const uint32_t*)e->buf, e->sector_size / 4) != HAL_OK) {
+            // the erase didn't start, and programming over the old contents
+            // would corrupt them, so leave the blocks dirty for a retry
+            flash_wb_error = true;
+            flash_wb_finish();
+            return;
+        }
+        flash_wb_state = FLASH_WB_ERASING;
+        flash_stats.erases += 1;
     }
 }
 
 void storage_flush(void) {
-    flash_cache_flush();
+    flash_cache_flush(NULL);
+}
+
+// Wait until no write-back is running and return with interrupts disabled,
+// so that one operation can use the flash before another write-back starts.
+static mp_uint_t flash_wait_idle_disable_irq(void) {
+    for (;;) {
+        mp_uint_t irq_state = disable_irq();
+        if (flash_wb_state == FLASH_WB_IDLE && __HAL_FLASH_GET_FLAG(FLASH_FLAG_BSY) == RESET) {
+            return irq_state;
+        }
+        enable_irq(irq_state);
+        __WFI();
+    }
+}
+
+// Erase and program flash outside the filesystem, in between write-backs.
+// The flash stalls the CPU while it erases or programs anyway, so holding
+// off interrupts for one operation costs little more.
+void storage_direct_erase(uint32_t addr, uint32_t len) {
+    mp_uint_t irq_state = flash_wait_idle_disable_irq();
+    flash_erase(addr, NULL, len / 4);
+    enable_irq(irq_state);
+}
+
+void storage_direct_program(uint32_t addr, const uint32_t *src, uint32_t num_word32) {
+    for (; num_word32 > 0; num_word32--) {
+        mp_uint_t irq_state = flash_wait_idle_disable_irq();
+        flash_write(addr, src, 1);
+        enable_irq(irq_state);
+        addr += 4;
+        src += 1;
+    }
 }
 
 static void build_partition(uint8_t *buf, int boot, int type, uint32_t start_block, uint32_t num_blocks) {
@@ -218,7 +522,7 @@ bool storage_read_block(uint8_t *dest, uint32_t block) {
     } else if (FLASH_PART1_START_BLOCK <= block && block < FLASH_PART1_START_BLOCK + FLASH_PART1_NUM_BLOCKS) {
         // non-MBR block, get data from flash memory, possibly via cache
         uint32_t flash_addr = FLASH_MEM_START_ADDR + (block - FLASH_PART1_START_BLOCK) * FLASH_BLOCK_SIZE;
-        uint8_t *src = flash_cache_get_addr_for_read(flash_addr);
+        const uint8_t *src = flash_cache_get_addr_for_read(flash_addr);
         memcpy(dest, src, FLASH_BLOCK_SIZE);
         return true;
 
@@ -237,8 +541,7 @@ bool storage_write_block(const uint8_t *src, uint32_t block) {
     } else if (FLASH_PART1_START_BLOCK <= block && block < FLASH_PART1_START_BLOCK + FLASH_PART1_NUM_BLOCKS) {
         // non-MBR block, copy to cache
         uint32_t flash_addr = FLASH_MEM_START_ADDR + (block - FLASH_PART1_START_BLOCK) * FLASH_BLOCK_SIZE;
-        uint8_t *dest = flash_cache_get_addr_for_write(flash_addr);
-        memcpy(dest, src, FLASH_BLOCK_SIZE);
+        flash_cache_write(flash_addr, src, 1);
         return true;
 
     } else {
@@ -246,3 +549,42 @@ bool storage_write_block(const uint8_t *src, uint32_t block) {
         return false;
     }
 }
+
+// Read num_blocks blocks.  Runs of blocks within a flash sector are copied in
+// one go, from the cache if the sector is there and from flash otherwise.
+bool storage_read_blocks(uint8_t *dest, uint32_t block_num, uint32_t num_blocks) {
+    while (num_blocks > 0) {
+        uint32_t n = 1;
+        if (FLASH_PART1_START_BLOCK <= block_num && block_num < FLASH_PART1_START_BLOCK + FLASH_PART1_NUM_BLOCKS) {
+            n = flash_run_length(block_num, num_blocks);
+            uint32_t flash_addr = FLASH_MEM_START_ADDR + (block_num - FLASH_PART1_START_BLOCK) * FLASH_BLOCK_SIZE;
+            const uint8_t *src = flash_cache_get_addr_for_read(flash_addr);
+            memcpy(dest, src, n * FLASH_BLOCK_SIZE);
+        } else if (!storage_read_block(dest, block_num)) {
+            return false;
+        }
+        dest += n * FLASH_BLOCK_SIZE;
+        block_num += n;
+        num_blocks -= n;
+    }
+    return true;
+}
+
+// Write num_blocks blocks, copying runs of blocks within a flash sector into
+// the cache in one go.
+bool storage_write_blocks(const uint8_t *src, uint32_t block_num, uint32_t num_blocks) {
+    while (num_blocks > 0) {
+        uint32_t n = 1;
+        if (FLASH_PART1_START_BLOCK <= block_num && block_num < FLASH_PART1_START_BLOCK + FLASH_PART1_NUM_BLOCKS) {
+            n = flash_run_length(block_num, num_blocks);
+            uint32_t flash_addr = FLASH_MEM_START_ADDR + (block_num - FLASH_PART1_START_BLOCK) * FLASH_BLOCK_SIZE;
+            flash_cache_write(flash_addr, src, n);
+        } else if (!storage_write_block(src, block_num)) {
+            return false;
+        }
+        src += n * FLASH_BLOCK_SIZE;
+        block_num += n;
+        num_blocks -= n;
+    }
+    return true;
+}
@@ -26,10 +26,23 @@
 
 #define FLASH_BLOCK_SIZE (512)
 
+typedef struct _storage_stats_t {
+    uint32_t cache_hits;        // block reads and writes served by the cache
+    uint32_t cache_misses;      // reads straight from flash, writes loading a sector
+    uint32_t cache_evictions;
+    uint32_t erases;            // sector erases
+    uint32_t blocks_programmed;
+} storage_stats_t;
+
 void storage_init(void);
 uint32_t storage_get_block_size(void);
 uint32_t storage_get_block_count(void);
 void storage_irq_handler(void);
 void storage_flush(void);
+void storage_direct_erase(uint32_t addr, uint32_t len);
+void storage_direct_program(uint32_t addr, const uint32_t *src, uint32_t num_word32);
+void storage_get_stats(storage_stats_t *stats);
 bool storage_read_block(uint8_t *dest, uint32_t block);
 bool storage_write_block(const uint8_t *src, uint32_t block);
+bool storage_read_blocks(uint8_t *dest, uint32_t block_num, uint32_t num_blocks);
+bool storage_write_blocks(const uint8_t *src, uint32_t block_num, uint32_t num_blocks);
@@ -88,9 +88,49 @@ struct _pyb_uart_obj_t {
     uint16_t timeout_char;              // timeout waiting between chars
     uint16_t char_width;                // 0 for 7,8 bit chars, 1 for 9 bit chars
     uint16_t read_buf_len;              // len in chars; buf can hold len-1 chars
-    volatile uint16_t read_buf_head;    // indexes first empty slot
+    volatile uint16_t read_buf_head;    // indexes first empty slot (unused when the DMA fills buf)
     uint16_t read_buf_tail;             // indexes first full slot (not full if equals head)
     byte *read_buf;                     // byte or uint16_t, depending on char size
+    uint16_t write_buf_len;             // len in chars; buf can hold len-1 chars
+    volatile uint16_t write_buf_head;   // indexes first empty slot
+    volatile uint16_t write_buf_tail;   // indexes first full slot (not full if equals head)
+    volatile uint16_t write_dma_len;    // chars from tail being sent by the DMA
+    byte *write_buf;                    // byte or uint16_t, depending on char size
+    DMA_HandleTypeDef rx_dma;           // Instance is NULL if not in use
+    DMA_HandleTypeDef tx_dma;           // Instance is NULL if not in use
+};
+
+// The DMA streams for each UART, where they are not taken by another
+// driver.  The DAC has both of USART2's, the CC3100 transport has the TX
+// streams of USART3 and UART4, and the SD card has USART6's TX stream (its
+// other one is USART1's).  A UART without a stream is served by interrupts.
+typedef struct _uart_dma_t {
+    DMA_Stream_TypeDef *rx_stream;
+    uint32_t rx_channel;
+    DMA_Stream_TypeDef *tx_stream;
+    uint32_t tx_channel;
+} uart_dma_t;
+
+STATIC const uart_dma_t uart_dma_table[6] = {
+    {DMA2_Stream2, DMA_CHANNEL_4, DMA2_Stream7, DMA_CHANNEL_4},
+#if MICROPY_HW_ENABLE_DAC
+    {NULL, 0, NULL, 0},
+#else
+    {DMA1_Stream5, DMA_CHANNEL_4, DMA1_Stream6, DMA_CHANNEL_4},
+#endif
+#if MICROPY_PY_CC31K
+    {DMA1_Stream1, DMA_CHANNEL_4, NULL, 0},
+    {DMA1_Stream2, DMA_CHANNEL_4, NULL, 0},
+#else
+    {DMA1_Stream1, DMA_CHANNEL_4, DMA1_Stream3, DMA_CHANNEL_4},
+    {DMA1_Stream2, DMA_CHANNEL_4, DMA1_Stream4, DMA_CHANNEL_4},
+#endif
+    {NULL, 0, NULL, 0}, // UART5 is not supported
+#if MICROPY_HW_HAS_SDCARD
+    {DMA2_Stream1, DMA_CHANNEL_5, NULL, 0},
+#else
+    {DMA2_Stream1, DMA_CHANNEL_5, DMA2_Stream6, DMA_CHANNEL_5},
+#endif
 };
 
 // pointers to all UART objects (if they have been created)
@@ -231,9 +271,63 @@ bool uart_init(pyb_uart_obj_t *uart_obj, uint32_t baudrate) {
 }
 */
 
+STATIC void uart_dma_init_stream(DMA_HandleTypeDef *dma, DMA_Stream_TypeDef *stream, uint32_t channel, uint32_t direction, uint32_t mode, uint16_t char_width) {
+    dma->Instance                   = stream;
+    dma->State                      = HAL_DMA_STATE_RESET;
+    dma->Init.Channel               = channel;
+    dma->Init.Direction             = direction;
+    dma->Init.PeriphInc             = DMA_PINC_DISABLE;
+    dma->Init.MemInc                = DMA_MINC_ENABLE;
+    dma->Init.PeriphDataAlignment   = char_width == CHAR_WIDTH_9BIT ? DMA_PDATAALIGN_HALFWORD : DMA_PDATAALIGN_BYTE;
+    dma->Init.MemDataAlignment      = char_width == CHAR_WIDTH_9BIT ? DMA_MDATAALIGN_HALFWORD : DMA_MDATAALIGN_BYTE;
+    dma->Init.Mode                  = mode;
+    dma->Init.Priority              = direction == DMA_PERIPH_TO_MEMORY ? DMA_PRIORITY_HIGH : DMA_PRIORITY_LOW;
+    dma->Init.FIFOMode              = DMA_FIFOMODE_DISABLE;
+    dma->Init.FIFOThreshold         = DMA_FIFO_THRESHOLD_HALFFULL;
+    dma->Init.MemBurst              = DMA_MBURST_SINGLE;
+    dma->Init.PeriphBurst           = DMA_PBURST_SINGLE;
+    HAL_DMA_DeInit(dma);
+    HAL_DMA_Init(dma);
+}
+
+// stop the interrupts and DMA streams that use the buffers, so they can be freed
+STATIC void uart_dma_deinit(pyb_uart_obj_t *self) {
+    if (self->uart.Instance != NULL) {
+        __HAL_UART_DISABLE_IT(&self->uart, UART_IT_RXNE);
+        __HAL_UART_DISABLE_IT(&self->uart, UART_IT_IDLE);
+        __HAL_UART_DISABLE_IT(&self->uart, UART_IT_TXE);
+        __HAL_UART_DISABLE_IT(&self->uart, UART_IT_TC);
+        self->uart.Instance->CR3 &= ~(USART_CR3_DMAR | USART_CR3_DMAT);
+    }
+    if (self->rx_dma.Instance != NULL) {
+        HAL_DMA_Abort(&self->rx_dma);
+        HAL_DMA_DeInit(&self->rx_dma);
+        self->rx_dma.Instance = NULL;
+    }
+    if (self->tx_dma.Instance != NULL) {
+        HAL_DMA_Abort(&self->tx_dma);
+        HAL_DMA_DeInit(&self->tx_dma);
+        self->tx_dma.Instance = NULL;
+    }
+}
+
+// the slot the next received char goes into
+STATIC mp_uint_t uart_rx_head(pyb_uart_obj_t *self) {
+    if (self->rx_dma.Instance != NULL) {
+        // the DMA counts down the chars left before it wraps round
+        mp_uint_t head = self->read_buf_len - __HAL_DMA_GET_COUNTER(&self->rx_dma);
+        return head == self->read_buf_len ? 0 : head;
+    }
+    return self->read_buf_head;
+}
+
 bool uart_rx_any(pyb_uart_obj_t *self) {
-    return self->read_buf_tail != self->read_buf_head
-        || __HAL_UART_GET_FLAG(&self->uart, UART_FLAG_RXNE) != RESET;
+    if (self->read_buf_tail != uart_rx_head(self)) {
+        return true;
+    }
+    // when the DMA is receiving the data register belongs to it
+    return self->rx_dma.Instance == NULL
+        && __HAL_UART_GET_FLAG(&self->uart, UART_FLAG_RXNE) != RESET;
 }
 
 // Waits at most timeout milliseconds for at least 1 char to become ready for
@@ -242,7 +336,7 @@ bool uart_rx_any(pyb_uart_obj_t *self) {
 STATIC bool uart_rx_wait(pyb_uart_obj_t *self, uint32_t timeout) {
     uint32_t start = HAL_GetTick();
     for (;;) {
-        if (self->read_buf_tail != self->read_buf_head || __HAL_UART_GET_FLAG(&self->uart, UART_FLAG_RXNE) != RESET) {
+        if (uart_rx_any(self)) {
             return true; // have at least 1 char ready for reading
         }
         if (HAL_GetTick() - start >= timeout) {
@@ -254,7 +348,7 @@ STATIC bool uart_rx_wait(pyb_uart_obj_t *self, uint32_t timeout) {
 
 // assumes there is a character available
 int uart_rx_char(pyb_uart_obj_t *self) {
-    if (self->read_buf_tail != self->read_buf_head) {
+    if (self->read_buf_tail != uart_rx_head(self)) {
         // buffering via IRQ
         int data;
         if (self->char_width == CHAR_WIDTH_9BIT) {
@@ -270,25 +364,205 @@ int uart_rx_char(pyb_uart_obj_t *self) {
     }
 }
 
+// Copies up to len chars out of the read buffer.
+// Returns the number of chars copied.
+STATIC mp_uint_t uart_rx_copy(pyb_uart_obj_t *self, byte *buf, mp_uint_t len) {
+    mp_uint_t head = uart_rx_head(self);
+    mp_uint_t tail = self->read_buf_tail;
+    mp_uint_t n = 0;
+    while (tail != head && n < len) {
+        // copy the run of chars up to head or the end of the buffer
+        mp_uint_t run = (head > tail ? head : self->read_buf_len) - tail;
+        if (run > len - n) {
+            run = len - n;
+        }
+        memcpy(buf + (n << self->char_width), self->read_buf + (tail << self->char_width), run << self->char_width);
+        n += run;
+        tail += run;
+        if (tail == self->read_buf_len) {
+            tail = 0;
+        }
+    }
+    self->read_buf_tail = tail;
+    return n;
+}
+
+// Starts the DMA on the chars waiting at the tail of the write buffer, up to
+// the end of the buffer.  Must be called with the UART IRQ unable to run.
+STATIC void uart_tx_dma_next(pyb_uart_obj_t *self) {
+    mp_uint_t head = self->write_buf_head;
+    mp_uint_t tail = self->write_buf_tail;
+    if (head == tail) {
+        self->write_dma_len = 0;
+        __HAL_UART_DISABLE_IT(&self->uart, UART_IT_TC);
+        return;
+    }
+    mp_uint_t n = (head > tail ? head : self->write_buf_len) - tail;
+    DMA_HandleTypeDef *dma = &self->tx_dma;
+    __HAL_DMA_CLEAR_FLAG(dma, __HAL_DMA_GET_TC_FLAG_INDEX(dma) | __HAL_DMA_GET_HT_FLAG_INDEX(dma)
+        | __HAL_DMA_GET_TE_FLAG_INDEX(dma) | __HAL_DMA_GET_FE_FLAG_INDEX(dma) | __HAL_DMA_GET_DME_FLAG_INDEX(dma));
+    dma->Instance->M0AR = (uint32_t)(self->write_buf + (tail << self->char_width));
+    dma->Instance->NDTR = n;
+    self->write_dma_len = n;
+    // the UART raises TC once the last char of the run has gone out
+    __HAL_UART_CLEAR_FLAG(&self->uart, UART_FLAG_TC);
+    __HAL_DMA_ENABLE(dma);
+    __HAL_UART_ENABLE_IT(&self->uart, UART_IT_TC);
+}
+
+// Returns true if the UART IRQ can preempt the running code, so that it will
+// make room in the write buffer.  It can't inside an atomic section, nor in a
+// handler of the same or higher priority (HAL_Init makes all the priority
+// bits preemption bits).
+STATIC bool uart_irq_can_preempt(pyb_uart_obj_t *self) {
+    if (__get_PRIMASK() != 0) {
+        return false;
+    }
+    uint32_t exc = __get_IPSR();
+    if (exc == 0) {
+        return true; // thread mode
+    }
+    if (exc < 4) {
+        return false; // NMI or HardFault
+    }
+    return NVIC_GetPriority(self->irqn) < NVIC_GetPriority((IRQn_Type)((int)exc - 16));
+}
+
+// Sends len chars by polling TXE, waiting at most timeout milliseconds for
+// each.  Returns the number of chars sent.
+STATIC mp_uint_t uart_tx_poll_strn(pyb_uart_obj_t *self, const byte *buf, mp_uint_t len) {
+    for (mp_uint_t i = 0; i < len; i++) {
+        uint32_t start = HAL_GetTick();
+        while (__HAL_UART_GET_FLAG(&self->uart, UART_FLAG_TXE) == RESET) {
+            if (HAL_GetTick() - start >= self->timeout) {
+                return i;
+            }
+        }
+        if (self->char_width == CHAR_WIDTH_9BIT) {
+            self->uart.Instance->DR = ((const uint16_t*)buf)[i];
+        } else {
+            self->uart.Instance->DR = buf[i];
+        }
+    }
+    return len;
+}
+
+// Sends what is in the write buffer and then buf by polling, for callers that
+// the UART IRQ can't preempt, which would otherwise wait out the timeout for
+// room that never comes.  Returns the number of chars of buf sent.
+STATIC mp_uint_t uart_tx_poll(pyb_uart_obj_t *self, const byte *buf, mp_uint_t len) {
+    // the DMA carries on without the IRQ, so let it finish its run
+    uint32_t start = HAL_GetTick();
+    while (self->write_dma_len != 0 && __HAL_DMA_GET_COUNTER(&self->tx_dma) != 0) {
+        if (HAL_GetTick() - start >= self->timeout) {
+            return 0;
+        }
+    }
+
+    // unless this interrupted the IRQ handler itself, nothing else touches
+    // the write buffer now, so send the queued chars first to keep the order
+    if (!NVIC_GetActive(self->irqn)) {
+        if (self->write_dma_len != 0) {
+            __HAL_UART_DISABLE_IT(&self->uart, UART_IT_TC);
+            self->write_buf_tail = (self->write_buf_tail + self->write_dma_len) % self->write_buf_len;
+            self->write_dma_len = 0;
+        }
+        while (self->write_buf_tail != self->write_buf_head) {
+            mp_uint_t head = self->write_buf_head;
+            mp_uint_t tail = self->write_buf_tail;
+            mp_uint_t n = (head > tail ? head : self->write_buf_len) - tail;
+            mp_uint_t sent = uart_tx_poll_strn(self, self->write_buf + (tail << self->char_width), n);
+            self->write_buf_tail = (tail + sent) % self->write_buf_len;
+            if (sent < n) {
+                return 0;
+            }
+        }
+    }
+
+    return uart_tx_poll_strn(self, buf, len);
+}
+
+// Queues up to len chars for sending, waiting at most timeout milliseconds
+// at a time for room in the write buffer.
+// Returns the number of chars queued.
+STATIC mp_uint_t uart_tx_queue(pyb_uart_obj_t *self, const byte *buf, mp_uint_t len) {
+    if (!uart_irq_can_preempt(self)) {
+        return uart_tx_poll(self, buf, len);
+    }
+
+    mp_uint_t n = 0;
+    uint32_t start = HAL_GetTick();
+    while (n < len) {
+        mp_uint_t head = self->write_buf_head;
+        mp_uint_t tail = self->write_buf_tail;
+        // room up to the slot before tail, or up to the end of the buffer
+        mp_uint_t room;
+        if (tail > head) {
+            room = tail - 1 - head;
+        } else {
+            room = (tail == 0 ? self->write_buf_len - 1 : self->write_buf_len) - head;
+        }
+        if (room == 0) {
+            if (HAL_GetTick() - start >= self->timeout) {
+                break;
+            }
+            __WFI();
+            continue;
+        }
+        if (room > len - n) {
+            room = len - n;
+        }
+        memcpy(self->write_buf + (head << self->char_width), buf + (n << self->char_width), room << self->char_width);
+        n += room;
+        head += room;
+        if (head == self->write_buf_len) {
+            head = 0;
+        }
+
+        // hand the new chars to the DMA or the TXE interrupt
+        mp_uint_t atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
+        self->write_buf_head = head;
+        if (self->tx_dma.Instance == NULL) {
+            __HAL_UART_ENABLE_IT(&self->uart, UART_IT_TXE);
+        } else if (self->write_dma_len == 0) {
+            uart_tx_dma_next(self);
+        }
+        MICROPY_END_ATOMIC_SECTION(atomic_state);
+        start = HAL_GetTick();
+    }
+    return n;
+}
+
 STATIC void uart_tx_char(pyb_uart_obj_t *uart_obj, int c) {
     uint8_t ch = c;
-    HAL_UART_Transmit(&uart_obj->uart, &ch, 1, uart_obj->timeout);
+    uart_tx_strn(uart_obj, (const char*)&ch, 1);
 }
 
 void uart_tx_strn(pyb_uart_obj_t *uart_obj, const char *str, uint len) {
-    HAL_UART_Transmit(&uart_obj->uart, (uint8_t*)str, len, uart_obj->timeout);
+    if (uart_obj->write_buf_len != 0) {
+        uart_tx_queue(uart_obj, (const byte*)str, len);
+    } else {
+        HAL_UART_Transmit(&uart_obj->uart, (uint8_t*)str, len, uart_obj->timeout);
+    }
 }
 
 void uart_tx_strn_cooked(pyb_uart_obj_t *uart_obj, const char *str, uint len) {
-    for (const char *top = str + len; str < top; str++) {
+    // send the runs of chars between newlines in one go
+    const char *top = str + len;
+    const char *run = str;
+    for (; str < top; str++) {
         if (*str == '\n') {
+            uart_tx_strn(uart_obj, run, str - run);
             uart_tx_char(uart_obj, '\r');
+            run = str;
         }
-        uart_tx_char(uart_obj, *str);
     }
+    uart_tx_strn(uart_obj, run, top - run);
 }
 
-// this IRQ handler is set up to handle RXNE interrupts only
+// this IRQ handler serves the read buffer, with RXNE interrupts or IDLE ones
+// to wake the reader when the DMA is receiving, and the write buffer, with
+// TXE interrupts or TC ones to restart the DMA
 void uart_irq_handler(mp_uint_t uart_id) {
     // get the uart object
     pyb_uart_obj_t *self = pyb_uart_obj_all[uart_id - 1];
@@ -299,7 +573,14 @@ void uart_irq_handler(mp_uint_t uart_id) {
         return;
     }
 
-    if (__HAL_UART_GET_FLAG(&self->uart, UART_FLAG_RXNE) != RESET) {
+    if (self->rx_dma.Instance != NULL) {
+        if (__HAL_UART_GET_FLAG(&self->uart, UART_FLAG_IDLE) != RESET) {
+            // the line has gone quiet, so the DMA has taken the last char
+            // and reading DR to clear the flag loses nothing
+            __HAL_UART_CLEAR_IDLEFLAG(&self->uart);
+        }
+    } else if (__HAL_UART_GET_IT_SOURCE(&self->uart, UART_IT_RXNE) != RESET
+        && __HAL_UART_GET_FLAG(&self->uart, UART_FLAG_RXNE) != RESET) {
         int data = self->uart.Instance->DR; // clears UART_FLAG_RXNE
         if (self->read_buf_len != 0) {
             uint16_t next_head = (self->read_buf_head + 1) % self->read_buf_len;
@@ -316,6 +597,32 @@ void uart_irq_handler(mp_uint_t uart_id) {
             // TODO set flag for buffer overflow
         }
     }
+
+    if (__HAL_UART_GET_IT_SOURCE(&self->uart, UART_IT_TXE) != RESET
+        && __HAL_UART_GET_FLAG(&self->uart, UART_FLAG_TXE) != RESET) {
+        uint16_t tail = self->write_buf_tail;
+        if (tail == self->write_buf_head) {
+            __HAL_UART_DISABLE_IT(&self->uart, UART_IT_TXE);
+        } else {
+            if (self->char_width == CHAR_WIDTH_9BIT) {
+                self->uart.Instance->DR = ((uint16_t*)self->write_buf)[tail];
+            } else {
+                self->uart.Instance->DR = self->write_buf[tail];
+            }
+            self->write_buf_tail = (tail + 1) % self->write_buf_len;
+        }
+    }
+
+    if (__HAL_UART_GET_IT_SOURCE(&self->uart, UART_IT_TC) != RESET
+        && __HAL_UART_GET_FLAG(&self->uart, UART_FLAG_TC) != RESET) {
+        if (__HAL_DMA_GET_COUNTER(&self->tx_dma) != 0) {
+            // the DMA fell behind the UART; wait for the real end of the run
+            __HAL_UART_CLEAR_FLAG(&self->uart, UART_FLAG_TC);
+        } else {
+            self->write_buf_tail = (self->write_buf_tail + self->write_dma_len) % self->write_buf_len;
+            uart_tx_dma_next(self);
+        }
+    }
 }
 
 /******************************************************************************/
@@ -334,13 +641,13 @@ STATIC void pyb_uart_print(void (*print)(void *env, const char *fmt, ...), void
         } else {
             print(env, "%u", self->uart.Init.Parity == UART_PARITY_EVEN ? 0 : 1);
         }
-        print(env, ", stop=%u, timeout=%u, timeout_char=%u, read_buf_len=%u)",
+        print(env, ", stop=%u, timeout=%u, timeout_char=%u, read_buf_len=%u, write_buf_len=%u)",
             self->uart.Init.StopBits == UART_STOPBITS_1 ? 1 : 2,
-            self->timeout, self->timeout_char, self->read_buf_len);
+            self->timeout, self->timeout_char, self->read_buf_len, self->write_buf_len);
     }
 }
 
-/// \method init(baudrate, bits=8, parity=None, stop=1, *, timeout=1000, timeout_char=0, read_buf_len=64)
+/// \method init(baudrate, bits=8, parity=None, stop=1, *, timeout=1000, timeout_char=0, read_buf_len=64, write_buf_len=64)
 ///
 /// Initialise the UART bus with the given parameters:
 ///
@@ -351,6 +658,15 @@ STATIC void pyb_uart_print(void (*print)(void *env, const char *fmt, ...), void
 ///   - `timeout` is the timeout in milliseconds to wait for the first character.
 ///   - `timeout_char` is the timeout in milliseconds to wait between characters.
 ///   - `read_buf_len` is the character length of the read buffer (0 to disable).
+///   - `write_buf_len` is the character length of the write buffer (0 to disable);
+///     it holds one character less than this, so it is at least 2.
+///
+/// Where the UART has a DMA stream to spare, the read buffer is filled by the
+/// DMA, and characters not read before it wraps round are overwritten.  With
+/// a write buffer, writes return once the data is queued, waiting up to
+/// `timeout` for room, and the data is sent in the background.  Writes from
+/// code the UART interrupt can't preempt, such as a higher priority interrupt
+/// handler, wait for the data to go out instead.
 STATIC mp_obj_t pyb_uart_init_helper(pyb_uart_obj_t *self, mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
     static const mp_arg_t allowed_args[] = {
         { MP_QSTR_baudrate, MP_ARG_REQUIRED | MP_ARG_INT, {.u_int = 9600} },
@@ -360,12 +676,16 @@ STATIC mp_obj_t pyb_uart_init_helper(pyb_uart_obj_t *self, mp_uint_t n_args, con
         { MP_QSTR_timeout, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 1000} },
         { MP_QSTR_timeout_char, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
         { MP_QSTR_read_buf_len, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 64} },
+        { MP_QSTR_write_buf_len, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 64} },
     };
 
     // parse args
     mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
     mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
 
+    // stop any previous init using its buffers, since they are freed below
+    uart_dma_deinit(self);
+
     // set the UART configuration values
     memset(&self->uart, 0, sizeof(self->uart));
     UART_InitTypeDef *init = &self->uart.Init;
@@ -396,6 +716,7 @@ STATIC mp_obj_t pyb_uart_init_helper(pyb_uart_obj_t *self, mp_uint_t n_args, con
 
     // setup the read buffer
     m_del(byte, self->read_buf, self->read_buf_len << self->char_width);
+    m_del(byte, self->write_buf, self->write_buf_len << self->char_width);
     if (init->WordLength == UART_WORDLENGTH_9B && init->Parity == UART_PARITY_NONE) {
         self->char_width = CHAR_WIDTH_9BIT;
     } else {
@@ -403,17 +724,61 @@ STATIC mp_obj_t pyb_uart_init_helper(pyb_uart_obj_t *self, mp_uint_t n_args, con
     }
     self->read_buf_head = 0;
     self->read_buf_tail = 0;
+    const uart_dma_t *dma = &uart_dma_table[self->uart_id - 1];
     if (args[6].u_int <= 0) {
         // no read buffer
         self->read_buf_len = 0;
         self->read_buf = NULL;
-        HAL_NVIC_DisableIRQ(self->irqn);
-        __HAL_UART_DISABLE_IT(&self->uart, UART_IT_RXNE);
     } else {
-        // read buffer using interrupts
         self->read_buf_len = args[6].u_int;
         self->read_buf = m_new(byte, args[6].u_int << self->char_width);
-        __HAL_UART_ENABLE_IT(&self->uart, UART_IT_RXNE);
+        if (dma->rx_stream != NULL) {
+            // read buffer filled round and round by the DMA
+            if (dma->rx_stream == DMA1_Stream1 || dma->rx_stream == DMA1_Stream2 || dma->rx_stream == DMA1_Stream5) {
+                __DMA1_CLK_ENABLE();
+            } else {
+                __DMA2_CLK_ENABLE();
+            }
+            uart_dma_init_stream(&self->rx_dma, dma->rx_stream, dma->rx_channel, DMA_PERIPH_TO_MEMORY, DMA_CIRCULAR, self->char_width);
+            HAL_DMA_Start(&self->rx_dma, (uint32_t)&self->uart.Instance->DR, (uint32_t)self->read_buf, self->read_buf_len);
+            self->uart.Instance->CR3 |= USART_CR3_DMAR;
+            __HAL_UART_ENABLE_IT(&self->uart, UART_IT_IDLE);
+        } else {
+            // read buffer using interrupts
+            __HAL_UART_ENABLE_IT(&self->uart, UART_IT_RXNE);
+        }
+    }
+
+    // setup the write buffer
+    self->write_buf_head = 0;
+    self->write_buf_tail = 0;
+    self->write_dma_len = 0;
+    if (args[7].u_int <= 0) {
+        // no write buffer, so writes wait for the data to go out
+        self->write_buf_len = 0;
+        self->write_buf = NULL;
+    } else {
+        // one slot is always kept free, so the buffer needs at least 2
+        self->write_buf_len = MAX(2, args[7].u_int);
+        self->write_buf = m_new(byte, self->write_buf_len << self->char_width);
+        if (dma->tx_stream != NULL) {
+            // write buffer drained by the DMA, a run of chars at a time
+            if (dma->tx_stream == DMA1_Stream3 || dma->tx_stream == DMA1_Stream4 || dma->tx_stream == DMA1_Stream6) {
+                __DMA1_CLK_ENABLE();
+            } else {
+                __DMA2_CLK_ENABLE();
+            }
+            uart_dma_init_stream(&self->tx_dma, dma->tx_stream, dma->tx_channel, DMA_MEMORY_TO_PERIPH, DMA_NORMAL, self->char_width);
+            self->tx_dma.Instance->PAR = (uint32_t)&self->uart.Instance->DR;
+            self->uart.Instance->CR3 |= USART_CR3_DMAT;
+        }
+        // otherwise it is drained by TXE interrupts, enabled as data is queued
+    }
+
+    // the IRQ is needed by either buffer
+    if (self->read_buf_len == 0 && self->write_buf_len == 0) {
+        HAL_NVIC_DisableIRQ(self->irqn);
+    } else {
         HAL_NVIC_SetPriority(self->irqn, 0xd, 0xd); // next-to-next-to lowest priority
         HAL_NVIC_EnableIRQ(self->irqn);
     }
@@ -498,6 +863,7 @@ STATIC mp_obj_t pyb_uart_deinit(mp_obj_t self_in) {
     pyb_uart_obj_t *self = self_in;
     self->is_enabled = false;
     UART_HandleTypeDef *uart = &self->uart;
+    uart_dma_deinit(self);
     HAL_UART_DeInit(uart);
     if (uart->Instance == USART1) {
         HAL_NVIC_DisableIRQ(USART1_IRQn);
@@ -551,7 +917,12 @@ STATIC mp_obj_t pyb_uart_writechar(mp_obj_t self_in, mp_obj_t char_in) {
     uint16_t data = mp_obj_get_int(char_in);
 
     // write the data
-    HAL_StatusTypeDef status = HAL_UART_Transmit(&self->uart, (uint8_t*)&data, 1, self->timeout);
+    HAL_StatusTypeDef status;
+    if (self->write_buf_len != 0) {
+        status = uart_tx_queue(self, (byte*)&data, 1) == 1 ? HAL_OK : HAL_TIMEOUT;
+    } else {
+        status = HAL_UART_Transmit(&self->uart, (uint8_t*)&data, 1, self->timeout);
+    }
 
     if (status != HAL_OK) {
         mp_hal_raise(status);
@@ -624,17 +995,23 @@ STATIC mp_uint_t pyb_uart_read(mp_obj_t self_in, void *buf_in, mp_uint_t size, i
         return 0;
     }
 
-    // read the data
+    // read the data, as much at a time as the read buffer has
     byte *orig_buf = buf;
     for (;;) {
-        int data = uart_rx_char(self);
-        if (self->char_width == CHAR_WIDTH_9BIT) {
-            *(uint16_t*)buf = data;
-            buf += 2;
-        } else {
-            *buf++ = data;
+        mp_uint_t n = uart_rx_copy(self, buf, size);
+        if (n == 0) {
+            // nothing buffered, so take the char from the data register
+            int data = uart_rx_char(self);
+            if (self->char_width == CHAR_WIDTH_9BIT) {
+                *(uint16_t*)buf = data;
+            } else {
+                *buf = data;
+            }
+            n = 1;
         }
-        if (--size == 0 || !uart_rx_wait(self, self->timeout_char)) {
+        buf += n << self->char_width;
+        size -= n;
+        if (size == 0 || !uart_rx_wait(self, self->timeout_char)) {
             // return number of bytes read
             return buf - orig_buf;
         }
@@ -651,6 +1028,16 @@ STATIC mp_uint_t pyb_uart_write(mp_obj_t self_in, const void *buf_in, mp_uint_t
         return MP_STREAM_ERROR;
     }
 
+    if (self->write_buf_len != 0) {
+        // queue the data, returning as soon as it is all in the write buffer
+        mp_uint_t n = uart_tx_queue(self, buf, size >> self->char_width);
+        if (n == 0) {
+            *errcode = mp_hal_status_to_errno_table[HAL_TIMEOUT];
+            return MP_STREAM_ERROR;
+        }
+        return n << self->char_width;
+    }
+
     // write the data
     HAL_StatusTypeDef status = HAL_UART_Transmit(&self->uart, (uint8_t*)buf, size >> self->char_width, self->timeout);
 
@@ -674,8 +1061,15 @@ STATIC mp_uint_t pyb_uart_ioctl(mp_obj_t self_in, mp_uint_t request, int *errcod
         if ((flags & MP_IOCTL_POLL_RD) && uart_rx_any(self)) {
             ret |= MP_IOCTL_POLL_RD;
         }
-        if ((flags & MP_IOCTL_POLL_WR) && __HAL_UART_GET_FLAG(&self->uart, UART_FLAG_TXE)) {
-            ret |= MP_IOCTL_POLL_WR;
+        if (flags & MP_IOCTL_POLL_WR) {
+            if (self->write_buf_len != 0) {
+                // writable while the write buffer has room
+                if ((self->write_buf_head + 1) % self->write_buf_len != self->write_buf_tail) {
+                    ret |= MP_IOCTL_POLL_WR;
+                }
+            } else if (__HAL_UART_GET_FLAG(&self->uart, UART_FLAG_TXE)) {
+                ret |= MP_IOCTL_POLL_WR;
+            }
         }
     } else {
         *errcode = EINVAL;
@@ -31,12 +31,16 @@
   ******************************************************************************
   */
 
+#include <string.h>
+
 #include "usbd_cdc_msc_hid.h"
 #include "usbd_msc_storage.h"
 
 #include "misc.h"
 #include "storage.h"
 #include "diskio.h"
+#include "ff.h"
+#include "fscache.h"
 #include "sdcard.h"
 
 // These are needed to support removal of the medium, so that the USB drive
@@ -45,6 +49,19 @@ static uint8_t flash_started = 0;
 
 #if MICROPY_HW_HAS_SDCARD
 static uint8_t sdcard_started = 0;
+
+// Card transfers for the SD card unit overlap the USB ones.  After each read
+// the blocks that follow are fetched in the background, on the guess that the
+// host reads sequentially, and each write is copied aside and left to run
+// while the next packet comes in.
+#define MSC_SD_IDLE (0)
+#define MSC_SD_PREFETCH (1)
+#define MSC_SD_WRITE (2)
+static uint8_t msc_sd_state = MSC_SD_IDLE;
+static uint32_t msc_sd_block;
+static uint16_t msc_sd_num;
+// word aligned and outside the CCM RAM, so the SD DMA can use it
+static uint32_t msc_sd_buf[MSC_MEDIA_PACKET / 4];
 #endif
 
 /******************************************************************************/
@@ -132,14 +149,9 @@ int8_t FLASH_STORAGE_PreventAllowMediumRemoval(uint8_t lun, uint8_t param) {
   * @retval Status
   */
 int8_t FLASH_STORAGE_Read(uint8_t lun, uint8_t *buf, uint32_t blk_addr, uint16_t blk_len) {
-    disk_read(0, buf, blk_addr, blk_len);
-    /*
-    for (int i = 0; i < blk_len; i++) {
-        if (!storage_read_block(buf + i * FLASH_BLOCK_SIZE, blk_addr + i)) {
-            return -1;
-        }
+    if (!storage_read_blocks(buf, blk_addr, blk_len)) {
+        return -1;
     }
-    */
     return 0;
 }
 
@@ -152,14 +164,11 @@ int8_t FLASH_STORAGE_Read(uint8_t lun, uint8_t *buf, uint32_t blk_addr, uint16_t
   * @retval Status
   */
 int8_t FLASH_STORAGE_Write (uint8_t lun, uint8_t *buf, uint32_t blk_addr, uint16_t blk_len) {
-    disk_write(0, buf, blk_addr, blk_len);
-    /*
-    for (int i = 0; i < blk_len; i++) {
-        if (!storage_write_block(buf + i * FLASH_BLOCK_SIZE, blk_addr + i)) {
-            return -1;
-        }
+    // the host may have changed any file, so drop all cached lookups
+    fscache_invalidate();
+    if (!storage_write_blocks(buf, blk_addr, blk_len)) {
+        return -1;
     }
-    */
     return 0;
 }
 
@@ -206,6 +215,19 @@ static const int8_t SDCARD_STORAGE_Inquirydata[] = { // 36 bytes
     '1', '.', '0' ,'0',                     // Version      : 4 Bytes
 };
 
+// Collect the background transfer, returning -1 if it was a write that failed.
+static int8_t msc_sd_finish(void) {
+    uint8_t state = msc_sd_state;
+    if (state == MSC_SD_IDLE) {
+        return 0;
+    }
+    msc_sd_state = MSC_SD_IDLE;
+    if (sdcard_transfer_finish() != 0 && state == MSC_SD_WRITE) {
+        return -1;
+    }
+    return 0;
+}
+
 /**
   * @brief  Initialize the storage medium
   * @param  lun : logical unit number
@@ -282,6 +304,7 @@ int8_t SDCARD_STORAGE_IsWriteProtected(uint8_t lun) {
 
 // Remove the lun
 int8_t SDCARD_STORAGE_StartStopUnit(uint8_t lun, uint8_t started) {
+    msc_sd_finish();
     sdcard_started = started;
     return 0;
 }
@@ -299,9 +322,25 @@ int8_t SDCARD_STORAGE_PreventAllowMediumRemoval(uint8_t lun, uint8_t param) {
   * @retval Status
   */
 int8_t SDCARD_STORAGE_Read(uint8_t lun, uint8_t *buf, uint32_t blk_addr, uint16_t blk_len) {
-    if (sdcard_read_blocks(buf, blk_addr, blk_len) != 0) {
+    if (msc_sd_state == MSC_SD_PREFETCH && msc_sd_block == blk_addr && msc_sd_num == blk_len) {
+        msc_sd_state = MSC_SD_IDLE;
+        if (sdcard_transfer_finish() == 0) {
+            memcpy(buf, msc_sd_buf, blk_len * SDCARD_BLOCK_SIZE);
+        } else if (sdcard_read_blocks(buf, blk_addr, blk_len) != 0) {
+            return -1;
+        }
+    } else if (msc_sd_finish() != 0 || sdcard_read_blocks(buf, blk_addr, blk_len) != 0) {
         return -1;
     }
+
+    // fetch the following blocks while these go to the host
+    uint32_t next = blk_addr + blk_len;
+    if (next + blk_len <= sdcard_get_capacity_in_bytes() / SDCARD_BLOCK_SIZE
+        && sdcard_read_blocks_start((uint8_t*)msc_sd_buf, next, blk_len) == 0) {
+        msc_sd_state = MSC_SD_PREFETCH;
+        msc_sd_block = next;
+        msc_sd_num = blk_len;
+    }
     return 0;
 }
 
@@ -314,12 +353,30 @@ int8_t SDCARD_STORAGE_Read(uint8_t lun, uint8_t *buf, uint32_t blk_addr, uint16_
   * @retval Status
   */
 int8_t SDCARD_STORAGE_Write(uint8_t lun, uint8_t *buf, uint32_t blk_addr, uint16_t blk_len) {
-    if (sdcard_write_blocks(buf, blk_addr, blk_len) != 0) {
+    fscache_invalidate();
+    // a failure of the previous packet's write fails this command, since the
+    // last packet of each command is waited for by SDCARD_STORAGE_Flush
+    if (msc_sd_finish() != 0) {
+        return -1;
+    }
+    // the buffer passed in is refilled with the next packet straight away
+    memcpy(msc_sd_buf, buf, blk_len * SDCARD_BLOCK_SIZE);
+    if (sdcard_write_blocks_start((uint8_t*)msc_sd_buf, blk_addr, blk_len) != 0) {
         return -1;
     }
+    msc_sd_state = MSC_SD_WRITE;
     return 0;
 }
 
+/**
+  * @brief  Wait for a write still in progress on the medium
+  * @param  lun : logical unit number
+  * @retval Status
+  */
+int8_t SDCARD_STORAGE_Flush(uint8_t lun) {
+    return msc_sd_finish();
+}
+
 /**
   * @brief  Return number of supported logical unit
   * @param  None
@@ -340,6 +397,7 @@ const USBD_StorageTypeDef USBD_SDCARD_STORAGE_fops = {
     SDCARD_STORAGE_Write,
     SDCARD_STORAGE_GetMaxLun,
     (int8_t *)SDCARD_STORAGE_Inquirydata,
+    SDCARD_STORAGE_Flush,
 };
 
 #endif // MICROPY_HW_HAS_SDCARD
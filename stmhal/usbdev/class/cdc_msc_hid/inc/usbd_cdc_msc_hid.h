@@ -64,6 +64,7 @@ typedef struct _USBD_STORAGE {
   int8_t (* Write)(uint8_t lun, uint8_t *buf, uint32_t blk_addr, uint16_t blk_len);
   int8_t (* GetMaxLun)(void);
   int8_t *pInquiry;
+  int8_t (* Flush)(uint8_t lun); // may be NULL; called at the end of each write command
 } USBD_StorageTypeDef;
 
 typedef struct {
@@ -769,6 +769,16 @@ static int8_t SCSI_ProcessWrite (USBD_HandleTypeDef  *pdev, uint8_t lun)
   
   if (hmsc->scsi_blk_len == 0)
   {
+    /* the medium may still be writing the last packet */
+    if(((USBD_StorageTypeDef *)pdev->pUserData)->Flush != NULL &&
+       ((USBD_StorageTypeDef *)pdev->pUserData)->Flush(lun) < 0)
+    {
+      SCSI_SenseCode(pdev,
+                     lun, 
+                     HARDWARE_ERROR, 
+                     WRITE_FAULT);     
+      return -1; 
+    }
     MSC_BOT_SendCSW (pdev, USBD_CSW_CMD_PASSED);
   }
   else
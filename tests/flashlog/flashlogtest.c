@@ -0,0 +1,316 @@
+// --------------------------------------------------------------------------------------
+// Module     : FLASHLOGTEST
+// Runs stmhal/flashlog.c on a RAM stand-in for the flash sectors.
+//
+//   flashlogtest [n]    run n random power losses (default 20000)
+//
+// The stand-in only clears bits when programming, as flash does, and can stop
+// programming part way through a record, or erasing part way through a sector,
+// to act as a power loss.  The tests check that records come back in order
+// after the log wraps round the ring, that a record whose data or CRC is
+// damaged is skipped, and that after a power loss the log mounts with every
+// record before the lost one intact and carries on appending.
+// --------------------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "flashlog.h"
+
+#define SECTOR_SIZE (4096)
+#define NUM_SECTORS (3)
+#define MAX_REC_LEN (100)
+
+static uint8_t *flash;
+static int erases[NUM_SECTORS];
+static long program_budget = -1;    // words programmed before power is lost; -1 for no limit
+static bool erase_cut;              // erase only the first half of the next sector
+static long erase_cuts;
+static flashlog_t log_obj;
+static long failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            if (failures++ < 20) { \
+                printf("FAIL line %d: %s\n", __LINE__, #cond); \
+            } \
+        } \
+    } while (0)
+
+static uint32_t flash_addr(uint32_t off)
+{
+    return (uint32_t)(uintptr_t)flash + off;
+}
+
+static void ram_erase(uint32_t addr, uint32_t len)
+{
+    uint32_t off = addr - flash_addr(0);
+    CHECK(off % SECTOR_SIZE == 0 && len == SECTOR_SIZE);
+    if (erase_cut) {
+        erase_cut = false;
+        erase_cuts += 1;
+        len /= 2;
+    }
+    memset(flash + off, 0xff, len);
+    erases[off / SECTOR_SIZE] += 1;
+}
+
+static void ram_program(uint32_t addr, const uint32_t *src, uint32_t num_word32)
+{
+    uint32_t *dest = (uint32_t*)(uintptr_t)addr;
+    for (uint32_t i = 0; i < num_word32; i++) {
+        if (program_budget == 0) {
+            return;
+        }
+        if (program_budget > 0) {
+            program_budget -= 1;
+        }
+        // flash can only clear bits, and words are only programmed once
+        CHECK(dest[i] == 0xffffffff);
+        dest[i] &= src[i];
+    }
+}
+
+static void mount(void)
+{
+    log_obj.base = flash_addr(0);
+    log_obj.sector_size = SECTOR_SIZE;
+    log_obj.num_sectors = NUM_SECTORS;
+    log_obj.erase = ram_erase;
+    log_obj.program = ram_program;
+    flashlog_mount(&log_obj);
+}
+
+// Record v holds v and then bytes derived from it, so that it can be checked
+// on its own, and its length varies with v.
+static uint32_t record_len(uint32_t v)
+{
+    return 4 + v % (MAX_REC_LEN - 3);
+}
+
+static int append(uint32_t v)
+{
+    uint8_t buf[MAX_REC_LEN];
+    uint32_t len = record_len(v);
+    memcpy(buf, &v, 4);
+    for (uint32_t i = 4; i < len; i++) {
+        buf[i] = v + i;
+    }
+    return flashlog_append(&log_obj, buf, len);
+}
+
+// Reads the whole log, checking each record and that they run on from one
+// another.  Returns the number of records, and the first and last of them.
+static int read_all(uint32_t *first, uint32_t *last)
+{
+    flashlog_iter_t iter;
+    flashlog_iter_init(&log_obj, &iter);
+    const uint8_t *data;
+    uint32_t len;
+    int n = 0;
+    int res;
+    *first = *last = 0;
+    while ((res = flashlog_iter_next(&log_obj, &iter, &data, &len)) == FLASHLOG_OK) {
+        uint32_t v;
+        memcpy(&v, data, 4);
+        CHECK(len == record_len(v));
+        for (uint32_t i = 4; i < len; i++) {
+            CHECK(data[i] == (uint8_t)(v + i));
+        }
+        if (n == 0) {
+            *first = v;
+        } else {
+            CHECK(v == *last + 1);
+        }
+        *last = v;
+        n += 1;
+    }
+    CHECK(res == FLASHLOG_END);
+    return n;
+}
+
+// returns the address of record v, or NULL if it isn't in the log
+static const uint8_t *find(uint32_t v)
+{
+    flashlog_iter_t iter;
+    flashlog_iter_init(&log_obj, &iter);
+    const uint8_t *data;
+    uint32_t len;
+    while (flashlog_iter_next(&log_obj, &iter, &data, &len) == FLASHLOG_OK) {
+        if (memcmp(data, &v, 4) == 0) {
+            return data;
+        }
+    }
+    return NULL;
+}
+
+static void test_append(void)
+{
+    uint32_t first, last;
+    mount();
+    CHECK(read_all(&first, &last) == 0);
+    for (uint32_t v = 1; v <= 100; v++) {
+        CHECK(append(v) == FLASHLOG_OK);
+    }
+    CHECK(read_all(&first, &last) == 100 && first == 1 && last == 100);
+    mount();
+    CHECK(read_all(&first, &last) == 100 && first == 1 && last == 100);
+
+    uint8_t big[SECTOR_SIZE];
+    memset(big, 0, sizeof(big));
+    CHECK(flashlog_append(&log_obj, big, flashlog_max_record_len(&log_obj) + 1) == FLASHLOG_TOO_BIG);
+    CHECK(flashlog_append(&log_obj, big, flashlog_max_record_len(&log_obj)) == FLASHLOG_OK);
+    flashlog_clear(&log_obj);
+    CHECK(read_all(&first, &last) == 0);
+    mount();
+    CHECK(read_all(&first, &last) == 0);
+    printf("append: ok\n");
+}
+
+static void test_wrap(void)
+{
+    uint32_t first, last;
+    memset(erases, 0, sizeof(erases));
+    mount();
+    int n = 0;
+    for (uint32_t v = 1; v <= 20000; v++) {
+        CHECK(append(v) == FLASHLOG_OK);
+        if (v % 1000 == 0) {
+            // the newest records are kept and the oldest dropped a sector at a time
+            n = read_all(&first, &last);
+            CHECK(last == v && first > 1 && n > 50);
+        }
+    }
+    mount();
+    CHECK(read_all(&first, &last) == n && last == 20000);
+
+    // each sector has been erased about as often as the others
+    int min = erases[0], max = erases[0];
+    for (int s = 1; s < NUM_SECTORS; s++) {
+        min = erases[s] < min ? erases[s] : min;
+        max = erases[s] > max ? erases[s] : max;
+    }
+    CHECK(min >= 100 && max - min <= 1);
+
+    // an iterator carries on past appends until its sector is reused
+    flashlog_iter_t iter;
+    flashlog_iter_init(&log_obj, &iter);
+    const uint8_t *data;
+    uint32_t len;
+    CHECK(flashlog_iter_next(&log_obj, &iter, &data, &len) == FLASHLOG_OK);
+    CHECK(append(20001) == FLASHLOG_OK);
+    CHECK(flashlog_iter_next(&log_obj, &iter, &data, &len) == FLASHLOG_OK);
+    for (uint32_t v = 20002; v < 20002 + 500; v++) {
+        append(v);
+    }
+    CHECK(flashlog_iter_next(&log_obj, &iter, &data, &len) == FLASHLOG_LOST);
+    printf("wrap: %d records kept, %d..%d erases per sector\n", n, min, max);
+}
+
+static void test_crc(void)
+{
+    flashlog_clear(&log_obj);
+    mount();
+    for (uint32_t v = 1; v <= 20; v++) {
+        append(v);
+    }
+
+    // a bit cleared in the data of record 5, and one flipped in the CRC of 12
+    uint8_t *d = (uint8_t*)find(5);
+    d[6] &= ~0x08;
+    d = (uint8_t*)find(12);
+    d[(record_len(12) + 3) & ~3] ^= 0x01;
+
+    flashlog_iter_t iter;
+    flashlog_iter_init(&log_obj, &iter);
+    const uint8_t *data;
+    uint32_t len;
+    int n = 0;
+    while (flashlog_iter_next(&log_obj, &iter, &data, &len) == FLASHLOG_OK) {
+        uint32_t v;
+        memcpy(&v, data, 4);
+        CHECK(v != 5 && v != 12);
+        n += 1;
+    }
+    CHECK(n == 18);
+
+    // the damaged records are stepped over when mounting too
+    mount();
+    append(21);
+    CHECK(find(20) != NULL && find(21) != NULL);
+    CHECK(find(5) == NULL && find(12) == NULL);
+    printf("crc: ok\n");
+}
+
+static void test_power_loss(long n)
+{
+    uint32_t first, last;
+    flashlog_clear(&log_obj);
+    mount();
+    uint32_t v = 1;
+    long lost = 0;
+    erase_cuts = 0;
+    for (long k = 0; k < n; k++) {
+        // lose power after a random number of words, often before the record
+        // is complete, and now and then half way through erasing the sector
+        // it starts
+        program_budget = rand() % 60;
+        if (rand() % 50 == 0) {
+            erase_cut = true;
+            program_budget = 0;
+        }
+        append(v);
+        bool cut = program_budget == 0;
+        program_budget = -1;
+        erase_cut = false;
+        if (!cut) {
+            v += 1;
+            continue;
+        }
+
+        lost += 1;
+        mount();
+        // every record before v is still there, and v is there only if it
+        // was written out in full
+        int m = read_all(&first, &last);
+        CHECK(m > 0 || v == 1);
+        CHECK(last == v || last == v - 1);
+        v = last + 1;
+    }
+    mount();
+    int m = read_all(&first, &last);
+    CHECK(last == v - 1);
+    for (int i = 0; i < 1000; i++) {
+        CHECK(append(v++) == FLASHLOG_OK);
+    }
+    CHECK(read_all(&first, &last) >= m / 2 && last == v - 1);
+    CHECK(erase_cuts > 0);
+    printf("power loss: %ld losses (%ld while erasing), %u records written\n", lost, erase_cuts, v - 1);
+}
+
+int main(int argc, char **argv)
+{
+    long n = argc > 1 ? atol(argv[1]) : 20000;
+
+    // flashlog addresses flash with 32 bit words, so keep it below 4GB
+    flash = mmap(NULL, SECTOR_SIZE * NUM_SECTORS, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (flash == MAP_FAILED) {
+        printf("can't map the flash below 4GB\n");
+        return 1;
+    }
+    memset(flash, 0xff, SECTOR_SIZE * NUM_SECTORS);
+
+    test_append();
+    test_wrap();
+    test_crc();
+    test_power_loss(n);
+
+    printf("%ld failures\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,279 @@
+// --------------------------------------------------------------------------------------
+// Module     : FORMATFLOATTEST
+// Checks py/formatfloat.c against the host C library, which rounds correctly, and
+// times both.
+//
+//   formatfloattest [n]    run n random cases of each kind (default 1000000)
+//
+// Formatting: 'r' output must read back to the same float and be no longer than the
+// shortest '%.*e' that does; 'e' and 'g' output must match printf exactly.
+// Parsing: float_from_decimal must match strtof on printed floats, on exact and
+// nearly exact half way points between floats, and on random decimal strings.
+// --------------------------------------------------------------------------------------
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "formatfloat.h"
+
+static uint64_t rng_state = 88172645463325252ULL;
+static long failures;
+
+static uint64_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static float float_from_bits(uint32_t u)
+{
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static uint32_t bits_from_float(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+static void fail(const char *what, const char *in, const char *got, const char *want)
+{
+    if (failures++ < 20) {
+        printf("FAIL %s: %s -> %s, want %s\n", what, in, got, want);
+    }
+}
+
+// Collect the digits the way mp_parse_num_decimal does for float builds: up to
+// 19 significant digits exactly, noting any non-zero digits dropped after that.
+static float parse_decimal(const char *s)
+{
+    uint64_t mant = 0;
+    int exp10 = 0;
+    bool truncated = false;
+    bool frac = false;
+    bool neg = false;
+    if (*s == '-') {
+        neg = true;
+        s++;
+    }
+    for (; *s != '\0'; s++) {
+        if (*s >= '0' && *s <= '9') {
+            int dig = *s - '0';
+            if (mant < 1000000000000000000ULL) {
+                mant = 10 * mant + dig;
+                exp10 -= frac;
+            } else {
+                truncated |= dig != 0;
+                exp10 += !frac;
+            }
+        } else if (*s == '.') {
+            frac = true;
+        } else if (*s == 'e' || *s == 'E') {
+            exp10 += atoi(s + 1);
+            break;
+        }
+    }
+    float f = float_from_decimal(mant, exp10, truncated);
+    return neg ? -f : f;
+}
+
+static void check_parse(const char *what, const char *s)
+{
+    float got = parse_decimal(s);
+    float want = strtof(s, NULL);
+    if (bits_from_float(got) != bits_from_float(want)) {
+        char g[32], w[32];
+        snprintf(g, sizeof(g), "%08x", bits_from_float(got));
+        snprintf(w, sizeof(w), "%08x", bits_from_float(want));
+        fail(what, s, g, w);
+    }
+}
+
+// number of significant digits in a %e or %g style string
+static int sig_digits(const char *s)
+{
+    int n = 0, zeros = 0;
+    bool started = false;
+    for (; *s != '\0' && *s != 'e' && *s != 'E'; s++) {
+        if (*s >= '1' && *s <= '9') {
+            n += zeros + 1;
+            zeros = 0;
+            started = true;
+        } else if (*s == '0' && started) {
+            zeros += 1;
+        }
+    }
+    return n;
+}
+
+static void check_format(float f)
+{
+    char got[64], want[64];
+
+    // 'r' reads back and is as short as possible
+    format_float(f, got, sizeof(got), 'r', 0, 0);
+    if (bits_from_float(strtof(got, NULL)) != bits_from_float(f)) {
+        snprintf(want, sizeof(want), "%.9g", f);
+        fail("'r' round trip", want, got, want);
+    }
+    for (int p = 0; p < 9; p++) {
+        snprintf(want, sizeof(want), "%.*e", p, f);
+        if (strtof(want, NULL) == f) {
+            if (sig_digits(got) > p + 1) {
+                fail("'r' shortest", want, got, want);
+            }
+            break;
+        }
+    }
+
+    // 'e' and 'g' match printf, which formats the exact value of the float
+    for (int p = 0; p <= 8; p += 2) {
+        format_float(f, got, sizeof(got), 'e', p, 0);
+        snprintf(want, sizeof(want), "%.*e", p, f);
+        if (strcmp(got, want) != 0) {
+            fail("'e'", want, got, want);
+        }
+    }
+    format_float(f, got, sizeof(got), 'g', 6, 0);
+    snprintf(want, sizeof(want), "%g", f);
+    if (strcmp(got, want) != 0) {
+        fail("'g'", want, got, want);
+    }
+}
+
+static void check_half_way(float f)
+{
+    // The point half way to the next float up is exact as a double.  The
+    // parser keeps 19 significant digits, and from those it can't round a
+    // longer string lying within 10^-19 of a half way point, so only strings
+    // of up to 19 digits are checked here.
+    float up = nextafterf(f, INFINITY);
+    if (isinf(up)) {
+        return;
+    }
+    double mid = ((double)f + (double)up) / 2;
+    char s[64];
+    snprintf(s, sizeof(s), "%.18e", mid);
+    if (strtod(s, NULL) == mid) {
+        // an exact tie, such as 8807845.5
+        check_parse("half way", s);
+    }
+    // and the point rounded to fewer digits, just above or below it
+    for (int p = 6; p <= 18; p += 2) {
+        snprintf(s, sizeof(s), "%.*e", p, mid);
+        check_parse("near half way", s);
+    }
+}
+
+static void random_decimal(char *s)
+{
+    int ndig = 1 + rng() % 25;
+    int point = rng() % (ndig + 1);
+    for (int i = 0; i < ndig; i++) {
+        if (i == point) {
+            *s++ = '.';
+        }
+        *s++ = '0' + rng() % 10;
+    }
+    sprintf(s, "e%d", (int)(rng() % 100) - 55);
+}
+
+static double seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static float finite_float(void)
+{
+    float f;
+    do {
+        f = float_from_bits(rng());
+    } while (!isfinite(f));
+    return f;
+}
+
+static void bench(long n)
+{
+    char buf[64];
+    static char strs[1024][64];
+    float fs[1024];
+    for (int i = 0; i < 1024; i++) {
+        fs[i] = finite_float();
+        snprintf(strs[i], sizeof(strs[i]), "%.9e", fs[i]);
+    }
+    volatile float sink = 0;
+    double t;
+
+    t = seconds();
+    for (long i = 0; i < n; i++) {
+        format_float(fs[i & 1023], buf, sizeof(buf), 'r', 0, 0);
+    }
+    printf("format_float 'r'  %6.1f ns\n", (seconds() - t) * 1e9 / n);
+    t = seconds();
+    for (long i = 0; i < n; i++) {
+        format_float(fs[i & 1023], buf, sizeof(buf), 'g', 6, 0);
+    }
+    printf("format_float 'g'  %6.1f ns\n", (seconds() - t) * 1e9 / n);
+    t = seconds();
+    for (long i = 0; i < n; i++) {
+        snprintf(buf, sizeof(buf), "%g", fs[i & 1023]);
+    }
+    printf("snprintf %%g       %6.1f ns\n", (seconds() - t) * 1e9 / n);
+    t = seconds();
+    for (long i = 0; i < n; i++) {
+        sink += parse_decimal(strs[i & 1023]);
+    }
+    printf("float_from_decimal %5.1f ns (with digit collection)\n", (seconds() - t) * 1e9 / n);
+    t = seconds();
+    for (long i = 0; i < n; i++) {
+        sink += strtof(strs[i & 1023], NULL);
+    }
+    printf("strtof            %6.1f ns\n", (seconds() - t) * 1e9 / n);
+}
+
+int main(int argc, char **argv)
+{
+    long n = argc > 1 ? atol(argv[1]) : 1000000;
+    char s[64];
+
+    // every power of two and its neighbours, then random bit patterns
+    for (int e = 0; e < 255; e++) {
+        for (int d = -2; d <= 2; d++) {
+            uint32_t u = ((uint32_t)e << 23) + d;
+            if (e == 0 && d < 0) {
+                continue;
+            }
+            check_format(float_from_bits(u));
+            check_half_way(float_from_bits(u));
+        }
+    }
+    for (long i = 0; i < n; i++) {
+        float f = finite_float();
+        check_format(f);
+        check_half_way(fabsf(f));
+        snprintf(s, sizeof(s), "%.9e", f);
+        check_parse("printed", s);
+        random_decimal(s);
+        check_parse("random", s);
+    }
+    check_parse("tie", "8807845.5");
+    check_parse("tie", "16777217");
+    check_parse("tie", "16777219.0");
+    check_parse("tie", "8807845.50000000000000000001");
+
+    printf("%ld failures\n", failures);
+    bench(n);
+    return failures != 0;
+}
@@ -0,0 +1,12 @@
+// Just enough configuration to build py/formatfloat.c on the host.
+
+#include <stdint.h>
+
+#define MICROPY_FLOAT_IMPL (MICROPY_FLOAT_IMPL_FLOAT)
+
+#define BYTES_PER_WORD (8)
+typedef int64_t mp_int_t;
+typedef uint64_t mp_uint_t;
+typedef void *machine_ptr_t;
+typedef const void *machine_const_ptr_t;
+typedef long mp_off_t;